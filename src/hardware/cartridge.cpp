@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <cassert>
 #include <memory>
+#include <algorithm>
 #include <chrono>
 #include <ctime>
 
@@ -26,6 +27,7 @@ const uint16_t Cartridge::ROM_CGB_OFFSET      = 0x0143;
 const uint16_t Cartridge::ROM_TYPE_OFFSET     = 0x0147;
 const uint16_t Cartridge::ROM_SIZE_OFFSET     = 0x0148;
 const uint16_t Cartridge::ROM_RAM_SIZE_OFFSET = 0x0149;
+const uint16_t Cartridge::ROM_CHECKSUM_END    = 0x0150;
 
 const uint8_t Cartridge::ROM_NAME_MAX_LENGTH = 0x10;
 
@@ -42,10 +44,13 @@ const vector<uint16_t> Cartridge::RAM_SIZES = {
     0x0000, 0x0800, 0x2000, 0x8000,
 };
 
-Cartridge::Cartridge(const string & path)
+const vector<Cartridge::RamBank> Cartridge::NO_RAM;
+
+Cartridge::Cartridge(const string & path, EmuMode mode, const RealTimeClock & clock)
     : m_path(path),
       m_valid(false),
-      m_cgb(false)
+      m_cgb(false),
+      m_clock(clock)
 {
     ifstream input(m_path, std::ios::in | std::ios::binary);
     if (!input.is_open()) { return; }
@@ -89,7 +94,7 @@ Cartridge::Cartridge(const string & path)
 
     assert(m_bank);
 
-    m_cgb = getCgbMode();
+    m_cgb = getCgbMode(mode);
 
     NOTE("ROM Name: %s\n", m_info.name.c_str());
 
@@ -99,11 +104,52 @@ Cartridge::Cartridge(const string & path)
     m_valid = true;
 }
 
-bool Cartridge::getCgbMode() const
+void Cartridge::saveState(StateWriter & state) const
+{
+    state.put(m_valid);
+    if (!m_valid) { return; }
+
+    // The header (from the name through the checksums) is what tells us that
+    // a state gets loaded back in to the same game that it came from.
+    state.put(&m_memory.at(ROM_NAME_OFFSET), ROM_CHECKSUM_END - ROM_NAME_OFFSET);
+    state.put(m_cgb);
+
+    m_bank->saveState(state);
+}
+
+bool Cartridge::loadState(StateReader & state)
+{
+    bool valid = false;
+    if (!state.get(valid)) { return false; }
+
+    if (valid != m_valid) { return state.fail(); }
+    if (!m_valid) { return true; }
+
+    vector<uint8_t> header(ROM_CHECKSUM_END - ROM_NAME_OFFSET);
+    if (!state.get(header)) { return false; }
+
+    bool cgb = false;
+    if (!state.get(cgb)) { return false; }
+
+    if (!std::equal(header.begin(), header.end(), m_memory.begin() + ROM_NAME_OFFSET)) {
+        return state.fail();
+    }
+    if (cgb != m_cgb) { return state.fail(); }
+
+    return m_bank->loadState(state);
+}
+
+bool Cartridge::supportsCGB() const
+{
+    if (!m_valid) { return false; }
+
+    return (m_memory.at(ROM_CGB_OFFSET) & ROM_DUAL_SUPPORT);
+}
+
+bool Cartridge::getCgbMode(EmuMode mode) const
 {
     uint8_t flag = m_memory.at(ROM_CGB_OFFSET);
 
-    EmuMode mode = EmuMode(Configuration::getInt(ConfigKey::EMU_MODE));
     switch (mode) {
     default:
         WARN("Requested unknown emulation mode: %d\n", int(mode));
@@ -230,12 +276,49 @@ void Cartridge::MemoryBankController::initRAM(const string & name)
     m_nvRam = ofstream(name, std::ios::out | std::ios::binary);
     if (!m_nvRam) { return; }
 
+    storeRAM();
+}
+
+void Cartridge::MemoryBankController::storeRAM()
+{
+    m_nvRam.seekp(0);
     for (auto & bank : m_ram) {
         m_nvRam.write(reinterpret_cast<char*>(bank.data()), bank.size());
     }
     m_nvRam.flush();
 }
 
+void Cartridge::MemoryBankController::saveState(StateWriter & state) const
+{
+    state.put(m_ramEnable);
+    state.put(m_romBank);
+    state.put(m_ramBank);
+
+    state.put(uint32_t(m_ram.size()));
+    for (const auto & bank : m_ram) {
+        state.put(bank.data(), bank.size());
+    }
+}
+
+bool Cartridge::MemoryBankController::loadState(StateReader & state)
+{
+    uint32_t banks = 0;
+    if (!state.get(m_ramEnable) || !state.get(m_romBank) || !state.get(m_ramBank)) {
+        return false;
+    }
+    if (!state.get(banks)) { return false; }
+
+    if (banks != m_ram.size()) { return state.fail(); }
+    for (auto & bank : m_ram) {
+        if (!state.get(bank.data(), bank.size())) { return false; }
+    }
+
+    // The battery backed RAM is whatever the game has in there now, so the
+    // save file has to follow along with the state that we just loaded.
+    if (m_nvRam.good()) { storeRAM(); }
+    return true;
+}
+
 void Cartridge::MemoryBankController::writeRAM(uint16_t address, uint8_t value)
 {
     if (!m_ramEnable) { return; }
@@ -320,12 +403,28 @@ void Cartridge::MBC1::writeROM(uint16_t address, uint8_t value)
         assert(0);
     }
 }
+
+void Cartridge::MBC1::saveState(StateWriter & state) const
+{
+    MemoryBankController::saveState(state);
+    state.put(m_mode);
+}
+
+bool Cartridge::MBC1::loadState(StateReader & state)
+{
+    return MemoryBankController::loadState(state) && state.get(m_mode);
+}
 ////////////////////////////////////////////////////////////////////////////////
 
 ////////////////////////////////////////////////////////////////////////////////
 Cartridge::MBC3::MBC3(Cartridge & cartridge, uint16_t size, bool battery)
     : MemoryBankController(cartridge, "MBC3", size, battery),
-      m_latch(0x00)
+      m_latch(0x00),
+      m_clock(cartridge.m_clock),
+      m_counted(uint64_t(m_clock.start) * TICKS_PER_SECOND),
+      m_reference((isEmulated()) ? m_clock.ticks() : 0),
+      m_halted(false),
+      m_carry(false)
 {
     m_rtc.seconds = m_rtc.minutes = m_rtc.hours = m_rtc.day[0] = 0x00;
 
@@ -379,6 +478,9 @@ void Cartridge::MBC3::writeRAM(uint16_t address, uint8_t value)
         case RtcDayLower: m_rtc.day[0]  = value; break;
         case RtcDayUpper: m_rtc.day[1]  = value; break;
         }
+
+        // The emulated clock keeps its own time, so it needs to be set too.
+        if (isEmulated()) { set(m_ramBank, value); }
     }
 }
 
@@ -408,24 +510,125 @@ void Cartridge::MBC3::writeROM(uint16_t address, uint8_t value)
     }
 }
 
+void Cartridge::MBC3::saveState(StateWriter & state) const
+{
+    MemoryBankController::saveState(state);
+    state.put(m_rtc);
+    state.put(m_latch);
+
+    // The emulated tick count isn't part of the state, so the clock goes out
+    // as however much time it has counted so far.
+    state.put(counted());
+    state.put(m_halted);
+    state.put(m_carry);
+}
+
+bool Cartridge::MBC3::loadState(StateReader & state)
+{
+    bool loaded = MemoryBankController::loadState(state)
+        && state.get(m_rtc)
+        && state.get(m_latch)
+        && state.get(m_counted)
+        && state.get(m_halted)
+        && state.get(m_carry);
+
+    m_reference = (isEmulated()) ? m_clock.ticks() : 0;
+    return loaded;
+}
+
+uint64_t Cartridge::MBC3::counted() const
+{
+    if (m_halted || !isEmulated()) { return m_counted; }
+
+    return m_counted + (m_clock.ticks() - m_reference);
+}
+
+void Cartridge::MBC3::advance()
+{
+    m_counted   = counted();
+    m_reference = m_clock.ticks();
+
+    // The carry stays set until the game clears it, no matter how many more
+    // times that the day counter rolls over.
+    const uint64_t rollover = RTC_DAYS_MAX * SECONDS_PER_DAY * TICKS_PER_SECOND;
+    if (m_counted >= rollover) {
+        m_counted %= rollover;
+        m_carry = true;
+    }
+}
+
+void Cartridge::MBC3::set(uint8_t select, uint8_t value)
+{
+    advance();
+
+    uint64_t seconds  = m_counted / TICKS_PER_SECOND;
+    uint64_t fraction = m_counted % TICKS_PER_SECOND;
+
+    uint64_t second = seconds % 60;
+    uint64_t minute = (seconds / 60) % 60;
+    uint64_t hour   = (seconds / 3600) % 24;
+    uint64_t day    = seconds / SECONDS_PER_DAY;
+
+    switch (select) {
+    // Whoever called us already complained about the register.
+    default: return;
+
+    // Writing the seconds starts the current second over.
+    case RtcSeconds:
+        second   = value & 0x3F;
+        fraction = 0;
+        break;
+
+    case RtcMinutes:  minute = value & 0x3F; break;
+    case RtcHours:    hour   = value & 0x1F; break;
+    case RtcDayLower: day    = (day & 0x100) | value; break;
+
+    case RtcDayUpper:
+        day = (day & 0xFF) | (uint64_t(value & RTC_DAY_MSB) << 8);
+
+        m_halted = (0 != (value & RTC_HALT));
+        m_carry  = (0 != (value & RTC_DAY_CARRY));
+        break;
+    }
+
+    seconds = second + (minute * 60) + (hour * 3600) + (day * SECONDS_PER_DAY);
+    m_counted = (seconds * TICKS_PER_SECOND) + fraction;
+}
+
 void Cartridge::MBC3::latch()
 {
+    if (isEmulated()) {
+        advance();
+        latch(m_counted / TICKS_PER_SECOND);
+
+        m_rtc.day[1] &= uint8_t(~(RTC_HALT | RTC_DAY_CARRY));
+        if (m_halted) { m_rtc.day[1] |= RTC_HALT; }
+        if (m_carry)  { m_rtc.day[1] |= RTC_DAY_CARRY; }
+        return;
+    }
+
     time_t timestamp = system_clock::to_time_t(system_clock::now());
 
     std::tm *now = std::localtime(&timestamp);
     if (now) {
-        m_rtc.seconds = now->tm_sec;
-        m_rtc.minutes = now->tm_min;
-        m_rtc.hours   = now->tm_hour;
-
-        // The day is stored in 9 bits.  The lower 8 bits are stored in the
-        // lower day register, and the MSB is stored in the LSB of the
-        // upper day register.
-        uint16_t days = now->tm_yday;
-        m_rtc.day[0] = days & 0xFF;
-        m_rtc.day[1] = (m_rtc.day[1] & 0xFE) | ((days >> 7) & 0x01);
+        uint64_t seconds = now->tm_sec + (now->tm_min * 60) + (now->tm_hour * 3600);
+        latch(seconds + (uint64_t(now->tm_yday) * SECONDS_PER_DAY));
     } else {
         WARN("%s\n", "Failed to latch current time");
     }
 }
+
+void Cartridge::MBC3::latch(uint64_t seconds)
+{
+    m_rtc.seconds = uint8_t(seconds % 60);
+    m_rtc.minutes = uint8_t((seconds / 60) % 60);
+    m_rtc.hours   = uint8_t((seconds / 3600) % 24);
+
+    // The day is stored in 9 bits.  The lower 8 bits are stored in the
+    // lower day register, and the MSB is stored in the LSB of the
+    // upper day register.
+    uint64_t days = (seconds / SECONDS_PER_DAY) % RTC_DAYS_MAX;
+    m_rtc.day[0] = uint8_t(days & 0xFF);
+    m_rtc.day[1] = uint8_t((m_rtc.day[1] & ~RTC_DAY_MSB) | ((days >> 8) & RTC_DAY_MSB));
+}
 ////////////////////////////////////////////////////////////////////////////////
@@ -7,12 +7,25 @@
 #include <memory>
 #include <fstream>
 #include <array>
+#include <functional>
 
 #include "memmap.h"
+#include "configuration.h"
+#include "savestate.h"
 
 class Cartridge {
 public:
-    explicit Cartridge(const std::string & path);
+    // Where the cartridge's real time clock (if it has one) gets the time
+    // from.  Without a tick source, it follows the host's clock just like a
+    // real cartridge does.  Otherwise, it counts emulated ticks of the ~4MHz
+    // clock starting from the start time (in seconds), which makes it read
+    // the same thing every time that a game gets played the same way.
+    struct RealTimeClock {
+        std::function<uint64_t()> ticks;
+        uint32_t start;
+    };
+
+    Cartridge(const std::string & path, EmuMode mode, const RealTimeClock & clock = RealTimeClock());
     ~Cartridge() = default;
 
     inline bool isValid() const { return m_valid; }
@@ -22,9 +35,25 @@ public:
 
     inline bool isCGB() const { return m_cgb; }
 
+    // Whether the game itself knows about the CGB, which isn't the same
+    // thing as running on one (a DMG game can run on a CGB too).
+    bool supportsCGB() const;
+
+    // Every bank of the ROM, one after the other.
+    inline const std::vector<uint8_t> & rom() const { return m_memory; }
+
     inline uint8_t romBank() const { return (m_bank) ? m_bank->romBank() : 0; }
     inline uint8_t ramBank() const { return (m_bank) ? m_bank->ramBank() : 0; }
 
+    using RamBank = std::array<uint8_t, EXT_RAM_SIZE>;
+
+    // Every bank of RAM that the cartridge has, which is empty until a
+    // cartridge gets loaded.
+    inline const std::vector<RamBank> & ram() const { return (m_bank) ? m_bank->ram() : NO_RAM; }
+
+    void saveState(StateWriter & state) const;
+    bool loadState(StateReader & state);
+
 private:
     static constexpr uint32_t ROM_MAX_SIZE = 2097152; // 2MB
 
@@ -36,6 +65,7 @@ private:
     static const uint16_t ROM_SIZE_OFFSET;
     static const uint16_t ROM_CGB_OFFSET;
     static const uint16_t ROM_RAM_SIZE_OFFSET;
+    static const uint16_t ROM_CHECKSUM_END;
     static const uint8_t ROM_NAME_MAX_LENGTH;
 
     static constexpr uint8_t ROM_DUAL_SUPPORT = 0x80;
@@ -45,6 +75,8 @@ private:
 
     static const std::vector<uint16_t> RAM_SIZES;
 
+    static const std::vector<RamBank> NO_RAM;
+
     enum BankType {
         MBC_NONE = 0x00,
         MBC_1    = 0x01,
@@ -89,6 +121,11 @@ private:
         inline uint8_t romBank() const { return m_romBank; }
         inline uint8_t ramBank() const { return m_ramBank; }
 
+        inline const std::vector<RamBank> & ram() const { return m_ram; }
+
+        virtual void saveState(StateWriter & state) const;
+        virtual bool loadState(StateReader & state);
+
     protected:
         static uint8_t RAM_DISABLED;
 
@@ -96,7 +133,7 @@ private:
 
         std::string m_name;
 
-        std::vector<std::array<uint8_t, EXT_RAM_SIZE>> m_ram;
+        std::vector<RamBank> m_ram;
 
         bool m_ramEnable;
 
@@ -109,6 +146,7 @@ private:
 
     private:
         void initRAM(const std::string & name);
+        void storeRAM();
     };
 
     class MBC1 : public MemoryBankController {
@@ -118,6 +156,9 @@ private:
 
         void writeROM(uint16_t address, uint8_t value) override;
 
+        void saveState(StateWriter & state) const override;
+        bool loadState(StateReader & state) override;
+
     private:
         Cartridge::BankMode m_mode;
     };
@@ -140,9 +181,22 @@ private:
 
         uint8_t & readRAM(uint16_t address) override;
 
+        void saveState(StateWriter & state) const override;
+        bool loadState(StateReader & state) override;
+
     private:
         static constexpr uint8_t RAM_BANK_COUNT = 4;
 
+        static constexpr uint64_t TICKS_PER_SECOND = 4194304;
+        static constexpr uint64_t SECONDS_PER_DAY  = 86400;
+
+        // The day counter is 9 bits, and the rest of it lives in the upper
+        // day register along with the halt flag and the counter's carry.
+        static constexpr uint16_t RTC_DAYS_MAX  = 512;
+        static constexpr uint8_t  RTC_DAY_MSB   = 0x01;
+        static constexpr uint8_t  RTC_HALT      = 0x40;
+        static constexpr uint8_t  RTC_DAY_CARRY = 0x80;
+
         enum RtcRegisterSelect {
             RtcSeconds  = 0x08,
             RtcMinutes  = 0x09,
@@ -161,7 +215,25 @@ private:
 
         uint8_t m_latch;
 
+        // Emulated time only.  The clock has counted m_counted ticks as of
+        // the emulated tick m_reference, and only counts while it's running.
+        const RealTimeClock & m_clock;
+
+        uint64_t m_counted;
+        uint64_t m_reference;
+
+        bool m_halted;
+        bool m_carry;
+
+        inline bool isEmulated() const { return bool(m_clock.ticks); }
+
+        uint64_t counted() const;
+        void advance();
+
         void latch();
+        void latch(uint64_t seconds);
+
+        void set(uint8_t select, uint8_t value);
     };
 
     std::vector<uint8_t> m_memory;
@@ -170,11 +242,13 @@ private:
 
     bool m_cgb;
 
+    RealTimeClock m_clock;
+
     MemoryBankController *initMemoryBankController(uint8_t type);
 
     inline std::string game() const { return m_info.name; }
 
-    bool getCgbMode() const;
+    bool getCgbMode(EmuMode mode) const;
 };
 
 #endif
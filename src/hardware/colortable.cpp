@@ -0,0 +1,92 @@
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#include "colortable.h"
+
+const ColorTable & ColorTable::get(GameBoyInterface::ColorCorrection curve)
+{
+    // Function local statics are only built once (and safely) no matter how
+    // many threads come asking for them, and a curve that nobody uses never
+    // costs us anything.
+    switch (curve) {
+    default:
+        assert(0);
+        [[fallthrough]];
+
+    case GameBoyInterface::COLOR_RAW: {
+        static const ColorTable table(GameBoyInterface::COLOR_RAW);
+        return table;
+    }
+    case GameBoyInterface::COLOR_LCD: {
+        static const ColorTable table(GameBoyInterface::COLOR_LCD);
+        return table;
+    }
+    case GameBoyInterface::COLOR_GAMMA: {
+        static const ColorTable table(GameBoyInterface::COLOR_GAMMA);
+        return table;
+    }
+    }
+}
+
+ColorTable::ColorTable(GameBoyInterface::ColorCorrection curve)
+{
+    auto convert = [curve](uint8_t red, uint8_t green, uint8_t blue) {
+        switch (curve) {
+        default:
+            assert(0);
+            [[fallthrough]];
+
+        case GameBoyInterface::COLOR_RAW:   return raw(red, green, blue);
+        case GameBoyInterface::COLOR_LCD:   return lcd(red, green, blue);
+        case GameBoyInterface::COLOR_GAMMA: return gamma(red, green, blue);
+        }
+    };
+
+    // RGB555 format (D = don't care): DBBBBBGGGGGRRRRR
+    for (uint16_t color = 0; color < COLOR_COUNT; color++) {
+        m_colors[color] = convert(
+            color & CHANNEL_MAX, (color >> 5) & CHANNEL_MAX, (color >> 10) & CHANNEL_MAX);
+    }
+}
+
+GB::RGB ColorTable::raw(uint8_t red, uint8_t green, uint8_t blue)
+{
+    // Normalize each channel to 1 and then scale it up to an 8 bit value.
+    auto convert = [](uint8_t value) -> uint8_t {
+        double normalized = double(value) / double(CHANNEL_MAX);
+        return uint8_t(0xFF * normalized);
+    };
+
+    return { convert(red), convert(green), convert(blue), 0xFF };
+}
+
+GB::RGB ColorTable::lcd(uint8_t red, uint8_t green, uint8_t blue)
+{
+    // The CGB screen bleeds each channel in to its neighbors and never gets
+    // all the way to full brightness, so the raw colors look a lot more
+    // saturated than they do on real hardware.  Mix the channels the way that
+    // the screen does and cap them at 240 to get a lot closer.
+    auto clamp = [](uint16_t value) -> uint8_t {
+        return uint8_t(std::min<uint16_t>(value, 960) >> 2);
+    };
+
+    return {
+        clamp((red * 26) + (green * 4) + (blue * 2)),
+        clamp((green * 24) + (blue * 8)),
+        clamp((red * 6) + (green * 4) + (blue * 22)),
+        0xFF
+    };
+}
+
+GB::RGB ColorTable::gamma(uint8_t red, uint8_t green, uint8_t blue)
+{
+    // Games were drawn for a screen that's a lot darker in the mid tones than
+    // a modern monitor, so brighten them back up.
+    auto convert = [](uint8_t value) -> uint8_t {
+        double normalized = double(value) / double(CHANNEL_MAX);
+        return uint8_t(std::lround(0xFF * std::pow(normalized, 1.0 / GAMMA)));
+    };
+
+    return { convert(red), convert(green), convert(blue), 0xFF };
+}
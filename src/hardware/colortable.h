@@ -0,0 +1,43 @@
+#ifndef COLOR_TABLE_H_
+#define COLOR_TABLE_H_
+
+#include <cstdint>
+#include <array>
+
+#include "gbrgb.h"
+#include "gameboyinterface.h"
+
+// Translates every possible RGB555 color in to the RGBA8888 value that we
+// hand out to the UI.  There's one table per color curve, and each one gets
+// built the first time that somebody asks for it and then shared by every
+// instance for the life of the process.
+class ColorTable final {
+public:
+    static constexpr uint16_t COLOR_COUNT = 0x8000;
+
+    static const ColorTable & get(GameBoyInterface::ColorCorrection curve);
+
+    ~ColorTable() = default;
+
+    ColorTable(const ColorTable &) = delete;
+    ColorTable(ColorTable &&) = delete;
+    ColorTable & operator=(const ColorTable &) = delete;
+
+    inline const GB::RGB & operator[](uint16_t color) const
+        { return m_colors[color & (COLOR_COUNT - 1)]; }
+
+private:
+    static constexpr uint8_t CHANNEL_MAX = 0x1F;
+
+    static constexpr double GAMMA = 2.2;
+
+    std::array<GB::RGB, COLOR_COUNT> m_colors;
+
+    explicit ColorTable(GameBoyInterface::ColorCorrection curve);
+
+    static GB::RGB raw(uint8_t red, uint8_t green, uint8_t blue);
+    static GB::RGB lcd(uint8_t red, uint8_t green, uint8_t blue);
+    static GB::RGB gamma(uint8_t red, uint8_t green, uint8_t blue);
+};
+
+#endif /* COLOR_TABLE_H_ */
@@ -9,16 +9,15 @@
 
 using namespace std::chrono_literals;
 
-ConsoleLink::ConsoleLink(MemoryController & memory)
+ConsoleLink::ConsoleLink(MemoryController & memory, const ConfigSnapshot & config)
     : m_memory(memory),
+      m_master(config.getBool(ConfigKey::LINK_MASTER)),
       m_ticks(0),
       m_poll(0),
       m_interrupt(false),
       m_connected(false),
       m_state(ConsoleLink::STATE_DISCONNECTED)
 {
-    m_master = Configuration::getBool(ConfigKey::LINK_MASTER);
-
     m_queue.tx.ready = false;
     m_queue.rx.ready = false;
 }
@@ -33,10 +32,13 @@ void ConsoleLink::stop()
 
 void ConsoleLink::cycle(uint8_t ticks)
 {
-    // TODO: Need to handle CGB high speed mode here, which should just shift
-    //       these values down by 1 (i.e. double the speed)
-    const uint16_t count = (m_memory.read(SERIAL_CONTROL_ADDRESS) & LINK_SPEED) ?
-        LINK_SPEED_FAST : LINK_SPEED_NORMAL;
+    // The internal clock runs off of the CPU's clock, so it goes twice as
+    // fast in double speed mode, while the ticks that we get don't.
+    const uint8_t shift =
+        (m_memory.isCGB() && (m_memory.read(CGB_SPEED_SWITCH_ADDRESS) & CGB_SPEED_DOUBLE)) ? 1 : 0;
+
+    const uint16_t count = ((m_memory.read(SERIAL_CONTROL_ADDRESS) & LINK_SPEED) ?
+        LINK_SPEED_FAST : LINK_SPEED_NORMAL) >> shift;
 
     m_ticks += ticks;
     while (m_ticks >= count) {
@@ -87,7 +89,7 @@ void ConsoleLink::finishTransfer(uint8_t data)
     uint8_t & current = m_memory.read(SERIAL_CONTROL_ADDRESS);
     current &= ~ConsoleLink::LINK_TRANSFER;
 
-    Interrupts::set(m_memory, InterruptMask::SERIAL);
+    m_memory.interrupts().raise(InterruptMask::SERIAL);
 
     m_state =
         (STATE_PENDING == m_state) ? STATE_IDLE : STATE_DISCONNECTED;
@@ -8,6 +8,7 @@
 #include <utility>
 
 class MemoryController;
+class ConfigSnapshot;
 
 class ConsoleLink {
 public:
@@ -17,7 +18,7 @@ public:
         LINK_CLOCK    = 0x01,
     };
 
-    explicit ConsoleLink(MemoryController & memory);
+    ConsoleLink(MemoryController & memory, const ConfigSnapshot & config);
     virtual ~ConsoleLink() = default;
 
     virtual void stop();
@@ -29,6 +30,8 @@ protected:
     static constexpr uint16_t LINK_SPEED_NORMAL = 4096;
     static constexpr uint16_t LINK_SPEED_FAST   = 128;
 
+    static constexpr uint8_t CGB_SPEED_DOUBLE = 0x80;
+
     MemoryController & m_memory;
 
     bool m_master;
@@ -0,0 +1,358 @@
+/*
+ * disassembler.cpp
+ *
+ * Cache layout:
+ *   The cache is a StateWriter stream with the magic number, the version,
+ *   the hash and size of the ROM that it goes with, and then the bank and
+ *   address of every instruction that has been found.  The instructions
+ *   themselves get decoded again from the ROM when the cache is loaded, so a
+ *   cache that doesn't line up with the ROM (or with the opcode tables)
+ *   gets thrown out and rebuilt from scratch.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <iomanip>
+#include <utility>
+
+#include "disassembler.h"
+#include "savestate.h"
+#include "logging.h"
+#include "util.h"
+
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+using std::future;
+using std::promise;
+
+const uint32_t Disassembler::MAGIC   = 0x53444247; // "GBDS"
+const uint8_t  Disassembler::VERSION = 1;
+
+Disassembler::Disassembler(const Processor & cpu, vector<uint8_t> rom)
+    : m_cpu(cpu),
+      m_rom(std::move(rom)),
+      m_banks(uint16_t(m_rom.size() / BANK_SIZE)),
+      m_hash(0),
+      m_running(true)
+{
+}
+
+Disassembler::~Disassembler()
+{
+    // The worker finishes whatever it was asked to do first, so nobody is
+    // left waiting on a listing that never shows up.
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_running = false;
+    }
+    m_cv.notify_one();
+
+    if (m_thread.joinable()) { m_thread.join(); }
+}
+
+future<Disassembler::Listing> Disassembler::request()
+{
+    // Wherever the CPU can get to without any help from the code itself.
+    vector<Path> paths = { { ENTRY_POINT, 1 } };
+    for (uint16_t address = 0x0000; address < VECTOR_END; address += VECTOR_STEP) {
+        paths.push_back({ address, 1 });
+    }
+
+    return enqueue(std::move(paths));
+}
+
+future<Disassembler::Listing> Disassembler::request(uint16_t bank, uint16_t address)
+{
+    // Starting out in the fixed bank still needs something in the other half
+    // for the path to follow if it goes there.
+    uint16_t mapped = ((address < BANK_SIZE) && (0 == bank)) ? 1 : bank;
+    return enqueue({ { address, mapped } });
+}
+
+future<Disassembler::Listing> Disassembler::enqueue(vector<Path> paths)
+{
+    promise<Listing> listing;
+    future<Listing> result = listing.get_future();
+
+    {
+        lock_guard<mutex> guard(m_lock);
+
+        m_queue.insert(m_queue.end(), paths.begin(), paths.end());
+        m_waiting.push_back(std::move(listing));
+
+        if (!m_thread.joinable()) {
+            m_thread = std::thread([&] { run(); });
+        }
+    }
+    m_cv.notify_one();
+
+    return result;
+}
+
+void Disassembler::run()
+{
+    // Whatever was found the last time that this ROM was loaded is where we
+    // pick up from, before anything new gets walked.
+    m_hash = Util::hash(m_rom.data(), m_rom.size());
+
+    std::ostringstream filename;
+    filename << std::hex << std::setw(16) << std::setfill('0') << m_hash << ".dis";
+    m_filename = filename.str();
+
+    loadCache();
+
+    bool changed = false;
+
+    unique_lock<mutex> lock(m_lock);
+    while (true) {
+        m_cv.wait(lock, [&] { return !m_running || !m_queue.empty() || !m_waiting.empty(); });
+
+        while (!m_queue.empty()) {
+            Path path = m_queue.front();
+            m_queue.pop_front();
+
+            lock.unlock();
+            changed |= walk(path);
+            lock.lock();
+        }
+
+        // Everybody that is waiting asked before the queue ran dry, so
+        // everything that they asked for is in the listing.
+        vector<promise<Listing>> waiting;
+        waiting.swap(m_waiting);
+
+        lock.unlock();
+
+        if (changed) {
+            saveCache();
+            changed = false;
+        }
+
+        if (!waiting.empty()) {
+            Listing code = listing();
+            for (auto & listing : waiting) {
+                listing.set_value(code);
+            }
+        }
+
+        lock.lock();
+        if (!m_running && m_queue.empty() && m_waiting.empty()) { break; }
+    }
+}
+
+uint16_t Disassembler::bankOf(uint16_t address, uint16_t mapped) const
+{
+    if (address >= ROM_END) { return m_banks; }
+    if (address < BANK_SIZE) { return 0; }
+
+    return (mapped < m_banks) ? mapped : m_banks;
+}
+
+size_t Disassembler::offsetOf(uint16_t bank, uint16_t address) const
+{
+    return (size_t(bank) * BANK_SIZE) + (address % BANK_SIZE);
+}
+
+bool Disassembler::walk(Path start)
+{
+    bool changed = false;
+
+    vector<Path> paths = { start };
+    while (!paths.empty()) {
+        Path path = paths.back();
+        paths.pop_back();
+
+        // Only constants that got loaded right before the write to the MBC
+        // are any help in working out which bank got switched in, and
+        // anything else is -1.
+        int32_t a = -1;
+        int32_t hl = -1;
+
+        while (true) {
+            uint16_t bank = bankOf(path.address, path.mapped);
+            if (bank >= m_banks) { break; }
+
+            // Anything past here has already been walked.
+            auto & code = m_code[key(bank, path.address)];
+            if (!code.bytes.empty()) { break; }
+
+            if (!decode(bank, path.address, code)) {
+                m_code.erase(key(bank, path.address));
+                break;
+            }
+            changed = true;
+
+            const vector<uint8_t> & bytes = code.bytes;
+
+            uint16_t next = uint16_t(path.address + bytes.size());
+            uint16_t immediate = (bytes.size() > 2) ? uint16_t(bytes[1] | (bytes[2] << 8)) : 0;
+            uint16_t relative = (bytes.size() > 1) ? uint16_t(next + int8_t(bytes[1])) : 0;
+
+            auto branch = [&](uint16_t target) { paths.push_back({ target, path.mapped }); };
+            auto select = [&](uint16_t target) {
+                if ((a < 0) || (target < BANK_REGISTER) || (target >= BANK_SIZE)) { return; }
+
+                // Bank 0 can't be mapped in to the switchable half on most of
+                // the MBCs, so asking for it gets bank 1 instead.
+                path.mapped = uint16_t(a % m_banks);
+                if (0 == path.mapped) { path.mapped = 1; }
+            };
+
+            bool done = false;
+            switch (bytes.front()) {
+            default:
+                a = hl = -1;
+                break;
+
+            case 0x3E: a = bytes[1];      break; // LD A,n
+            case 0x21: hl = immediate;    break; // LD HL,nn
+            case 0xEA: select(immediate); break; // LD (nn),A
+            case 0x77: if (hl >= 0) { select(uint16_t(hl)); } break; // LD (HL),A
+
+            case 0xC3: branch(immediate); done = true; break; // JP nn
+            case 0x18: branch(relative);  done = true; break; // JR n
+
+            case 0xC2: case 0xCA: case 0xD2: case 0xDA: // JP cc,nn
+            case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC: // CALL
+                branch(immediate);
+                break;
+
+            case 0x20: case 0x28: case 0x30: case 0x38: // JR cc,n
+                branch(relative);
+                break;
+
+            case 0xC7: case 0xCF: case 0xD7: case 0xDF: // RST
+            case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+                branch(bytes.front() & 0x38);
+                break;
+
+            case 0xC9: case 0xD9: case 0xE9: // RET, RETI, JP (HL)
+                done = true;
+                break;
+            }
+
+            if (done) { break; }
+
+            path.address = next;
+        }
+    }
+
+    return changed;
+}
+
+bool Disassembler::decode(uint16_t bank, uint16_t address, Instruction & instruction) const
+{
+    // An instruction never runs off of the end of its bank, since whatever
+    // comes after it depends on which bank is mapped.
+    size_t offset = offsetOf(bank, address);
+    size_t left = BANK_SIZE - (address % BANK_SIZE);
+
+    uint8_t opcode = m_rom.at(offset);
+    uint8_t next = (left > 1) ? m_rom.at(offset + 1) : 0x00;
+
+    const Processor::Operation *operation = m_cpu.decode(opcode, next);
+    if (!operation) { return false; }
+
+    // The length in the CB table doesn't count the prefix.
+    size_t length = (Processor::CB_PREFIX == opcode) ? 2 : operation->length;
+    if (length > left) { return false; }
+
+    Processor::Command command = { };
+    command.pc        = address;
+    command.romBank   = uint8_t(bank);
+    command.opcode    = (Processor::CB_PREFIX == opcode) ? next : opcode;
+    command.operation = operation;
+    if (Processor::CB_PREFIX != opcode) {
+        for (size_t i = 1; i < length; i++) {
+            command.operands[i - 1] = m_rom.at(offset + i);
+        }
+    }
+
+    instruction.bank = bank;
+    instruction.address = address;
+    instruction.bytes.assign(m_rom.begin() + offset, m_rom.begin() + offset + length);
+    instruction.text = command.abbrev();
+
+    return true;
+}
+
+Disassembler::Listing Disassembler::listing() const
+{
+    // The map is already in bank order, and address order within a bank.
+    Listing code;
+    code.reserve(m_code.size());
+
+    for (const auto & entry : m_code) {
+        code.push_back(entry.second);
+    }
+    return code;
+}
+
+void Disassembler::loadCache()
+{
+    ifstream input(m_filename, std::ios::in | std::ios::binary);
+    if (!input.is_open()) { return; }
+
+    vector<uint8_t> bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    StateReader reader(bytes);
+
+    uint32_t magic = 0;
+    uint8_t version = 0;
+    uint64_t hash = 0;
+    uint64_t size = 0;
+    uint32_t count = 0;
+
+    bool valid = reader.get(magic) && (MAGIC == magic)
+        && reader.get(version) && (VERSION == version)
+        && reader.get(hash) && (m_hash == hash)
+        && reader.get(size) && (m_rom.size() == size)
+        && reader.get(count);
+
+    for (uint32_t i = 0; valid && (i < count); i++) {
+        uint32_t location = 0;
+        if (!reader.get(location)) { valid = false; break; }
+
+        uint16_t bank = uint16_t(location >> 16);
+        uint16_t address = uint16_t(location);
+        if ((bank >= m_banks) || (bankOf(address, bank) != bank)) { valid = false; break; }
+
+        valid = decode(bank, address, m_code[location]);
+    }
+
+    if (!valid || !reader.isDone()) {
+        WARN("Ignoring disassembly cache: %s\n", m_filename.c_str());
+        m_code.clear();
+    }
+}
+
+void Disassembler::saveCache() const
+{
+    vector<uint8_t> bytes;
+    StateWriter writer(bytes);
+
+    writer.put(MAGIC);
+    writer.put(VERSION);
+    writer.put(m_hash);
+    writer.put(uint64_t(m_rom.size()));
+    writer.put(uint32_t(m_code.size()));
+    for (const auto & entry : m_code) {
+        writer.put(entry.first);
+    }
+
+    ofstream output(m_filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        WARN("Failed to save disassembly cache: %s\n", m_filename.c_str());
+        return;
+    }
+
+    output.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+}
@@ -0,0 +1,111 @@
+#ifndef DISASSEMBLER_H_
+#define DISASSEMBLER_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "gameboyinterface.h"
+#include "processor.h"
+
+// Works out which bytes of a cartridge are actually code by following the
+// jumps and calls from the places that the CPU is known to start running
+// from (the entry point, the RST targets and the interrupt vectors), plus
+// anything else that somebody asks about (e.g. wherever the debugger is
+// stopped).  Nothing happens until the first request, and then everything
+// runs on a thread of our own, so the emulator never has to wait on it.
+//
+// Code in the switchable half of the ROM could be from any bank, so the
+// bank that a path is in is tracked along with it.  A path starts out with
+// bank 1 mapped, and picks up a new bank every time that it writes a
+// constant to the MBC's bank register (e.g. LD A,n followed by LD (nn),A).
+// Anything switched in some other way only shows up once somebody asks for
+// an address in that bank.
+//
+// Everything that has been found so far gets cached on disk by the hash of
+// the ROM, so the next time the same cartridge gets loaded, only new entry
+// points have to be walked.
+class Disassembler final {
+public:
+    using Instruction = GameBoyInterface::Instruction;
+    using Listing = GameBoyInterface::Listing;
+
+    Disassembler(const Processor & cpu, std::vector<uint8_t> rom);
+    ~Disassembler();
+
+    // The listing comes back once everything that can be reached from the
+    // entry point (and all of the ones that came before it) has been found.
+    std::future<Listing> request(uint16_t bank, uint16_t address);
+    std::future<Listing> request();
+
+private:
+    static const uint32_t MAGIC;
+    static const uint8_t VERSION;
+
+    static constexpr uint16_t BANK_SIZE     = 0x4000;
+    static constexpr uint16_t ROM_END       = 0x8000;
+    static constexpr uint16_t BANK_REGISTER = 0x2000;
+
+    // The RSTs go to 0x00 through 0x38, and the interrupts go to 0x40
+    // through 0x60, 8 bytes apart.
+    static constexpr uint16_t VECTOR_STEP = 0x08;
+    static constexpr uint16_t VECTOR_END  = 0x68;
+    static constexpr uint16_t ENTRY_POINT = 0x0100;
+
+    // Where a path is, and which bank is mapped in to the switchable half of
+    // the ROM while it's there.
+    struct Path {
+        uint16_t address;
+        uint16_t mapped;
+    };
+
+    const Processor & m_cpu;
+
+    const std::vector<uint8_t> m_rom;
+    const uint16_t m_banks;
+
+    // Hashing the ROM and reading the cache are both left to the worker, so
+    // only the worker ever touches any of these.
+    uint64_t m_hash;
+    std::string m_filename;
+
+    // Every instruction that has been found so far, by bank and address.
+    std::map<uint32_t, Instruction> m_code;
+
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+
+    std::thread m_thread;
+    bool m_running;
+
+    std::deque<Path> m_queue;
+    std::vector<std::promise<Listing>> m_waiting;
+
+    static inline uint32_t key(uint16_t bank, uint16_t address)
+        { return (uint32_t(bank) << 16) | address; }
+
+    // The bank that an address is in when the given bank is mapped, which is
+    // past the last bank when it isn't in the ROM at all.
+    uint16_t bankOf(uint16_t address, uint16_t mapped) const;
+    size_t offsetOf(uint16_t bank, uint16_t address) const;
+
+    std::future<Listing> enqueue(std::vector<Path> paths);
+
+    void run();
+    bool walk(Path start);
+    bool decode(uint16_t bank, uint16_t address, Instruction & instruction) const;
+
+    Listing listing() const;
+
+    void loadCache();
+    void saveCache() const;
+};
+
+#endif /* DISASSEMBLER_H_ */
@@ -11,20 +11,19 @@
  *   for running the fetch execute cycle of the CPU as well as updating
  *   the state of the other emulated pieces of hardware (i.e. GPU).  The
  *   CPU thread can also be paused in order to allow synchronization.
- *   The timing of the CPU's fetch execute cycle is controlled by the
- *   timer thread.
  *
- * Timer Thread:
- *  The GameBoy starts and manages the timer thread in the same way that
- *  it manages the CPU thread.  The sole purpose of the timer thread is
- *  to signal the CPU thread at a set interval in order to emulate the
- *  clock speed of the gameboy hardware.
+ * Pacing:
+ *   The CPU thread paces itself to emulate the clock speed of the gameboy
+ *   hardware.  At the end of every emulated frame, it sleeps until the
+ *   absolute time that the frame is supposed to be finished at, which is
+ *   worked out from the frame period (~59.73Hz) and the selected speed.
  *
  * Configuration Updates:
- *   The configuration manager dispatches setting updates when a config
- *   change is requested.  The GameBoy class is responsible for making
- *   changes to the execution of the hardware emulation and ensuring that
- *   the CPU and Timer threads stay in sync with config changes.
+ *   Every GameBoy runs with its own snapshot of the configuration, so any
+ *   number of them with different settings can share a process.  Whoever
+ *   owns the instance hands it a new snapshot when the settings change, and
+ *   the GameBoy class is responsible for applying whatever changed while
+ *   keeping the CPU thread in sync with the new settings.
  *
  *  Created on: May 28, 2019
  *      Author: Robert Phillips III
@@ -38,6 +37,10 @@
 #include <chrono>
 #include <mutex>
 #include <memory>
+#include <cmath>
+#include <algorithm>
+#include <future>
+#include <cassert>
 
 #include "gameboy.h"
 #include "memmap.h"
@@ -47,276 +50,885 @@
 
 using std::string;
 using std::vector;
-using std::unique_lock;
 using std::mutex;
+using std::unique_lock;
 using std::unique_ptr;
 using std::lock_guard;
-using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::chrono::nanoseconds;
 
-using namespace std::chrono_literals;
+const uint32_t GameBoy::STATE_MAGIC   = 0x54534247; // "GBST"
+const uint32_t GameBoy::STATE_VERSION = 4;
 
-GameBoy::GameBoy()
-    : m_clock(*this),
+GameBoy::GameBoy(const ConfigSnapshot & config)
+    : m_config(config),
+      m_clock(*this),
       m_memory(*this),
       m_gpu(m_memory),
       m_cpu(m_clock, m_memory),
       m_joypad(m_memory),
-      m_ready(false),
       m_runCpu(false),
-      m_runTimer(false),
       m_pauseCpu(false),
-      m_pauseTimer(false),
-      m_timerPaused(true),
-      m_cpuPaused(true)
+      m_cpuPaused(true),
+      m_halts(0),
+      m_parked(false),
+      m_frameStart(true),
+      m_inline(0)
 {
+    m_recording.origin   = 0;
+    m_recording.interval = 0;
+    m_recording.next     = 0;
+
+    m_boot.loaded = steady_clock::now();
+    m_boot.origin = 0;
+    m_boot.time   = 0.0;
+    m_boot.ticks  = 0;
+
     initLink();
     readSpeed();
 
-    Configuration::instance().registerListener(*this);
-}
-
-GameBoy::~GameBoy()
-{
-    Configuration::instance().unregisterListener(*this);
+    m_gpu.setDeterministic(m_config.getBool(ConfigKey::DETERMINISTIC));
 }
 
 void GameBoy::readSpeed()
 {
-    EmuSpeed speed = Configuration::getEnum<EmuSpeed>(ConfigKey::SPEED);
+    EmuSpeed speed = m_config.getEnum<EmuSpeed>(ConfigKey::SPEED);
     switch (speed) {
     default:
         assert(0);
         [[fallthrough]];
 
-    case EmuSpeed::NORMAL: m_clock.setSpeed(TICKS_NORMAL); break;
-    case EmuSpeed::_2X:    m_clock.setSpeed(TICKS_DOUBLE); break;
-    case EmuSpeed::FREE:   m_clock.setSpeed(TICKS_FREE);   break;
+    case EmuSpeed::NORMAL: m_clock.setSpeed(SPEED_NORMAL); break;
+    case EmuSpeed::_2X:    m_clock.setSpeed(SPEED_DOUBLE); break;
+    case EmuSpeed::_4X:    m_clock.setSpeed(SPEED_QUAD);   break;
+    case EmuSpeed::FREE:   m_clock.setSpeed(SPEED_FREE);   break;
     }
 }
 
-void GameBoy::initLink()
+void GameBoy::setSpeed(double multiplier)
 {
-    if (m_link) { m_link->stop(); }
+    // Anything that isn't a real speed (including NaN) gets treated as free
+    // running instead of a frame that never ends.
+    m_clock.setSpeed(((multiplier > 0.0) && std::isfinite(multiplier)) ? multiplier : SPEED_FREE);
+}
 
-    if (Configuration::getBool(ConfigKey::LINK_ENABLE)) {
-        m_link = unique_ptr<ConsoleLink>(
-            [&]() -> ConsoleLink* {
-                LinkType link = Configuration::getEnum<LinkType>(ConfigKey::LINK_TYPE);
-                switch (link) {
-                default:
-                    assert(0);
-                    return nullptr;
+void GameBoy::initLink()
+{
+    if (m_link) {
+        m_link->stop();
+        m_link.reset();
+    }
 
-                case LinkType::SOCKET:
-                    return new SocketLink(m_memory);
+    if (!m_config.getBool(ConfigKey::LINK_ENABLE)) { return; }
 
-                case LinkType::PIPE:
-                    WARN("%s\n", "Pipe Link not yet supported");
-                    return nullptr;
-                }
-            }());
+    // Whatever is on the other end of the link runs on its own time.
+    if (m_config.getBool(ConfigKey::DETERMINISTIC)) {
+        WARN("%s\n", "The link is disabled while running deterministically");
+        return;
     }
+
+    m_link = unique_ptr<ConsoleLink>(
+        [&]() -> ConsoleLink* {
+            LinkType link = m_config.getEnum<LinkType>(ConfigKey::LINK_TYPE);
+            switch (link) {
+            default:
+                assert(0);
+                return nullptr;
+
+            case LinkType::SOCKET:
+                return new SocketLink(m_memory, m_config);
+
+            case LinkType::PIPE:
+                WARN("%s\n", "Pipe Link not yet supported");
+                return nullptr;
+            }
+        }());
 }
 
 bool GameBoy::load(const string & filename)
 {
     NOTE("Loading Rom: %s\n", filename.c_str())
 
+    // The movie wouldn't make any sense with a different cartridge.
+    stopRecording();
+
+    m_boot.loaded = steady_clock::now();
+
+    // Whatever was disassembled went with the old cartridge.
+    {
+        lock_guard<mutex> guard(m_disassembly);
+        m_disassembler.reset();
+    }
+
     m_memory.setCartridge(filename);
 
-    m_assembly = m_cpu.disassemble();
-#if 0
-    for (size_t i = 0; i < m_assembly.size(); ++i) {
-        printf("0x%04x | %s\n", uint(i + 0x100), m_assembly.at(i).abbrev().c_str());
+    // Starting (or running the emulator ourselves) picks up wherever the CPU
+    // is, which could be a save state, so a new cartridge is what starts it
+    // over.
+    m_cpu.reset();
+
+    // Without the BIOS, everything has to be left the way that it would have
+    // left it when it jumped to the cartridge.
+    if (m_config.getBool(ConfigKey::FAST_BOOT)) {
+        m_memory.boot();
+        m_cpu.boot();
     }
-#endif
+
+    m_boot.origin = m_clock.elapsed();
+    m_boot.time.store(0.0, std::memory_order_relaxed);
+    m_boot.ticks.store(0, std::memory_order_release);
+
     return true;
 }
 
 void GameBoy::start()
 {
-    m_runCpu.store(true, std::memory_order_release);
-    m_runTimer.store(true, std::memory_order_release);
+    // The thread is running from here on out, so anybody that wants to
+    // pause it needs to wait for it to acknowledge them.
+    {
+        unique_lock<mutex> lock(m_lock);
+
+        // Somebody else (e.g. a scheduler) is already running the CPU.
+        if (m_runCpu.load(std::memory_order_acquire)) { return; }
+
+        claim(lock);
+        m_cpuPaused = false;
+    }
+
+    // Start the frame schedule over from when the CPU actually starts.
+    m_clock.reset();
 
     m_thread = std::thread([&] { run(); });
-    m_timer  = std::thread([&] { executeTimer(); });
 }
 
 void GameBoy::run()
 {
     LOG("%s\n", "Gameboy thread running");
 
-    m_cpu.reset();
-
     while (m_runCpu.load(std::memory_order_acquire)) {
-        step();
+        if (frame()) {
+            m_clock.pace();
+        } else if (m_pauseCpu.load(std::memory_order_acquire)) {
+            park();
+        }
     }
+
+    // Don't strand anything that got queued up while we were stopping.
+    execute();
 }
 
 void GameBoy::stop()
 {
-    // Resume the CPU and timer just in case we happened to be paused.
-    // We won't be able to stop the threads if they are paused.
-    resume();
-
-    m_runCpu.store(false, std::memory_order_release);
+    // Wake the CPU thread up if it's waiting on the end of a frame, or if
+    // it's paused.  Whoever paused it still has their halt, which they let
+    // go of on their own.
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_runCpu.store(false);
+        m_cv.notify_all();
+    }
 
     if (m_link) {
         m_link->stop();
     }
 
-    // Make sure that the CPU thread has stopped and exited before
-    // attempting to stop the timer thread.  The timer thread controls
-    // the execution timing of the CPU, so we need to guarantee that
-    // the CPU thread is done before we start messing with the timer.
     if (m_thread.joinable()) { m_thread.join(); }
 
-    m_runTimer.store(false, std::memory_order_release);
-    if (m_timer.joinable()) { m_timer.join();  }
+    unique_lock<mutex> lock(m_lock);
+
+    // A scheduler could be in the middle of running a frame for us, which
+    // ends as soon as it notices that we are stopping.
+    if (m_wake) {
+        m_cv.wait(lock, [&] { return m_cpuPaused; });
+        m_wake = nullptr;
+    }
+
+    // The thread isn't running any more, so as far as pause() is concerned
+    // it's paused.  Otherwise, anything that halts the emulator after it has
+    // been stopped (e.g. reading memory) would wait on it forever.
+    m_cpuPaused = true;
+
+    lock.unlock();
+
+    // Commands kept getting queued up until just now, after the thread
+    // drained the queue for the last time.
+    execute();
+}
+
+void GameBoy::claim(unique_lock<mutex> & lock)
+{
+    m_cv.wait(lock, [&] { return 0 == m_inline; });
+    m_runCpu.store(true, std::memory_order_release);
+}
+
+void GameBoy::settle(unique_lock<mutex> & lock)
+{
+    // Anything that got queued up before now is ours to run, and anything
+    // that shows up after we say that we are paused gets run by whoever
+    // queued it.
+    while (!m_commands.empty()) {
+        lock.unlock();
+        execute();
+        lock.lock();
+    }
+
+    m_cpuPaused = true;
+    m_cv.notify_all();
 }
 
-void GameBoy::step()
+void GameBoy::unpause(unique_lock<mutex> & lock)
 {
-    while (m_pauseCpu.load(std::memory_order_acquire)) {
-        if (!m_cpuPaused.load()) {
-            m_cpuPaused.store(true, std::memory_order_release);
+    m_cv.wait(lock, [&] { return 0 == m_inline; });
+    m_cpuPaused = false;
+}
+
+template <typename Done>
+bool GameBoy::cycle(Done done)
+{
+    // Checking the flags is all that we do on every instruction.  The lock
+    // only comes in to play when somebody actually wants us to stop.
+    while (!done()) {
+        if (m_pauseCpu.load(std::memory_order_acquire)) { return false; }
+        if (!m_runCpu.load(std::memory_order_acquire))  { return false; }
+
+        if (!m_commands.empty()) { execute(); }
+
+        m_joypad.update(m_clock.elapsed());
+
+        m_cpu.cycle();
+
+        if (m_gpu.vblank()) { endFrame(); }
+    }
+    return true;
+}
+
+void GameBoy::endFrame()
+{
+    // The first frame that ends after the BIOS is done is the first one that
+    // the cartridge had anything to do with.
+    if (!m_boot.ticks.load(std::memory_order_relaxed) && !m_memory.inBios()) {
+        auto elapsed = std::chrono::duration<double, std::milli>(steady_clock::now() - m_boot.loaded);
+
+        m_boot.time.store(elapsed.count(), std::memory_order_relaxed);
+        m_boot.ticks.store(m_clock.elapsed() - m_boot.origin, std::memory_order_release);
+    }
+
+    if (m_recording.movie) {
+        uint64_t ticks = m_clock.elapsed() - m_recording.origin;
+        if (ticks >= m_recording.next) {
+            m_recording.movie->checkpoint(ticks, save());
+            m_recording.next = ticks + m_recording.interval;
         }
-        std::this_thread::sleep_for(5ms);
     }
 
-    if (m_cpuPaused.load()) {
-        m_cpuPaused.store(false, std::memory_order_release);
+    // The frame is done being drawn, so the memory is where the game left
+    // it and nothing else is going to touch it until we go on.
+    if (m_frameCallback) { m_frameCallback(m_gpu.frames()); }
+}
+
+bool GameBoy::frame()
+{
+    return cycle([&] { return m_clock.endOfFrame(); });
+}
+
+template <typename Done>
+uint64_t GameBoy::runSync(Done done)
+{
+    {
+        // The caller's thread stands in for the CPU thread, so everybody
+        // else sees a running emulator (e.g. commands get queued up and
+        // halts wait on us) until we're done.
+        unique_lock<mutex> lock(m_lock);
+        if (m_runCpu.load(std::memory_order_acquire)) { return 0; }
+
+        claim(lock);
+        m_cpuPaused = false;
     }
 
-    m_cpu.cycle();
+    uint64_t begin = m_clock.elapsed();
+    auto finished = [&] { return done(begin); };
+
+    while (!cycle(finished) && m_pauseCpu.load(std::memory_order_acquire)
+           && m_runCpu.load(std::memory_order_acquire)) {
+        park();
+    }
+
+    {
+        lock_guard<mutex> guard(m_lock);
+
+        m_runCpu.store(false);
+
+        m_cpuPaused = true;
+        m_cv.notify_all();
+    }
+
+    // Don't strand anything that got queued up while we were finishing.
+    execute();
+
+    return m_clock.elapsed() - begin;
+}
+
+uint64_t GameBoy::runFrame()
+{
+    return runSync([&](uint64_t begin) {
+        // Whatever is left of the flag before we run anything belongs to a
+        // frame that has already been run.
+        bool ended = m_clock.endOfFrame();
+        return ended && (m_clock.elapsed() != begin);
+    });
+}
+
+uint64_t GameBoy::runCycles(uint64_t cycles)
+{
+    return runSync([&](uint64_t begin) { return ((m_clock.elapsed() - begin) >= cycles); });
+}
+
+uint64_t GameBoy::runUntil(std::function<bool()> done, uint64_t limit)
+{
+    return runSync([&](uint64_t begin) {
+        uint64_t cycles = m_clock.elapsed() - begin;
+        if (0 == cycles) { return false; }
+
+        return (cycles >= limit) || done();
+    });
+}
+
+uint64_t GameBoy::runUntil(uint16_t breakpoint, uint64_t limit)
+{
+    return runUntil([&] { return (m_cpu.pc() == breakpoint); }, limit);
+}
+
+GameBoyInterface::State GameBoy::saveState()
+{
+    // The CPU only ever halts in between instructions, which is the only
+    // time that all of the hardware agrees on where things are.
+    Halt h(*this);
+    return save();
+}
+
+GameBoyInterface::State GameBoy::save()
+{
+    State state;
+    StateWriter writer(state);
+
+    writer.put(STATE_MAGIC);
+    writer.put(STATE_VERSION);
+
+    m_clock.saveState(writer);
+    m_cpu.saveState(writer);
+    m_memory.saveState(writer);
+    m_gpu.saveState(writer);
+    m_joypad.saveState(writer);
+
+    return state;
+}
+
+bool GameBoy::loadState(const State & state)
+{
+    Halt h(*this);
+
+    // Nothing that gets recorded after this could ever be played back.
+    stopRecording();
+
+    // Something wrong with the state might not turn up until part of it has
+    // already been loaded, so hang on to where we are in case we have to go
+    // back to it.
+    State backup = save();
+    if (restore(state)) { return true; }
+
+    WARN("%s\n", "Failed to load save state");
+
+    bool restored = restore(backup);
+    assert(restored);
+    (void)restored;
+
+    return false;
+}
+
+bool GameBoy::restore(const State & state)
+{
+    StateReader reader(state);
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    if (!reader.get(magic) || !reader.get(version)) { return false; }
+
+    if ((STATE_MAGIC != magic) || (STATE_VERSION != version)) { return false; }
+
+    bool loaded = m_clock.loadState(reader)
+        && m_cpu.loadState(reader)
+        && m_memory.loadState(reader)
+        && m_gpu.loadState(reader)
+        && m_joypad.loadState(reader);
+
+    return loaded && reader.isDone();
+}
+
+bool GameBoy::startRecording(const string & filename, uint32_t checkpoint)
+{
+    Halt h(*this);
+
+    stopRecording();
+
+    auto movie = std::make_unique<Movie::Recorder>();
+    if (!movie->open(filename, save())) { return false; }
+
+    if (0 == checkpoint) { checkpoint = Movie::CHECKPOINT_FRAMES; }
+
+    m_recording.movie    = std::move(movie);
+    m_recording.origin   = m_clock.elapsed();
+    m_recording.interval = uint64_t(checkpoint) * Movie::FRAME_TICKS;
+    m_recording.next     = m_recording.interval;
+
+    m_joypad.setListener([this](JoyPadButton button, bool pressed) {
+        m_recording.movie->record(m_clock.elapsed() - m_recording.origin, button, pressed);
+    });
+    return true;
+}
+
+void GameBoy::stopRecording()
+{
+    Halt h(*this);
+
+    if (!m_recording.movie) { return; }
+
+    m_joypad.setListener(nullptr);
+
+    m_recording.movie->close(m_clock.elapsed() - m_recording.origin);
+    m_recording.movie.reset();
+}
+
+void GameBoy::park()
+{
+    unique_lock<mutex> lock(m_lock);
+
+    settle(lock);
+
+    m_cv.wait(lock, [&] {
+        return !m_pauseCpu.load(std::memory_order_acquire)
+            || !m_runCpu.load(std::memory_order_acquire);
+    });
+
+    // Getting stopped doesn't let go of anybody's halt, so there's no going
+    // back to running instructions.
+    if (m_runCpu.load(std::memory_order_acquire)) { unpause(lock); }
+}
+
+bool GameBoy::attach(std::function<void()> wake)
+{
+    unique_lock<mutex> lock(m_lock);
+
+    // Only one thread at a time can ever be running the CPU.
+    if (m_runCpu.load(std::memory_order_acquire)) { return false; }
+
+    m_clock.reset();
+
+    m_wake   = std::move(wake);
+    m_parked = false;
+
+    m_frameStart = true;
+
+    claim(lock);
+    return true;
 }
 
-void GameBoy::wait()
+GameBoy::Advance GameBoy::advance(TimePoint now, std::optional<TimePoint> & deadline)
 {
+    {
+        unique_lock<mutex> lock(m_lock);
+        if (!m_runCpu.load(std::memory_order_acquire)) { return Advance::STOPPED; }
+
+        // There's no point in holding up a worker while we're paused, so
+        // the console gets handed back to the scheduler when it's resumed.
+        if (m_pauseCpu.load(std::memory_order_acquire)) {
+            m_parked = true;
+            return Advance::PARKED;
+        }
+        unpause(lock);
+    }
+
+    // The console was waiting on the scheduler instead of sleeping in pace(),
+    // so this is when the frame actually starts.  A frame that got cut short
+    // by a pause just picks up where it left off.
+    if (m_frameStart) { m_clock.record(now); }
+
+    m_frameStart = frame();
+    if (m_frameStart) { deadline = m_clock.schedule(steady_clock::now()); }
+
+    // Until the next frame, commands get run by whoever queues them.
     unique_lock<mutex> lock(m_lock);
-    m_cv.wait(lock, [&] { return m_ready; });
+    settle(lock);
+
+    if (!m_runCpu.load(std::memory_order_acquire)) { return Advance::STOPPED; }
+    if (m_pauseCpu.load(std::memory_order_acquire)) {
+        m_parked = true;
+        return Advance::PARKED;
+    }
+    return Advance::RAN;
+}
+
+GameBoy::Clock::Clock(GameBoy & gameboy)
+    : m_hardware(gameboy),
+      m_ticks(0),
+      m_elapsed(0),
+      m_endOfFrame(false),
+      m_speed(SPEED_FREE),
+      m_resync(true),
+      m_frames(0)
+{
+    m_times.count = 0;
+    m_times.mean  = 0.0;
+    m_times.m2    = 0.0;
+    m_times.max   = 0.0;
+}
+
+void GameBoy::Clock::saveState(StateWriter & state) const
+{
+    state.put(m_ticks);
+    state.put(m_endOfFrame);
+}
+
+bool GameBoy::Clock::loadState(StateReader & state)
+{
+    return state.get(m_ticks) && state.get(m_endOfFrame);
+}
 
-    m_ready = false;
+void GameBoy::Clock::setSpeed(double speed)
+{
+    m_speed.store(speed, std::memory_order_release);
+
+    // The old frame times don't say anything about how well we are keeping
+    // up with the new speed.
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_times.count = 0;
+        m_times.mean  = 0.0;
+        m_times.m2    = 0.0;
+        m_times.max   = 0.0;
+    }
+
+    reset();
 }
 
 void GameBoy::Clock::tick(uint8_t ticks)
 {
-    // Check to see if we have executed the number of ticks corresponding
-    // to the timeout interval of the timer thread.  If so, we need to wait
-    // here until the timer thread signals that we can continue to execute.
-    // The one exception is "free" mode.  In that case, just let the thread
-    // free run without any syncronization with the timer and skip this
-    // check.
-    m_ticks += ticks;
-    if ((TICKS_FREE != m_speed) && (m_ticks >= m_speed)) {
-        m_hardware.wait();
+    m_elapsed += ticks;
 
-        m_ticks %= m_speed;
+    m_ticks += ticks;
+    if (m_ticks >= FRAME_TICKS) {
+        m_ticks -= FRAME_TICKS;
+        m_endOfFrame = true;
     }
 
     m_hardware.m_cpu.updateTimer(ticks);
 
     m_hardware.m_gpu.cycle(ticks);
-    m_hardware.m_joypad.cycle(ticks);
 
     if (m_hardware.m_link) {
         m_hardware.m_link->cycle(ticks);
     }
 }
 
-void GameBoy::pause()
+std::optional<GameBoy::TimePoint> GameBoy::Clock::schedule(TimePoint now)
 {
-    // Make sure that the CPU is paused before pausing the timer thread
-    // because the timer thread controls the execution timing of the
-    // CPU thread, so we can't mess with the timer until the CPU thread
-    // is paused.
-    m_pauseCpu.store(true, std::memory_order_release);
-    while (!m_cpuPaused.load(std::memory_order_acquire)) {
-        std::this_thread::sleep_for(5ms);
+    // Anything that stops the CPU for a while (pausing, changing the speed,
+    // etc) throws the schedule off, so start it over and don't count the
+    // gap as a frame.
+    if (m_resync.exchange(false, std::memory_order_acq_rel)) {
+        m_origin = now;
+        m_frames = 0;
+
+        lock_guard<mutex> guard(m_lock);
+        m_times.last.reset();
+        return std::nullopt;
+    }
+
+    double speed = m_speed.load(std::memory_order_acquire);
+    if (SPEED_FREE == speed) { return std::nullopt; }
+
+    double period = FRAME_NS / speed;
+
+    m_frames++;
+    TimePoint deadline = m_origin + nanoseconds(uint64_t((double(m_frames) * period) + 0.5));
+
+    if ((now - deadline) > nanoseconds(uint64_t(period * FRAMES_BEHIND_MAX))) {
+        m_origin = now;
+        m_frames = 0;
+        return std::nullopt;
     }
+    return deadline;
+}
 
-    // Block until the timer is paused.
-    m_pauseTimer.store(true, std::memory_order_release);
-    while (!m_timerPaused.load(std::memory_order_acquire)) {
-        std::this_thread::sleep_for(5ms);
+void GameBoy::Clock::pace()
+{
+    std::optional<TimePoint> deadline = schedule(steady_clock::now());
+    if (deadline) {
+        // Don't keep anybody that wants to pause or stop us waiting around
+        // for the rest of the frame.  The schedule starts over after a
+        // pause anyway.
+        // Commands that show up in the mean time get run right away
+        // instead of at the start of the next frame.
+        unique_lock<mutex> lock(m_hardware.m_lock);
+        while (m_hardware.m_cv.wait_until(lock, *deadline, [&] {
+            return m_hardware.m_pauseCpu.load(std::memory_order_acquire)
+                || !m_hardware.m_runCpu.load(std::memory_order_acquire)
+                || !m_hardware.m_commands.empty();
+        })) {
+            if (m_hardware.m_commands.empty()) { break; }
+
+            lock.unlock();
+            m_hardware.execute();
+            lock.lock();
+        }
     }
+
+    record(steady_clock::now());
+}
+
+void GameBoy::Clock::record(TimePoint now)
+{
+    lock_guard<mutex> guard(m_lock);
+
+    if (m_times.last) {
+        double elapsed = std::chrono::duration<double, std::milli>(now - *m_times.last).count();
+
+        m_times.count++;
+
+        double delta = elapsed - m_times.mean;
+        m_times.mean += delta / double(m_times.count);
+        m_times.m2   += delta * (elapsed - m_times.mean);
+
+        m_times.max = std::max(m_times.max, elapsed);
+    }
+    m_times.last = now;
+}
+
+void GameBoy::Clock::getStatistics(Statistics & stats)
+{
+    lock_guard<mutex> guard(m_lock);
+
+    stats.frameTime    = m_times.mean;
+    stats.frameJitter  =
+        (m_times.count > 1) ? std::sqrt(m_times.m2 / double(m_times.count - 1)) : 0.0;
+    stats.frameTimeMax = m_times.max;
+}
+
+void GameBoy::pause()
+{
+    unique_lock<mutex> lock(m_lock);
+
+    m_halts++;
+
+    m_pauseCpu.store(true, std::memory_order_release);
+    m_cv.notify_all();
+
+    // Somebody that is running commands on their own thread is as good as
+    // the CPU running, so they have to be done too.
+    m_cv.wait(lock, [&] { return m_cpuPaused && (0 == m_inline); });
 }
 
 void GameBoy::resume()
 {
-    // We are going to resume the two threads that we manage, so we need
-    // reset the tick count and let the CPU sync back with the timer.
+    lock_guard<mutex> guard(m_lock);
+
+    // Only the last halt to go away lets the CPU go.
+    assert(m_halts > 0);
+    if (--m_halts > 0) { return; }
+
+    // The CPU has been sitting still, so the frame schedule needs to start
+    // over from wherever it picks back up.
     m_clock.reset();
 
     m_pauseCpu.store(false, std::memory_order_release);
-    m_pauseTimer.store(false, std::memory_order_release);
+    m_cv.notify_all();
+
+    // A scheduler doesn't come back for a console that got parked, so give
+    // it back.
+    if (m_parked) {
+        m_parked = false;
+        if (m_wake) { m_wake(); }
+    }
 }
 
-void GameBoy::executeTimer()
+void GameBoy::submit(Command command)
 {
-    while (m_runTimer.load(std::memory_order_acquire)) {
-        while (m_pauseTimer.load(std::memory_order_acquire)) {
-            if (!m_timerPaused.load()) {
-                m_timerPaused.store(true, std::memory_order_release);
-            }
-            std::this_thread::sleep_for(5ms);
+    // Nobody is going to drain the queue while the CPU is stopped, paused or
+    // parked, so run the command ourselves.  That has to be decided under
+    // the lock: the CPU drains the queue before it says that it's paused,
+    // and whoever gets it going again waits for us to finish first.
+    {
+        lock_guard<mutex> guard(m_lock);
+        if (!m_cpuPaused) {
+            m_commands.push(std::move(command));
+
+            // The CPU thread might be waiting on the end of a frame.
+            m_cv.notify_all();
+            return;
         }
 
-        if (m_timerPaused.load()) {
-            m_timerPaused.store(false, std::memory_order_release);
+        m_inline++;
+    }
+
+    m_commands.push(std::move(command));
+    execute();
+
+    lock_guard<mutex> guard(m_lock);
+    m_inline--;
+    m_cv.notify_all();
+}
+
+void GameBoy::execute()
+{
+    lock_guard<mutex> guard(m_drain);
+
+    Command command;
+    while (m_commands.pop(command)) {
+        command();
+    }
+}
+
+std::future<vector<uint8_t>> GameBoy::queueRead(vector<uint16_t> addresses)
+{
+    auto promise = std::make_shared<std::promise<vector<uint8_t>>>();
+    auto future  = promise->get_future();
+
+    queueRead(std::move(addresses), [promise](vector<uint8_t> values) {
+        promise->set_value(std::move(values));
+    });
+    return future;
+}
+
+void GameBoy::queueRead(vector<uint16_t> addresses, ReadCallback done)
+{
+    submit([this, addresses = std::move(addresses), done = std::move(done)] {
+        vector<uint8_t> values;
+        values.reserve(addresses.size());
+
+        for (uint16_t address : addresses) {
+            values.push_back(m_memory.peek(address));
         }
+        done(std::move(values));
+    });
+}
 
-        // Put this thread to sleep.  When we wake up, then we will
-        // notify the CPU thread that it's ok to continue.
-        std::this_thread::sleep_for(milliseconds(REFRESH_MS));
+std::future<void> GameBoy::queueWrite(vector<MemoryWrite> writes)
+{
+    auto promise = std::make_shared<std::promise<void>>();
+    auto future  = promise->get_future();
 
-        lock_guard<mutex> guard(m_lock);
+    submit([this, promise, writes = std::move(writes)] {
+        for (const MemoryWrite & write : writes) {
+            m_memory.write(write.address, write.value);
+        }
+        promise->set_value();
+    });
+    return future;
+}
 
-        m_ready = true;
-        m_cv.notify_one();
+void GameBoy::queueCallback(std::function<void()> callback)
+{
+    submit(std::move(callback));
+}
+
+Disassembler & GameBoy::disassembler()
+{
+    // The ROM doesn't change until the next cartridge gets loaded, so it can
+    // be copied without stopping the CPU.
+    if (!m_disassembler) {
+        m_disassembler = std::make_unique<Disassembler>(m_cpu, m_memory.rom());
     }
+    return *m_disassembler;
 }
 
-void GameBoy::onConfigChange(ConfigKey key)
+std::future<GameBoyInterface::Listing> GameBoy::disassemble()
 {
-    // Config change updates run in the UI thread's context, so we need to make
-    // sure that we pause the execution of these two threads before we make any
+    lock_guard<mutex> guard(m_disassembly);
+    return disassembler().request();
+}
+
+std::future<GameBoyInterface::Listing> GameBoy::disassemble(uint16_t bank, uint16_t address)
+{
+    lock_guard<mutex> guard(m_disassembly);
+    return disassembler().request(bank, address);
+}
+
+GameBoyInterface::Statistics GameBoy::getStatistics()
+{
+    Statistics stats;
+    stats.frames      = m_gpu.frames();
+    stats.linesDrawn  = m_gpu.linesDrawn();
+    stats.linesReused = m_gpu.linesReused();
+
+    stats.firstFrameTicks = m_boot.ticks.load(std::memory_order_acquire);
+    stats.firstFrameTime  = m_boot.time.load(std::memory_order_relaxed);
+
+    m_clock.getStatistics(stats);
+
+    return stats;
+}
+
+ConfigSnapshot GameBoy::configuration()
+{
+    // Whoever is asking isn't on the CPU thread, so the settings could be
+    // getting replaced out from under us.
+    lock_guard<mutex> guard(m_lock);
+    return m_config;
+}
+
+void GameBoy::configure(const ConfigSnapshot & config)
+{
+    // The update comes in on somebody else's thread, so we need to make sure
+    // that we pause the execution of the CPU thread before we make any
     // changes to the configuration.
     Halt halt(*this);
 
-    switch (key) {
-    case ConfigKey::SPEED: {
-        readSpeed();
-        break;
+    ConfigSnapshot previous = m_config;
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_config = config;
     }
 
-    case ConfigKey::LINK_PORT:
-    case ConfigKey::LINK_ADDR: {
-        // Check the link type to see if we're changing a setting that is going
-        // to apply to the active configuration.  If not, we can don't need to
-        // do anything, so just break here.  Otherwise, fall through and restart
-        // the interface.
-        LinkType link = Configuration::getEnum<LinkType>(ConfigKey::LINK_TYPE);
-        if (LinkType::SOCKET != link) {
+    bool relink = false;
+    for (ConfigKey key : previous.diff(m_config)) {
+        switch (key) {
+        case ConfigKey::SPEED: {
+            readSpeed();
             break;
         }
-        [[fallthrough]];
-    }
 
-    case ConfigKey::LINK_MASTER:
-    case ConfigKey::LINK_TYPE:
-    case ConfigKey::LINK_ENABLE: {
-        if (m_link) {
-            m_link->stop();
-            m_link.reset();
+        case ConfigKey::LINK_PORT:
+        case ConfigKey::LINK_ADDR: {
+            // The port and address only apply to socket links, so there's no
+            // need to restart any other kind of link.
+            LinkType link = m_config.getEnum<LinkType>(ConfigKey::LINK_TYPE);
+            if (LinkType::SOCKET != link) {
+                break;
+            }
+            [[fallthrough]];
         }
 
-        if (Configuration::getBool(key)) {
-            initLink();
+        case ConfigKey::LINK_MASTER:
+        case ConfigKey::LINK_TYPE:
+        case ConfigKey::LINK_ENABLE: {
+            relink = true;
+            break;
+        }
+
+        // The link is turned off while running deterministically, so it has
+        // to be restarted whichever way this went.
+        case ConfigKey::DETERMINISTIC: {
+            m_gpu.setDeterministic(m_config.getBool(ConfigKey::DETERMINISTIC));
+            relink = true;
+            break;
         }
-        break;
-    }
 
-    default: break;
+        // The emulation mode and the cartridge's clock get picked up the next
+        // time that a cartridge is loaded, and the ROM is only ever used by
+        // the front ends.
+        default: break;
+        }
     }
+
+    // Restart the link once, no matter how many of its settings changed.
+    if (relink) { initLink(); }
 }
@@ -14,8 +14,11 @@
 #include <thread>
 #include <vector>
 #include <memory>
-#include <condition_variable>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <optional>
+#include <functional>
 
 #include "gameboyinterface.h"
 #include "gpu.h"
@@ -25,31 +28,89 @@
 #include "consolelink.h"
 #include "configuration.h"
 #include "clockinterface.h"
+#include "mpscqueue.h"
+#include "savestate.h"
+#include "movie.h"
+#include "disassembler.h"
 
-class GameBoy final : public GameBoyInterface, public ConfigChangeListener {
+class GameBoy final : public GameBoyInterface {
 public:
-    explicit GameBoy();
-    ~GameBoy();
+    explicit GameBoy(const ConfigSnapshot & config);
+    ~GameBoy() = default;
 
     bool load(const std::string & filename) override;
 
     void start() override;
     void stop() override;
 
+    uint64_t runFrame() override;
+    uint64_t runCycles(uint64_t cycles) override;
+    uint64_t runUntil(std::function<bool()> done, uint64_t limit) override;
+    uint64_t runUntil(uint16_t breakpoint, uint64_t limit) override;
+
+    State saveState() override;
+    bool loadState(const State & state) override;
+
     void pause();
     void resume();
 
     void write(uint16_t address, uint8_t value) override
-        { Halt h(*this); m_memory.write(address, value); }
+        { queueWrite({ { address, value } }).get(); }
     uint8_t read(uint16_t address) override
-        { Halt h(*this); return m_memory.peek(address); }
+        { return queueRead({ address }).get().front(); }
+
+    std::future<std::vector<uint8_t>> queueRead(std::vector<uint16_t> addresses) override;
+    void queueRead(std::vector<uint16_t> addresses, ReadCallback done) override;
+    std::future<void> queueWrite(std::vector<MemoryWrite> writes) override;
+    void queueCallback(std::function<void()> callback) override;
+
+    inline void setButton(JoyPadButton button) override { m_joypad.push(button, true); }
+    inline void clrButton(JoyPadButton button) override { m_joypad.push(button, false); }
+
+    inline void queueButton(JoyPadButton button, bool pressed, uint64_t delay) override
+        { m_joypad.push(button, pressed, delay); }
+
+    bool startRecording(const std::string & filename, uint32_t checkpoint) override;
+    void stopRecording() override;
+
+    inline ColorArray getRGB() override { return m_gpu.getColorMap(); }
+    inline FrameInfo getFrameInfo() override { return m_gpu.frameInfo(); }
+    inline ColorArray getRGB(FrameInfo & frame) override { return m_gpu.getColorMap(frame); }
+
+    void setFrameSkip(FrameSkipMode mode, uint8_t ratio) override
+        { Halt h(*this); m_gpu.setFrameSkip(mode, ratio); }
+    void setThreadedRendering(bool enable) override
+        { Halt h(*this); m_gpu.setThreadedRendering(enable); }
+
+    void setHeadless(bool enable) override
+        { Halt h(*this); m_gpu.setHeadless(enable); }
+    inline void requestFrame() override { m_gpu.requestFrame(); }
+
+    void setColorCorrection(ColorCorrection curve) override
+        { Halt h(*this); m_gpu.setColorCorrection(curve); }
+    void setDmgPalette(const DmgPalette & palette) override
+        { Halt h(*this); m_gpu.setDmgPalette(palette); }
 
-    void onConfigChange(ConfigKey key) override;
+    void setSpeed(double multiplier) override;
 
-    inline void setButton(JoyPadButton button) override { m_joypad.set(button); }
-    inline void clrButton(JoyPadButton button) override { m_joypad.clr(button); }
+    inline std::vector<MemorySpan> getMemory(MemoryArea area) override
+        { return m_memory.getMemory(area); }
+    void setFrameCallback(FrameCallback callback) override
+        { Halt h(*this); m_frameCallback = std::move(callback); }
 
-    inline ColorArray && getRGB() override { return m_gpu.getColorMap(); }
+    std::future<Listing> disassemble() override;
+    std::future<Listing> disassemble(uint16_t bank, uint16_t address) override;
+
+    Statistics getStatistics() override;
+
+    void configure(const ConfigSnapshot & config) override;
+    ConfigSnapshot configuration() override;
+
+    inline const ConfigSnapshot & config() const { return m_config; }
+
+    // Every tick of the ~4MHz clock that has gone by, which is the only
+    // notion of time that a deterministic console has.
+    inline uint64_t ticks() const { return m_clock.elapsed(); }
 
     inline GPU & gpu() { return m_gpu; }
     inline Processor & cpu() { return m_cpu; }
@@ -58,15 +119,34 @@ public:
     inline std::unique_ptr<ConsoleLink> & link() { return m_link; }
 
 private:
-    static constexpr uint32_t REFRESH_MS = 20;
-
-    // The number of ticks per interval is the clock rate (~4MHz), divided
-    // by the number refresh intervals per second (number of milliseconds
-    // per second divided by the refresh rate)
-    static constexpr uint32_t TICKS_NORMAL = 4e6 / (1e3 / REFRESH_MS);
-    static constexpr uint32_t TICKS_DOUBLE = TICKS_NORMAL * 2;
-    static constexpr uint32_t TICKS_QUAD   = TICKS_NORMAL * 4;
-    static constexpr uint32_t TICKS_FREE   = 0;
+    // Consoles that run on a scheduler's worker threads instead of their own
+    // get driven one frame at a time through the private interface below.
+    friend class Scheduler;
+
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    // The emulator gets paced one frame at a time.  A frame is 70224 ticks of
+    // the ~4MHz clock, which works out to ~59.73 frames per second.
+    static constexpr uint32_t FRAME_TICKS = 70224;
+    static constexpr double   CLOCK_RATE  = 4194304.0;
+    static constexpr double   FRAME_NS    = (FRAME_TICKS * 1e9) / CLOCK_RATE;
+
+    // If we ever fall further behind than this (e.g. the host was busy), we
+    // give up on catching up and start the schedule over from where we are.
+    static constexpr uint32_t FRAMES_BEHIND_MAX = 4;
+
+    // Every save state starts off with these so that we can turn away
+    // anything that isn't one (or is one from a different version).
+    static const uint32_t STATE_MAGIC;
+    static const uint32_t STATE_VERSION;
+
+    // Speeds are a multiple of the real hardware's speed, except for free
+    // running, which doesn't do any pacing at all.  These are the ones that
+    // the SPEED setting picks from, but setSpeed takes any multiple.
+    static constexpr double SPEED_NORMAL = 1.0;
+    static constexpr double SPEED_DOUBLE = 2.0;
+    static constexpr double SPEED_QUAD   = 4.0;
+    static constexpr double SPEED_FREE   = 0.0;
 
     class Halt final {
     public:
@@ -79,22 +159,73 @@ private:
 
     class Clock final : public ClockInterface {
     public:
-        explicit Clock(GameBoy & gameboy)
-            : m_hardware(gameboy), m_ticks(0) { }
+        explicit Clock(GameBoy & gameboy);
         ~Clock() = default;
 
         void tick(uint8_t cycles) override;
 
-        inline void setSpeed(uint32_t speed) { m_speed = speed; }
-        inline void reset() { m_ticks = 0; }
+        void setSpeed(double speed);
+        inline void reset() { m_resync.store(true, std::memory_order_release); }
+
+        void getStatistics(Statistics & stats);
+
+        // Where we are in the frame is the only part of the clock that the
+        // hardware cares about.  Everything else is about keeping up with
+        // the host, so it carries on from wherever it is.
+        void saveState(StateWriter & state) const;
+        bool loadState(StateReader & state);
+
+        // Every tick that has ever gone by.
+        inline uint64_t elapsed() const { return m_elapsed; }
+
+        // Set once the last tick of a frame has gone by, and cleared when
+        // whoever is running the CPU notices it.
+        inline bool endOfFrame()
+        {
+            bool ended = m_endOfFrame;
+            m_endOfFrame = false;
+            return ended;
+        }
+
+        // Works out when the frame after the one that just finished is due,
+        // which is nothing when there is nothing to wait for.  The frame time
+        // statistics are kept up to date by recording when each frame starts.
+        std::optional<TimePoint> schedule(TimePoint now);
+        void record(TimePoint now);
+
+        // Waits out the schedule on the CPU thread.
+        void pace();
 
     private:
         GameBoy & m_hardware;
 
         uint32_t m_ticks;
-        std::atomic<uint32_t> m_speed;
+        uint64_t m_elapsed;
+        bool m_endOfFrame;
+        std::atomic<double> m_speed;
+        std::atomic<bool> m_resync;
+
+        // The frame deadlines are all measured from the start of the schedule
+        // so that rounding errors don't pile up from one frame to the next.
+        TimePoint m_origin;
+        uint64_t m_frames;
+
+        // Running mean and variance (Welford) of the time between frames.
+        std::mutex m_lock;
+        struct {
+            std::optional<TimePoint> last;
+            uint64_t count;
+            double mean;
+            double m2;
+            double max;
+        } m_times;
     };
 
+    // Only ever replaced while the CPU thread is halted, so the hardware can
+    // read it whenever it wants to.  It's replaced under m_lock as well, so
+    // that any other thread can take a copy of it.
+    ConfigSnapshot m_config;
+
     Clock m_clock;
 
     MemoryController m_memory;
@@ -103,33 +234,114 @@ private:
     JoyPad m_joypad;
     std::unique_ptr<ConsoleLink> m_link;
 
-    std::condition_variable m_cv;
-    std::mutex m_lock;
-
-    bool m_ready;
-
     std::atomic<bool> m_runCpu;
-    std::atomic<bool> m_runTimer;
-
     std::atomic<bool> m_pauseCpu;
-    std::atomic<bool> m_pauseTimer;
 
-    std::atomic<bool> m_timerPaused;
-    std::atomic<bool> m_cpuPaused;
+    // The CPU thread acknowledges a pause (and waits to be resumed) on the
+    // condition variable, which also wakes it up early if it's waiting on
+    // the end of a frame.  Halts can come from more than one thread at the
+    // same time, so the CPU stays paused until the last one of them resumes.
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+
+    bool m_cpuPaused;
+    uint32_t m_halts;
+
+    std::function<void()> m_wake;
+    bool m_parked;
+    bool m_frameStart;
 
     std::thread m_thread;
-    std::thread m_timer;
 
-    std::vector<Processor::Command> m_assembly;
+    // Commands that other threads want to run on the CPU thread.  Only one
+    // thread at a time can drain the queue, which is normally the CPU thread,
+    // but somebody has to do it while the CPU thread isn't running.
+    using Command = std::function<void()>;
+
+    MpscQueue<Command> m_commands;
+    std::mutex m_drain;
+
+    // Threads that found the CPU stopped or paused and are draining the queue
+    // themselves.  Nobody starts running instructions until they're done,
+    // and it's only ever touched with m_lock held.
+    uint32_t m_inline;
+
+    // Made the first time that somebody wants a listing, and thrown away
+    // when the cartridge changes.
+    std::unique_ptr<Disassembler> m_disassembler;
+    std::mutex m_disassembly;
+
+    // Runs on whatever thread is running the CPU at the start of every vblank.
+    FrameCallback m_frameCallback;
+
+    // When the cartridge got loaded, and how long it took to draw its first
+    // frame once the BIOS was done.  Only the CPU thread writes the times,
+    // but anybody can ask for the statistics.
+    struct {
+        TimePoint loaded;
+        uint64_t origin;
+
+        std::atomic<double> time;
+        std::atomic<uint64_t> ticks;
+    } m_boot;
+
+    // The movie only ever gets touched by whoever is running the CPU (or
+    // while the CPU is halted).  The buttons go in to it as the joypad hands
+    // them to the console, so it knows exactly which instruction they landed
+    // on.
+    struct {
+        std::unique_ptr<Movie::Recorder> movie;
+
+        uint64_t origin;
+        uint64_t interval;
+        uint64_t next;
+    } m_recording;
 
     void run();
-    void step();
-    void wait();
+    void park();
+
+    // Waits out anybody that is draining the commands on their own thread,
+    // and then marks the CPU as running.  m_lock has to be held.
+    void claim(std::unique_lock<std::mutex> & lock);
+
+    // Whoever is running the CPU drains the commands before it stops running
+    // instructions, and waits on anybody else draining them before it starts
+    // back up.  m_lock has to be held for both.
+    void settle(std::unique_lock<std::mutex> & lock);
+    void unpause(std::unique_lock<std::mutex> & lock);
+
+    // Only with the disassembly lock held.
+    Disassembler & disassembler();
+
+    bool frame();
+
+    template <typename Done>
+    bool cycle(Done done);
+
+    template <typename Done>
+    uint64_t runSync(Done done);
+
+    // Running on a scheduler.  The wake callback hands the console back to
+    // the scheduler when it gets resumed after being parked by a pause.
+    enum class Advance {
+        RAN,
+        PARKED,
+        STOPPED,
+    };
+
+    bool attach(std::function<void()> wake);
+    Advance advance(TimePoint now, std::optional<TimePoint> & deadline);
+
+    void submit(Command command);
+    void execute();
+
+    State save();
+    bool restore(const State & state);
+
+    void endFrame();
 
     void initLink();
     void readSpeed();
-
-    void executeTimer();
 };
 
 
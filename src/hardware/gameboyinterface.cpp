@@ -15,10 +15,16 @@
 using std::shared_ptr;
 
 shared_ptr<GameBoyInterface> GameBoyInterface::Instance(GameBoyInterface::ConsoleType type)
+{
+    return Instance(Configuration::instance().snapshot(), type);
+}
+
+shared_ptr<GameBoyInterface> GameBoyInterface::Instance(
+    const ConfigSnapshot & config, GameBoyInterface::ConsoleType type)
 {
     switch (type) {
     case GAMEBOY_EMU:
-        return shared_ptr<GameBoyInterface>(new GameBoy());
+        return shared_ptr<GameBoyInterface>(new GameBoy(config));
 
     default:
         ERROR("Fatal Error: Unknown console type = %d\n", int(type));
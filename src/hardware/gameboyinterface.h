@@ -12,10 +12,14 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <array>
 #include <sstream>
 #include <iomanip>
+#include <future>
+#include <functional>
 
 #include "gbrgb.h"
+#include "configuration.h"
 
 class GameBoyInterface {
 public:
@@ -37,7 +41,61 @@ public:
         JOYPAD_DOWN   = 0x08,
     };
 
+    enum FrameSkipMode {
+        FRAMESKIP_NONE,
+        FRAMESKIP_FIXED,
+        FRAMESKIP_AUTO,
+    };
+
+    enum ColorCorrection {
+        COLOR_RAW,
+        COLOR_LCD,
+        COLOR_GAMMA,
+    };
+
+    // The four shades used in DMG mode as RGB555 values (lightest first).
+    using DmgPalette = std::array<uint16_t, 4>;
+
+    // Every frame that gets handed over is numbered and hashed (see
+    // Util::hash), so that anything consuming them can skip over identical
+    // frames without comparing the pixels.
+    struct FrameInfo {
+        uint64_t sequence;
+        uint64_t hash;
+    };
+
+    struct Statistics {
+        uint64_t frames;
+
+        uint64_t linesDrawn;
+        uint64_t linesReused;
+
+        // Wall clock milliseconds between frames.  Unless the emulator is
+        // free running, the mean should sit right on the frame period for
+        // the selected speed and the jitter is the standard deviation.
+        double frameTime;
+        double frameJitter;
+        double frameTimeMax;
+
+        // How long it took to get from loading the cartridge to the end of the
+        // first frame after the BIOS handed the console over to it, in wall
+        // clock milliseconds and in clock cycles (at ~4MHz).  Both of them
+        // are 0 until that frame is done.
+        double firstFrameTime;
+        uint64_t firstFrameTicks;
+
+        inline double lineHitRate() const
+        {
+            uint64_t total = linesDrawn + linesReused;
+            return (total) ? double(linesReused) / double(total) : 0.0;
+        }
+    };
+
+    // Each instance runs with its own copy of the configuration, which by
+    // default is whatever the process-wide configuration is at the time.
     static std::shared_ptr<GameBoyInterface> Instance(ConsoleType type=GAMEBOY_EMU);
+    static std::shared_ptr<GameBoyInterface> Instance(
+        const ConfigSnapshot & config, ConsoleType type=GAMEBOY_EMU);
 
     virtual ~GameBoyInterface() = default;
 
@@ -46,13 +104,156 @@ public:
     virtual void start() = 0;
     virtual void stop() = 0;
 
+    // Runs the emulator on the caller's thread instead of starting it, with
+    // no pacing at all.  They all return the number of clock cycles (at
+    // ~4MHz) that actually ran, which can go past what was asked for by part
+    // of an instruction.  None of them do anything while the emulator is
+    // started.
+    //
+    // runFrame runs up to the end of the current frame.  runUntil checks its
+    // predicate (or the breakpoint) after every instruction, so it always
+    // runs at least one, and gives up once it has run the cycle limit.
+    virtual uint64_t runFrame() = 0;
+    virtual uint64_t runCycles(uint64_t cycles) = 0;
+    virtual uint64_t runUntil(std::function<bool()> done, uint64_t limit = UINT64_MAX) = 0;
+    virtual uint64_t runUntil(uint16_t breakpoint, uint64_t limit = UINT64_MAX) = 0;
+
+    // A save state is everything that the console needs to pick up exactly
+    // where it left off.  It only goes back in to a console that has the
+    // same cartridge loaded (and was built from the same version of the
+    // emulator), and a state that doesn't fit leaves the console untouched.
+    // The link cable isn't part of it.
+    using State = std::vector<uint8_t>;
+
+    virtual State saveState() = 0;
+    virtual bool loadState(const State & state) = 0;
+
+    // The buttons are safe to change from any thread.  They land in between
+    // two instructions, the next time that the console runs one.
     virtual void setButton(JoyPadButton button) = 0;
     virtual void clrButton(JoyPadButton button) = 0;
 
-    virtual ColorArray && getRGB() = 0;
+    // Same thing, except that the button lands the given number of clock
+    // cycles (at ~4MHz) after the console picks it up.  Somebody running the
+    // console on their own thread picks out the exact instruction that it
+    // lands on, because the console picks it up before the next instruction.
+    virtual void queueButton(JoyPadButton button, bool pressed, uint64_t delay) = 0;
+
+    // Records every button that gets pressed or released (along with the
+    // emulated time that it lands on) in to a movie that starts from wherever
+    // the console is right now.  The movie gets a save state every so many
+    // frames (0 is about a minute) so that playing it back can skip ahead.
+    // Loading a cartridge or a save state stops the recording.
+    virtual bool startRecording(const std::string & filename, uint32_t checkpoint = 0) = 0;
+    virtual void stopRecording() = 0;
+
+    // A read only view of one bank of memory, for tools (e.g. bots) that
+    // want to look at a lot of memory every frame without going through
+    // read() one byte at a time.  The memory stays put until the next
+    // cartridge gets loaded, but it's only consistent while no instruction
+    // is running: inside of the frame callback, in between calls to
+    // runFrame, or while the emulator is stopped.
+    struct MemorySpan {
+        const uint8_t *data;
+        size_t size;
+    };
+
+    // The banks come back in bank order, and only the ones that the model
+    // actually has (e.g. WRAM has 2 banks on a DMG and 8 on a CGB).  HRAM
+    // doesn't include the interrupt enable register at the end of it.
+    enum class MemoryArea { WRAM, HRAM, VRAM, OAM, CART_RAM, };
+
+    virtual std::vector<MemorySpan> getMemory(MemoryArea area) = 0;
+
+    // Called on the emulation thread in between instructions every time the
+    // GPU goes in to the vblank, along with the number of frames so far.
+    // The emulator is waiting on the callback, so it can't call anything
+    // that halts the emulator (e.g. read or write), but it can look at any
+    // of the memory spans.  A null callback turns it back off.
+    //
+    // Buttons that get pressed from the callback (or in between calls to
+    // runFrame) always land on the same instruction, so a deterministic
+    // console plays the same input back the same way at any speed.
+    using FrameCallback = std::function<void(uint64_t frame)>;
+
+    virtual void setFrameCallback(FrameCallback callback) = 0;
+
+    // One instruction out of the cartridge, for debuggers and profilers.
+    // Addresses below 0x4000 are always in bank 0.
+    struct Instruction {
+        uint16_t bank;
+        uint16_t address;
+
+        std::vector<uint8_t> bytes;
+        std::string text;
+    };
+
+    // In bank order, and in address order within a bank.
+    using Listing = std::vector<Instruction>;
+
+    // Disassembles the cartridge by following the code from the entry point,
+    // the RSTs and the interrupt vectors, in every bank that it can tell the
+    // code switches to.  Nothing happens until the first time that somebody
+    // asks, and it all runs on a thread of its own, so it never holds up the
+    // emulator.  The second one adds a place that's known to be code (e.g.
+    // where the CPU is stopped) and follows it too.  Whatever was found gets
+    // cached on disk by the hash of the ROM, so it's only worked out once.
+    virtual std::future<Listing> disassemble() = 0;
+    virtual std::future<Listing> disassemble(uint16_t bank, uint16_t address) = 0;
+
+    virtual ColorArray getRGB() = 0;
+    virtual FrameInfo getFrameInfo() = 0;
+
+    // Same as getRGB, along with which frame it was.  Asking for the two of
+    // them separately could end up with the pixels from one frame and the
+    // sequence and hash of the next.
+    virtual ColorArray getRGB(FrameInfo & frame) = 0;
+
+    virtual void setFrameSkip(FrameSkipMode mode, uint8_t ratio = 0) = 0;
+    virtual void setThreadedRendering(bool enable) = 0;
+
+    // A headless instance keeps all of its timing and interrupts intact, but
+    // never draws (or allocates memory for) a frame unless one is requested.
+    // getRGB hands back the requested frame once it has been drawn.
+    virtual void setHeadless(bool enable) = 0;
+    virtual void requestFrame() = 0;
+
+    // Every color goes through the selected curve, including the DMG palette.
+    virtual void setColorCorrection(ColorCorrection curve) = 0;
+    virtual void setDmgPalette(const DmgPalette & palette) = 0;
+
+    // Paces the instance at any multiple of the real hardware's speed, where
+    // 0 runs it as fast as it can go.  This holds until the SPEED setting
+    // gets changed, which only has the presets that the UI offers.
+    virtual void setSpeed(double multiplier) = 0;
+
+    virtual Statistics getStatistics() = 0;
+
+    // Switches the instance over to a new set of settings.  Nothing else ever
+    // changes the settings of a running instance, so whoever owns it has to
+    // pass along any configuration updates that are supposed to apply to it.
+    virtual void configure(const ConfigSnapshot & config) = 0;
+    virtual ConfigSnapshot configuration() = 0;
 
     virtual void write(uint16_t address, uint8_t value) = 0;
     virtual uint8_t read(uint16_t address) = 0;
+
+    struct MemoryWrite {
+        uint16_t address;
+        uint8_t value;
+    };
+
+    using ReadCallback = std::function<void(std::vector<uint8_t>)>;
+
+    // Queued commands run on the emulation thread in between instructions,
+    // so they never have to stop the emulator.  Reads come back in the same
+    // order as the addresses that were asked for.  Callbacks run on the
+    // emulation thread, so they must not call anything that halts it, and
+    // nothing should wait on a result while it is holding the emulator.
+    virtual std::future<std::vector<uint8_t>> queueRead(std::vector<uint16_t> addresses) = 0;
+    virtual void queueRead(std::vector<uint16_t> addresses, ReadCallback done) = 0;
+    virtual std::future<void> queueWrite(std::vector<MemoryWrite> writes) = 0;
+    virtual void queueCallback(std::function<void()> callback) = 0;
 };
 
 #endif /* GAMEBOYINTERFACE_H_ */
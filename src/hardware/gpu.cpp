@@ -17,12 +17,14 @@
 #include <iostream>
 #include <cmath>
 #include <unordered_map>
+#include <cstring>
 
 #include "gpu.h"
 #include "processor.h"
 #include "memorycontroller.h"
 #include "memmap.h"
 #include "logging.h"
+#include "util.h"
 #include "gameboyinterface.h"
 
 using std::vector;
@@ -35,12 +37,49 @@ using std::unordered_map;
 using std::lock_guard;
 using std::mutex;
 using std::optional;
+using std::unique_lock;
+using std::thread;
+
+const GameBoyInterface::DmgPalette GPU::DMG_PALETTE = {{
+    0x7FFF, // white
+    0x5EF7, // light grey
+    0x318C, // grey
+    0x0000, // black
+}};
+
+/** Every CGB background palette is white once the BIOS is done with it */
+const GameBoyInterface::DmgPalette GPU::BOOT_PALETTE = {{
+    0x7FFF, 0x7FFF, 0x7FFF, 0x7FFF,
+}};
+
+/** The colors that the CGB BIOS gives a DMG game that it doesn't know about */
+const GameBoyInterface::DmgPalette GPU::COMPAT_BG_PALETTE = {{
+    0x7FFF, // white
+    0x1BEF, // light green
+    0x6180, // blue
+    0x0000, // black
+}};
+
+const GameBoyInterface::DmgPalette GPU::COMPAT_SPRITE_PALETTE = {{
+    0x7FFF, // white
+    0x421F, // light red
+    0x1CF2, // dark red
+    0x0000, // black
+}};
+
+/** The logo in the cartridge header, which the DMG BIOS copies in to VRAM */
+const uint16_t GPU::LOGO_ADDRESS = 0x0104;
+const uint16_t GPU::LOGO_LENGTH  = 48;
+
+/** The logo starts at tile 1, with the trademark right after it in tile 25 */
+const uint16_t GPU::LOGO_TILES = GPU_RAM_OFFSET + 0x0010;
 
-const ColorPalette GPU::DMG_PALETTE = {{
-    { { 0, 0 }, { 255, 255, 255, 0xFF } }, // white
-    { { 0, 0 }, { 192, 192, 192, 0xFF } }, // light grey
-    { { 0, 0 }, { 96,  96,  96,  0xFF } }, // grey
-    { { 0, 0 }, { 0,   0,   0,   0xFF } }, // black
+/** The logo is two rows of 12 tiles in the middle of the screen */
+const uint16_t GPU::LOGO_MAP = GPU_RAM_OFFSET + 0x1904;
+const uint8_t GPU::LOGO_MAP_COLUMNS = 12;
+
+const std::array<uint8_t, 8> GPU::LOGO_TRADEMARK = {{
+    0x3C, 0x42, 0xB9, 0xA5, 0xB9, 0xA5, 0x42, 0x4C,
 }};
 
 const uint8_t GPU::BANK_COUNT = GPU_BANK_COUNT;
@@ -66,6 +105,9 @@ const uint16_t GPU::TILE_MAP_0_OFFSET = TILE_SET_1_OFFSET + (TILES_PER_SET * TIL
 /** Tile map 1 comes directly after the end of tile map 0 */
 const uint16_t GPU::TILE_MAP_1_OFFSET = TILE_MAP_0_OFFSET + (TILE_MAP_ROWS * TILE_MAP_COLUMNS);
 
+/** The width (and height) of a tile map once it has been drawn out */
+const uint16_t GPU::TILE_MAP_PIXELS = TILE_MAP_COLUMNS * TILE_PIXELS_PER_ROW;
+
 const uint16_t GPU::BG_ATTRIBUTES_TABLE = TILE_SET_1_OFFSET + (TILES_PER_SET * TILE_SIZE);
 
 const uint16_t GPU::SPRITE_ATTRIBUTES_TABLE = GPU_SPRITE_TABLE_ADDRESS;
@@ -85,10 +127,10 @@ const uint8_t GPU::SPRITE_Y_OFFSET = 16;
 const uint16_t GPU::OAM_TICKS    = 80;
 const uint16_t GPU::VRAM_TICKS   = 172;
 const uint16_t GPU::HBLANK_TICKS = 204;
-const uint16_t GPU::VBLANK_TICKS = 4560;
 
-const uint16_t GPU::SCANLINE_MAX   = 155;
-const uint16_t GPU::SCANLINE_TICKS = VBLANK_TICKS / (SCANLINE_MAX - PIXELS_PER_COL);
+/** Every line takes the same amount of time, including the ones in the vblank */
+const uint16_t GPU::SCANLINE_MAX   = 153;
+const uint16_t GPU::SCANLINE_TICKS = OAM_TICKS + VRAM_TICKS + HBLANK_TICKS;
 
 const uint16_t GPU::PIXELS_PER_ROW = 160;
 const uint16_t GPU::PIXELS_PER_COL = 144;
@@ -97,25 +139,93 @@ const uint8_t GPU::ALPHA_TRANSPARENT = 0x00;
 
 const uint8_t GPU::WINDOW_ROW_OFFSET = 7;
 
+/** Let the CPU get up to two frames ahead of the render thread */
+const size_t GPU::PIPELINE_DEPTH = 2 * (PIXELS_PER_COL + 1);
+
 GPU::GPU(MemoryController & memory)
     : MemoryRegion(memory, GPU_RAM_SIZE, GPU_RAM_OFFSET, BANK_COUNT - 1),
       m_mmc(memory),
       m_control(m_mmc.read(GPU_CONTROL_ADDRESS)),
-      m_status(m_mmc.read(GPU_STATUS_ADDRESS)),
+      m_status(m_mmc.ioRegister(GPU_STATUS_ADDRESS)),
       m_palette(m_mmc.read(GPU_PALETTE_ADDRESS)),
+      m_obp1(m_mmc.read(GPU_OBP1_ADDRESS)),
+      m_obp2(m_mmc.read(GPU_OBP2_ADDRESS)),
       m_x(m_mmc.read(GPU_SCROLLX_ADDRESS)),
       m_y(m_mmc.read(GPU_SCROLLY_ADDRESS)),
       m_winX(m_mmc.read(GPU_WINDOW_X_ADDRESS)),
       m_winY(m_mmc.read(GPU_WINDOW_Y_ADDRESS)),
-      m_scanline(m_mmc.read(GPU_SCANLINE_ADDRESS)),
-      m_screen(PIXELS_PER_ROW * PIXELS_PER_COL),
-      m_buffer(PIXELS_PER_ROW * PIXELS_PER_COL),
-      m_bg(PIXELS_PER_ROW * PIXELS_PER_COL)
+      m_scanline(m_mmc.ioRegister(GPU_SCANLINE_ADDRESS)),
+      m_lyc(m_mmc.read(GPU_LYC_ADDRESS))
 {
+    m_skip.mode   = GameBoyInterface::FRAMESKIP_NONE;
+    m_skip.ratio  = 0;
+    m_skip.count  = 0;
+    m_skip.active = false;
+    m_skip.deterministic = false;
+
+    m_palettes  = Palettes();
+    m_dmg       = ColorPalette();
+    m_colors    = &ColorTable::get(GameBoyInterface::COLOR_RAW);
+    m_dmgColors = DMG_PALETTE;
+    updateColors();
+
+    m_renderLine = &GPU::updateScreen<false>;
+
+    m_lines.signatures.resize(PIXELS_PER_COL);
+    m_lines.valid.resize(PIXELS_PER_COL);
+
+    m_headless.enabled   = false;
+    m_headless.requested = false;
+
+    m_stats.drawn  = 0;
+    m_stats.reused = 0;
+    m_stats.frames = 0;
+
+    m_frame = { 0, 0 };
+
+    m_shadow.vram = m_memory;
+    m_shadow.oam.fill(0);
+
+    m_pipeline.running  = false;
+    m_pipeline.busy     = false;
+    m_pipeline.palettes = false;
+    m_pipeline.oam.fill(0);
+    clearDirty();
+
     reset();
 
+    m_render.regs = capture();
+
+    bindRenderMemory(false);
+}
+
+GPU::~GPU()
+{
+    setThreadedRendering(false);
+}
+
+void GPU::bindRenderMemory(bool shadow)
+{
+    if (shadow) {
+        m_render.vram     = &m_shadow.vram;
+        m_render.oam      = m_shadow.oam.data();
+        m_render.palettes = &m_shadow.palettes;
+    } else {
+        m_render.vram     = &m_memory;
+        m_render.oam      = &m_mmc.read(GRAPHICS_RAM_OFFSET);
+        m_render.palettes = &m_palettes;
+    }
+
+    // Both of the caches hold on to pointers in to the memory that we render
+    // from, so they need to be rebuilt every time that memory moves.
     initSpriteCache();
     initTileCache();
+
+    // The generation counters only tell us when the memory that we render
+    // from changes, so none of the lines that we drew out of the old memory
+    // can be trusted.
+    std::fill(m_lines.valid.begin(), m_lines.valid.end(), false);
+    invalidateMaps();
 }
 
 void GPU::initSpriteCache()
@@ -123,14 +233,16 @@ void GPU::initSpriteCache()
     for (size_t i = 0; i < m_sprites.size(); i++) {
         uint16_t address = SPRITE_ATTRIBUTES_TABLE + (i * SPRITE_BYTES_PER_ATTRIBUTE);
 
-        const uint8_t & y     = m_mmc.read(address);
-        const uint8_t & x     = m_mmc.read(address + 1);
-        const uint8_t & tile  = m_mmc.read(address + 2);
-        const uint8_t & flags = m_mmc.read(address + 3);
+        const uint8_t *attributes = m_render.oam + (address - SPRITE_ATTRIBUTES_TABLE);
+
+        const uint8_t & y     = attributes[0];
+        const uint8_t & x     = attributes[1];
+        const uint8_t & tile  = attributes[2];
+        const uint8_t & flags = attributes[3];
 
         shared_ptr<SpriteData> data = std::make_shared<SpriteData>(*this, x, y, tile, flags);
 
-        data->mono = { &m_mmc.read(GPU_OBP1_ADDRESS), &m_mmc.read(GPU_OBP2_ADDRESS) };
+        data->mono = { &m_render.regs.obp1, &m_render.regs.obp2 };
 
         data->address = address;
         data->height  = SPRITE_HEIGHT_NORMAL;
@@ -149,18 +261,26 @@ void GPU::initTileCache()
             (TILE_SET_0_OFFSET + (TILES_PER_SET * TILE_SIZE) + (offset.sVal * TILE_SIZE))
             - m_offset;
 
+        for (auto & bank : m_tiles) {
+            for (auto & set : bank) { set[i].clear(); }
+        }
+
         for (uint8_t j = 0; j < TILE_SIZE; j++) {
-            m_tiles[BANK_0][TILESET_0][i].push_back(&read(BANK_0, i0 + j));
-            m_tiles[BANK_1][TILESET_0][i].push_back(&read(BANK_1, i0 + j));
+            m_tiles[BANK_0][TILESET_0][i].push_back(&vram(BANK_0, i0 + j));
+            m_tiles[BANK_1][TILESET_0][i].push_back(&vram(BANK_1, i0 + j));
 
-            m_tiles[BANK_0][TILESET_1][i].push_back(&read(BANK_0, i1 + j));
-            m_tiles[BANK_1][TILESET_1][i].push_back(&read(BANK_1, i1 + j));
+            m_tiles[BANK_0][TILESET_1][i].push_back(&vram(BANK_0, i1 + j));
+            m_tiles[BANK_1][TILESET_1][i].push_back(&vram(BANK_1, i1 + j));
         }
     }
 }
 
 void GPU::reset()
 {
+    // The render thread owns all of the render state below, so it needs to
+    // be caught up and sitting idle before we go and clear it out.
+    flush();
+
     MemoryRegion::reset();
 
     m_control = 0x91;
@@ -169,8 +289,278 @@ void GPU::reset()
     updateRenderStateStatus(OAM);
 
     m_state = OAM;
+    m_vblank = false;
+
+    m_x = m_y = m_scanline = m_line = 0;
+
+    m_clock.cycles   = 0;
+    m_clock.frame    = 0;
+    m_clock.deadline = OAM_TICKS;
+
+    m_skip.count  = 0;
+    m_skip.active = m_headless.enabled;
+
+    // All of VRAM just got cleared out from under us, so none of the lines
+    // that we drew previously can be trusted any more.
+    for (auto & bank : m_generation.tiles) { bank.fill(0); }
+    for (auto & map : m_generation.maps)   { map.fill(0);  }
+    m_generation.palettes = 0;
+
+    std::fill(m_lines.valid.begin(), m_lines.valid.end(), false);
+    invalidateMaps();
+
+    // VRAM was wiped without going through write(), so the whole thing needs
+    // to go over to the render thread with the next line.
+    if (isThreaded()) {
+        for (size_t i = 0; i < m_pipeline.dirty.size(); i++) {
+            m_pipeline.dirty[i] = { 0, uint16_t(m_memory[i].size()) };
+        }
+    }
+}
+
+void GPU::saveState(StateWriter & state) const
+{
+    MemoryRegion::saveState(state);
+
+    state.put(m_state);
+    state.put(m_line);
+    state.put(m_clock);
+
+    for (const CgbColors *colors : { &m_palettes.bg, &m_palettes.sprite }) {
+        for (const ColorPalette & palette : *colors) {
+            for (const auto & color : palette) { state.put(color.first); }
+        }
+    }
+}
+
+bool GPU::loadState(StateReader & state)
+{
+    // Same as a reset, the render thread has to be sitting idle before we go
+    // and change everything out from under it.
+    flush();
+
+    if (!MemoryRegion::loadState(state)) { return false; }
+
+    if (!state.get(m_state) || !state.get(m_line) || !state.get(m_clock)) {
+        return false;
+    }
+
+    for (CgbColors *colors : { &m_palettes.bg, &m_palettes.sprite }) {
+        for (ColorPalette & palette : *colors) {
+            for (auto & [bytes, rgb] : palette) {
+                if (!state.get(bytes)) { return false; }
+
+                rgb = (*m_colors)[uint16_t((bytes[1] << 8) | bytes[0])];
+            }
+        }
+    }
+
+    m_skip.active = true;
+    m_vblank = false;
+
+    // VRAM and the palettes got replaced without going through write(), so
+    // nothing that we drew before can be trusted, and the render thread needs
+    // to be sent all of it.
+    m_generation.palettes++;
+
+    std::fill(m_lines.valid.begin(), m_lines.valid.end(), false);
+    invalidateMaps();
+
+    if (isThreaded()) {
+        for (size_t i = 0; i < m_pipeline.dirty.size(); i++) {
+            m_pipeline.dirty[i] = { 0, uint16_t(m_memory[i].size()) };
+        }
+        m_pipeline.palettes = true;
+    }
+    return true;
+}
+
+void GPU::setThreadedRendering(bool enable)
+{
+    if (enable == isThreaded()) { return; }
+
+    if (!enable) {
+        {
+            lock_guard<mutex> guard(m_pipeline.lock);
+            m_pipeline.running = false;
+        }
+        m_pipeline.cv.notify_all();
+
+        m_pipeline.thread.join();
+
+        bindRenderMemory(false);
+        return;
+    }
+
+    // Start the render thread off with its own copy of everything that it
+    // draws from.  From here on out, it only ever sees the changes that get
+    // handed over with each scanline.
+    m_shadow.vram = m_memory;
+    m_shadow.palettes = m_palettes;
+    std::memcpy(m_shadow.oam.data(), &m_mmc.read(GRAPHICS_RAM_OFFSET), m_shadow.oam.size());
+
+    m_pipeline.oam = m_shadow.oam;
+    m_pipeline.palettes = false;
+    clearDirty();
+
+    bindRenderMemory(true);
+
+    m_pipeline.running = true;
+    m_pipeline.thread = thread(&GPU::render, this);
+}
+
+void GPU::setModel(bool cgb)
+{
+    // Lines that are already in the pipeline were captured for the previous
+    // cartridge, so let them finish with the renderer that they expect.
+    flush();
+
+    m_renderLine = (cgb) ? &GPU::updateScreen<true> : &GPU::updateScreen<false>;
+
+    // The attributes only get used on a CGB, so the map images that we drew
+    // for the other model can't be used.
+    invalidateMaps();
+}
 
-    m_x = m_y = m_scanline = m_ticks = m_vscan = 0;
+void GPU::setHeadless(bool enable)
+{
+    // The frame buffers belong to whoever is rendering, so make sure that the
+    // render thread is done with them before we go and free them.
+    flush();
+
+    m_headless.enabled = enable;
+    if (enable) {
+        // Don't bother finishing off the frame that's in progress.
+        m_skip.active = true;
+
+        release();
+
+        lock_guard<mutex> guard(m_lock);
+        ColorArray().swap(m_screen);
+    }
+}
+
+void GPU::allocate()
+{
+    // None of the frame buffers get allocated until the first time that we
+    // actually draw something, so a headless instance never pays for them.
+    if (!m_buffer.empty()) { return; }
+
+    m_buffer.resize(PIXELS_PER_ROW * PIXELS_PER_COL);
+    m_bg.resize(PIXELS_PER_ROW * PIXELS_PER_COL);
+    m_lines.pixels.resize(PIXELS_PER_ROW * PIXELS_PER_COL);
+
+    for (auto & map : m_maps) {
+        for (MapImage & image : map) { image.pixels.resize(TILE_MAP_PIXELS * TILE_MAP_PIXELS); }
+    }
+}
+
+void GPU::release()
+{
+    ColorArray().swap(m_buffer);
+    ColorArray().swap(m_bg);
+    ColorArray().swap(m_lines.pixels);
+
+    for (auto & map : m_maps) {
+        for (MapImage & image : map) { std::vector<uint8_t>().swap(image.pixels); }
+    }
+
+    std::fill(m_lines.valid.begin(), m_lines.valid.end(), false);
+    invalidateMaps();
+}
+
+void GPU::invalidateMaps()
+{
+    for (auto & map : m_maps) {
+        for (MapImage & image : map) {
+            for (MapEntry & entry : image.entries) { entry.valid = false; }
+        }
+    }
+}
+
+void GPU::setColorCorrection(GameBoyInterface::ColorCorrection curve)
+{
+    m_colors = &ColorTable::get(curve);
+    updateColors();
+}
+
+void GPU::setDmgPalette(const GameBoyInterface::DmgPalette & palette)
+{
+    m_dmgColors = palette;
+    updateColors();
+}
+
+void GPU::updateColors()
+{
+    // The DMG palette is render state, so the render thread has to be done
+    // with it before we can change it.
+    flush();
+
+    for (size_t i = 0; i < m_dmg.size(); i++) {
+        m_dmg[i].second = (*m_colors)[m_dmgColors[i]];
+    }
+
+    // The CGB palettes hang on to the bytes that the game wrote, so run those
+    // back through the table to pick up the new curve.
+    for (CgbColors *colors : { &m_palettes.bg, &m_palettes.sprite }) {
+        for (ColorPalette & palette : *colors) {
+            for (auto & [bytes, rgb] : palette) {
+                rgb = (*m_colors)[uint16_t((bytes[1] << 8) | bytes[0])];
+            }
+        }
+    }
+
+    m_generation.palettes++;
+    m_pipeline.palettes = isThreaded();
+}
+
+void GPU::setFrameSkip(GameBoyInterface::FrameSkipMode mode, uint8_t ratio)
+{
+    m_skip.mode  = mode;
+    m_skip.ratio = ratio;
+    m_skip.count = 0;
+}
+
+bool GPU::isFrameSkipped()
+{
+    switch (m_skip.mode) {
+    default:
+        assert(0);
+        [[fallthrough]];
+
+    case GameBoyInterface::FRAMESKIP_NONE:
+        return false;
+
+    case GameBoyInterface::FRAMESKIP_FIXED: {
+        // Render one frame and then skip the next ratio frames.  A ratio of 0
+        // is the same thing as not skipping any frames at all.
+        bool skip = (0 != m_skip.count);
+        m_skip.count = (m_skip.count >= m_skip.ratio) ? 0 : m_skip.count + 1;
+        return skip;
+    }
+
+    case GameBoyInterface::FRAMESKIP_AUTO: {
+        if (m_skip.deterministic) { return false; }
+
+        // The screen buffer gets moved out when the external code grabs the
+        // frame, so if it's still holding pixels, nobody has looked at the last
+        // frame that we rendered and there is no point in rendering another.
+        lock_guard<mutex> guard(m_lock);
+        return !m_screen.empty();
+    }
+    }
+}
+
+void GPU::startFrame()
+{
+    // A headless instance only draws the frames that somebody asked for.  A
+    // request that shows up in the middle of a frame gets the next full one.
+    if (m_headless.enabled) {
+        m_skip.active = !m_headless.requested.exchange(false, std::memory_order_acq_rel);
+        return;
+    }
+
+    m_skip.active = isFrameSkipped();
 }
 
 void GPU::write(uint16_t address, uint8_t value)
@@ -184,9 +574,110 @@ void GPU::write(GPU::MemoryBank selected, uint16_t index, uint8_t value)
     assert(int(selected) < m_memory.size());
     assert(index < m_memory[int(selected)].size());
 
+    // When the render thread is running, it has its own copy of VRAM, so all
+    // that we need to do here is remember what it is going to need to copy.
+    if (isThreaded()) {
+        markDirty(selected, index);
+    } else {
+        touch(selected, index, value);
+    }
+
     m_memory[int(selected)][index] = value;
 }
 
+void GPU::markDirty(GPU::MemoryBank bank, uint16_t index)
+{
+    auto & [first, last] = m_pipeline.dirty[bank];
+
+    first = std::min(first, index);
+    last  = std::max(last, uint16_t(index + 1));
+}
+
+void GPU::clearDirty()
+{
+    for (size_t i = 0; i < m_pipeline.dirty.size(); i++) {
+        m_pipeline.dirty[i] = { uint16_t(m_memory[i].size()), 0 };
+    }
+}
+
+void GPU::touch(GPU::MemoryBank bank, uint16_t index, uint8_t value)
+{
+    // Rewriting the same value doesn't change anything that we are going to
+    // draw, so don't invalidate any of the lines that depend on this byte.
+    if (vram(bank, index) == value) { return; }
+
+    uint16_t address = index + m_offset;
+    if (address < TILE_MAP_0_OFFSET) {
+        m_generation.tiles[bank][index / TILE_SIZE]++;
+    } else {
+        // Both the tile numbers (bank 0) and the CGB attributes (bank 1) are
+        // laid out the same way, so they share a counter for each map row.
+        TileMapIndex map = (address < TILE_MAP_1_OFFSET) ? TILEMAP_0 : TILEMAP_1;
+        uint16_t offset  = (TILEMAP_0 == map) ? TILE_MAP_0_OFFSET : TILE_MAP_1_OFFSET;
+
+        m_generation.maps[map][(address - offset) / TILE_MAP_COLUMNS]++;
+    }
+}
+
+void GPU::boot(bool cgb, bool title)
+{
+    // The CGB BIOS draws its logo in a format of its own, which nothing ever
+    // looks at once the cartridge starts, so its VRAM is left empty.
+    if (!cgb) {
+        drawLogo();
+        return;
+    }
+
+    // Every background palette gets cleared out to white, and a DMG game
+    // gets a set of colors picked out for it in the palettes that its tiles
+    // and sprites end up using.  A CGB game sets up its own colors.
+    for (uint8_t i = 0; i < GPU_CGB_PALETTE_COUNT; i++) {
+        writePalette(m_palettes.bg, i, BOOT_PALETTE);
+    }
+
+    if (!title) {
+        writePalette(m_palettes.bg, 0, COMPAT_BG_PALETTE);
+        writePalette(m_palettes.sprite, 0, COMPAT_SPRITE_PALETTE);
+        writePalette(m_palettes.sprite, 1, COMPAT_SPRITE_PALETTE);
+    }
+}
+
+void GPU::drawLogo()
+{
+    // Every pixel of the logo in the header gets doubled in both directions,
+    // so each nibble turns in to two rows of a tile.  Only the low bit plane
+    // gets written, which is the darkest shade with the palette that the
+    // BIOS leaves behind.
+    uint16_t index = LOGO_TILES - m_offset;
+    for (uint16_t i = 0; i < LOGO_LENGTH; i++) {
+        uint8_t value = m_mmc.peek(LOGO_ADDRESS + i);
+
+        for (uint8_t nibble : { uint8_t(value >> 4), uint8_t(value & 0x0F) }) {
+            uint8_t row = 0x00;
+            for (uint8_t bit = 0; bit < 4; bit++) {
+                if (nibble & (1 << bit)) { row |= (0x03 << (bit * 2)); }
+            }
+
+            write(BANK_0, index, row);
+            write(BANK_0, index + 2, row);
+            index += 4;
+        }
+    }
+
+    // The trademark comes out of the BIOS itself instead of the cartridge.
+    for (uint8_t row : LOGO_TRADEMARK) {
+        write(BANK_0, index, row);
+        index += 2;
+    }
+
+    uint16_t map = LOGO_MAP - m_offset;
+    for (uint8_t i = 0; i < LOGO_MAP_COLUMNS; i++) {
+        write(BANK_0, map + i, i + 1);
+        write(BANK_0, map + TILE_MAP_COLUMNS + i, i + LOGO_MAP_COLUMNS + 1);
+    }
+    write(BANK_0, map + LOGO_MAP_COLUMNS, (LOGO_MAP_COLUMNS * 2) + 1);
+}
+
 uint8_t & GPU::read(uint16_t address)
 {
     MemoryBank selected = (MemoryBank)(m_mmc.read(GPU_BANK_SELECT_ADDRESS) & 0x01);
@@ -201,173 +692,462 @@ uint8_t & GPU::read(GPU::MemoryBank selected, uint16_t index)
     return m_memory[int(selected)][index];
 }
 
-GPU::RenderState GPU::next()
+void GPU::cycle(uint8_t ticks)
+{
+    if (!isDisplayEnabled()) { return; }
+
+    m_clock.cycles += ticks;
+
+    // The mode only changes a handful of times per scanline, so there is
+    // nothing for us to do until the master cycle count catches up with the
+    // timestamp of the next transition.  A long instruction can carry us past
+    // more than one of them, so keep going until we're caught back up.
+    while (m_clock.cycles >= m_clock.deadline) {
+        m_clock.deadline += transition();
+    }
+}
+
+uint16_t GPU::transition()
 {
     switch (m_state) {
-    case HBLANK: {
-        if (m_ticks < HBLANK_TICKS) { break; }
+    default:
+        LOG("GPU::transition : Unknown GPU state %d\n", m_state);
+        assert(0);
+        [[fallthrough]];
 
-        m_ticks -= HBLANK_TICKS;
-        return (PIXELS_PER_COL == m_scanline) ? VBLANK : OAM;
+    case OAM:    return enterVRAM();
+    case VRAM:   return enterHBlank();
+    case HBLANK: return (PIXELS_PER_COL == (m_line + 1)) ? enterVBlank() : enterOAM();
+    case VBLANK: return (SCANLINE_MAX == m_line) ? enterOAM() : nextVBlankLine();
     }
-    case VBLANK: {
-        if (m_ticks < VBLANK_TICKS) { break; }
+}
 
-        m_ticks -= VBLANK_TICKS;
-        return (SCANLINE_MAX == m_scanline) ? HBLANK : VBLANK;
+uint16_t GPU::enterOAM()
+{
+    // We either just finished up a visible line or we're coming out of the
+    // vblank.  If it's the latter, we're starting back at the top of the
+    // screen, so this is the timestamp that the rest of the frame is measured
+    // from.
+    if (VBLANK == m_state) {
+        m_line = 0;
+        m_clock.frame = m_clock.deadline;
+
+        startFrame();
+    } else {
+        m_line++;
     }
-    case OAM: {
-        if (m_ticks < OAM_TICKS) { break; }
 
-        m_ticks -= OAM_TICKS;
-        return VRAM;
+    m_state = OAM;
+
+    if (isOAMInterruptEnabled()) {
+        m_mmc.interrupts().raise(InterruptMask::LCD);
     }
-    case VRAM: {
-        if (m_ticks < VRAM_TICKS) { break; }
+    compare();
 
-        m_ticks -= VRAM_TICKS;
-        return HBLANK;
+    return OAM_TICKS;
+}
+
+uint16_t GPU::enterVRAM()
+{
+    m_state = VRAM;
+
+    return VRAM_TICKS;
+}
+
+uint16_t GPU::enterHBlank()
+{
+    // Draw the whole line in one shot as soon as the pixel transfer is done.
+    // The registers that the game set up during the OAM and VRAM periods are
+    // the ones that are in effect for this line.  Skipped frames still run
+    // through all of the mode transitions and interrupts, they just never
+    // spend any time generating pixels.
+    submit((m_skip.active) ? SKIP_LINE : DRAW_LINE);
+
+    m_state = HBLANK;
+
+    if (isHBlankInterruptEnabled()) {
+        m_mmc.interrupts().raise(InterruptMask::LCD);
     }
-    default: {
-        LOG("GPU::next() : Unknown render state %d\n", m_state);
 
-        assert(0);
-        break;
+    return HBLANK_TICKS;
+}
+
+uint16_t GPU::enterVBlank()
+{
+    m_line++;
+    m_state = VBLANK;
+
+    if (isVBlankInterruptEnabled()) {
+        m_mmc.interrupts().raise(InterruptMask::LCD);
     }
+    m_mmc.interrupts().raise(InterruptMask::VBLANK);
+
+    compare();
+
+    m_vblank = true;
+    m_stats.frames.fetch_add(1, std::memory_order_relaxed);
+
+    // Skipped frames never touched the buffer, so there is nothing new to
+    // hand over.
+    if (!m_skip.active) {
+        submit(PRESENT_FRAME);
     }
 
-    return m_state;
+    return SCANLINE_TICKS;
 }
 
-void GPU::cycle(uint8_t ticks)
+void GPU::present()
 {
-    if (!isDisplayEnabled()) { return; }
+    // We've move in to the vblank state, so move the internal buffer
+    // over to the screen buffer that the external code can retrieve.
+    // This empties out our buffer, so we need to resize it to the size
+    // of the screen.  Headless instances only get here for a frame that
+    // was asked for, so they hand the rest of the memory back instead.
+    uint64_t hash = Util::hash(m_buffer.data(), m_buffer.size() * sizeof(GB::RGB));
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_screen = std::move(m_buffer);
+
+        m_frame.sequence++;
+        m_frame.hash = hash;
+    }
 
-    m_ticks += ticks;
+    if (m_headless.enabled) {
+        release();
+    } else {
+        allocate();
+    }
+}
 
-    switch (m_state) {
-    case HBLANK: handleHBlank();      break;
-    case VBLANK: handleVBlank(ticks); break;
-    case OAM:    handleOAM();         break;
-    case VRAM:   handleVRAM();        break;
-    default:
-        LOG("GPU::cycle : Unknown GPU state %d\n", m_state);
-        assert(0);
+GPU::LineRegisters GPU::capture() const
+{
+    return {
+        m_line, m_control, m_x, m_y, m_winX, m_winY, m_palette, m_obp1, m_obp2,
+    };
+}
+
+void GPU::submit(RenderCommand command)
+{
+    Scanline scanline;
+    scanline.command = command;
+    scanline.regs    = capture();
+
+    // Without a render thread, the renderer is looking at the live memory, so
+    // there's nothing to copy and we can go ahead and run the command now.
+    if (!isThreaded()) {
+        execute(scanline);
         return;
     }
 
-    m_state = next();
+    for (size_t i = 0; i < m_pipeline.dirty.size(); i++) {
+        const auto & [first, last] = m_pipeline.dirty[i];
+        if (first >= last) { continue; }
+
+        scanline.vram.push_back({
+            MemoryBank(i),
+            first,
+            vector<uint8_t>(m_memory[i].begin() + first, m_memory[i].begin() + last)
+        });
+    }
+    clearDirty();
+
+    // OAM gets written by the DMA and the CPU without ever going through us,
+    // so compare it against what we sent last time.  It's small enough that
+    // this is cheaper than trying to track the writes.
+    const uint8_t *oam = &m_mmc.read(GRAPHICS_RAM_OFFSET);
+    if (0 != std::memcmp(oam, m_pipeline.oam.data(), m_pipeline.oam.size())) {
+        std::memcpy(m_pipeline.oam.data(), oam, m_pipeline.oam.size());
+        scanline.oam = m_pipeline.oam;
+    }
+
+    if (m_pipeline.palettes) {
+        scanline.palettes = m_palettes;
+        m_pipeline.palettes = false;
+    }
+
+    // If the render thread has fallen too far behind, hold the CPU up until
+    // it catches back up so that the queue can't grow without bound.
+    {
+        unique_lock<mutex> lock(m_pipeline.lock);
+        m_pipeline.cv.wait(lock, [&] { return m_pipeline.queue.size() < PIPELINE_DEPTH; });
+
+        m_pipeline.queue.push_back(std::move(scanline));
+    }
+    m_pipeline.cv.notify_all();
 }
 
-void GPU::handleHBlank()
+void GPU::execute(Scanline & scanline)
 {
-    if (HBLANK != (m_status & RENDER_MODE)) {
-        // The hblank mode hasn't been set yet, so this is the first time that we
-        // have executed the function in this mode.  If so, we need to figure out
-        // if we are coming out of a vblank.  If that is the case, we need to
-        // clear the scanline as we are starting back at the beginning.
-        if (VBLANK == (m_status & RENDER_MODE)) {
-            m_scanline = 0;
+    // Bring our copy of the memory up to date before drawing anything.  The
+    // VRAM goes through touch() one byte at a time so that the generation
+    // counters still only move for the bytes that actually changed.
+    for (const Scanline::Patch & patch : scanline.vram) {
+        for (size_t i = 0; i < patch.bytes.size(); i++) {
+            uint16_t index = uint16_t(patch.index + i);
+
+            touch(patch.bank, index, patch.bytes[i]);
+            m_shadow.vram[patch.bank][index] = patch.bytes[i];
         }
+    }
 
-        if (isHBlankInterruptEnabled()) {
-            Interrupts::set(m_mmc, InterruptMask::LCD);
-        }
-        updateRenderStateStatus(HBLANK);
+    if (scanline.oam) { m_shadow.oam = *scanline.oam; }
+
+    if (scanline.palettes) {
+        m_shadow.palettes = *scanline.palettes;
+        m_generation.palettes++;
     }
 
-    if (m_ticks < HBLANK_TICKS) { return; }
+    m_render.regs = scanline.regs;
+
+    switch (scanline.command) {
+    default:
+        assert(0);
+        [[fallthrough]];
 
-    updateScreen();
-    m_scanline++;
+    case SKIP_LINE:     break;
+    case DRAW_LINE:     (this->*m_renderLine)(); break;
+    case PRESENT_FRAME: present();      break;
+    }
 }
 
-void GPU::handleVBlank(uint8_t ticks)
+void GPU::render()
 {
-    if (VBLANK != (m_status & RENDER_MODE)) {
-        if (isVBlankInterruptEnabled()) {
-            Interrupts::set(m_mmc, InterruptMask::LCD);
+    while (true) {
+        Scanline scanline;
+        {
+            unique_lock<mutex> lock(m_pipeline.lock);
+            m_pipeline.cv.wait(lock, [&] {
+                return (!m_pipeline.queue.empty() || !m_pipeline.running);
+            });
+
+            // We only bail once everything that was handed to us is drawn.
+            if (m_pipeline.queue.empty()) { return; }
+
+            scanline = std::move(m_pipeline.queue.front());
+            m_pipeline.queue.pop_front();
+
+            m_pipeline.busy = true;
         }
+        m_pipeline.cv.notify_all();
 
-        Interrupts::set(m_mmc, InterruptMask::VBLANK);
-        updateRenderStateStatus(VBLANK);
+        execute(scanline);
 
-        // We've move in to the vblank state, so move the internal buffer
-        // over to the screen buffer that the external code can retrieve.
-        // This empties out our buffer, so we need to resize it to the size
-        // of the screen.
         {
-            lock_guard<mutex> guard(m_lock);
-            m_screen = std::move(m_buffer);
+            lock_guard<mutex> guard(m_pipeline.lock);
+            m_pipeline.busy = false;
         }
-        m_buffer.resize(PIXELS_PER_ROW * PIXELS_PER_COL);
+        m_pipeline.cv.notify_all();
     }
+}
 
-    m_vscan += ticks;
-    if (SCANLINE_TICKS <= m_vscan) {
-        m_vscan -= SCANLINE_TICKS;
+void GPU::flush()
+{
+    if (!isThreaded()) { return; }
 
-        m_scanline = std::min(uint16_t(m_scanline + 1), SCANLINE_MAX);
-    }
+    unique_lock<mutex> lock(m_pipeline.lock);
+    m_pipeline.cv.wait(lock, [&] { return (m_pipeline.queue.empty() && !m_pipeline.busy); });
 }
 
-void GPU::handleOAM()
+uint16_t GPU::nextVBlankLine()
 {
-    if (OAM != (m_status & RENDER_MODE)) {
-        if (isOAMInterruptEnabled()) {
-            Interrupts::set(m_mmc, InterruptMask::LCD);
-        }
-        updateRenderStateStatus(OAM);
+    // The mode doesn't change while we're in the vblank, but LY still counts
+    // through the lines below the screen, and each one of them gets compared
+    // against LYC just like a visible line would.
+    m_line++;
+    compare();
+
+    return SCANLINE_TICKS;
+}
+
+void GPU::compare()
+{
+    if ((m_line == m_lyc) && isCoincidenceInterruptEnabled()) {
+        m_mmc.interrupts().raise(InterruptMask::LCD);
     }
 }
 
-void GPU::handleVRAM()
+void GPU::writeControl(uint8_t value)
 {
-    if (VRAM != (m_status & RENDER_MODE)) {
-        updateRenderStateStatus(VRAM);
+    bool enabled = isDisplayEnabled();
+    m_control = value;
+
+    if (enabled || !isDisplayEnabled()) { return; }
+
+    // The clock doesn't move while the display is off, so the frame starts
+    // over from wherever it is now.
+    m_clock.frame    = m_clock.cycles;
+    m_clock.deadline = m_clock.cycles + OAM_TICKS;
+
+    m_state = OAM;
+    m_line  = 0;
+
+    startFrame();
+    compare();
+}
+
+void GPU::writeCompare(uint8_t value)
+{
+    m_lyc = value;
+
+    if (isDisplayEnabled() && (currentLine() == m_lyc) && isCoincidenceInterruptEnabled()) {
+        m_mmc.interrupts().raise(InterruptMask::LCD);
     }
 }
 
+uint8_t GPU::currentLine() const
+{
+    // LY sits at 0 for as long as the display is off.
+    if (!isDisplayEnabled()) { return 0; }
+
+    uint64_t elapsed = m_clock.cycles - m_clock.frame;
+    return uint8_t(std::min<uint64_t>(elapsed / SCANLINE_TICKS, SCANLINE_MAX));
+}
+
+GPU::RenderState GPU::currentMode() const
+{
+    if (!isDisplayEnabled()) { return HBLANK; }
+
+    uint64_t elapsed = m_clock.cycles - m_clock.frame;
+    if (elapsed >= uint64_t(PIXELS_PER_COL * SCANLINE_TICKS)) { return VBLANK; }
+
+    uint16_t dot = uint16_t(elapsed % SCANLINE_TICKS);
+    if (dot < OAM_TICKS) { return OAM; }
+
+    return (dot < (OAM_TICKS + VRAM_TICKS)) ? VRAM : HBLANK;
+}
+
+uint8_t & GPU::readScanline()
+{
+    // LY isn't kept up to date as the GPU runs.  Instead, it gets worked out
+    // from the master cycle count whenever somebody actually asks for it.
+    m_scanline = currentLine();
+    return m_scanline;
+}
+
+uint8_t & GPU::readStatus()
+{
+    uint8_t coincidence = (currentLine() == m_lyc) ? COINCIDENCE_FLAG : 0x00;
+
+    m_status = (m_status & ~(RENDER_MODE | COINCIDENCE_FLAG))
+             | coincidence | uint8_t(currentMode());
+    return m_status;
+}
+
+template <bool CGB>
 void GPU::updateScreen()
 {
-    if (m_scanline >= PIXELS_PER_COL) { return; }
+    const LineRegisters & regs = m_render.regs;
+
+    if (regs.line >= PIXELS_PER_COL) { return; }
+
+    allocate();
+
+    TileSetIndex set = (regs.control & TILE_SET_SELECT) ? TILESET_0 : TILESET_1;
 
-    TileSetIndex set = (m_control & TILE_SET_SELECT) ? TILESET_0 : TILESET_1;
+    TileMapIndex background = (regs.control & BACKGROUND_MAP) ? TILEMAP_1 : TILEMAP_0;
+    TileMapIndex window     = (regs.control & WINDOW_MAP) ? TILEMAP_1 : TILEMAP_0;
 
-    TileMapIndex background = (m_control & BACKGROUND_MAP) ? TILEMAP_1 : TILEMAP_0;
-    TileMapIndex window     = (m_control & WINDOW_MAP) ? TILEMAP_1 : TILEMAP_0;
+    auto line = m_buffer.begin() + (regs.line * PIXELS_PER_ROW);
+    auto last = m_lines.pixels.begin() + (regs.line * PIXELS_PER_ROW);
 
-    draw(set, background, window);
+    // If nothing that feeds in to this line has changed since the last time
+    // that we drew it, then we can just copy those pixels over instead of
+    // drawing the whole thing all over again.
+    uint64_t hash = signature<CGB>(set, background, window);
+    if (m_lines.valid[regs.line] && (hash == m_lines.signatures[regs.line])) {
+        std::copy(last, last + PIXELS_PER_ROW, line);
+
+        m_stats.reused.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    draw<CGB>(set, background, window);
+
+    std::copy(line, line + PIXELS_PER_ROW, last);
+
+    m_lines.signatures[regs.line] = hash;
+    m_lines.valid[regs.line] = true;
+
+    m_stats.drawn.fetch_add(1, std::memory_order_relaxed);
 }
 
-pair<const uint8_t&, const Tile&> GPU::lookup(
-    TileMapIndex mIndex,
-    TileSetIndex sIndex,
-    uint16_t x,
-    uint16_t y)
+template <bool CGB>
+uint64_t GPU::signature(TileSetIndex set, TileMapIndex background, TileMapIndex window)
 {
-    // We have two maps, so figure out which offset we need to use for our address
-    uint16_t offset = (TILEMAP_0 == mIndex) ? TILE_MAP_0_OFFSET : TILE_MAP_1_OFFSET;
+    const LineRegisters & regs = m_render.regs;
 
-    // Now that we know our offset, figure out the address of the tile that we are
-    // needing to look up.
-    uint16_t pointer = offset + ((y * TILE_MAP_COLUMNS) + x) - m_offset;
+    uint64_t hash = 0xCBF29CE484222325ULL;
 
-    // The attributes map lives in bank 1, so make sure that we are always reading
-    // out of bank 1 for the attributes.
-    const uint8_t & attributes = read(BANK_1, pointer);
+    // Start off with all of the registers that change how the line is drawn.
+    hash = mix(hash, (uint64_t(regs.control) << 56) | (uint64_t(regs.x) << 48)
+                   | (uint64_t(regs.y) << 40) | (uint64_t(regs.winX) << 32)
+                   | (uint64_t(regs.winY) << 24) | (uint64_t(regs.palette) << 16)
+                   | (uint64_t(regs.obp1) << 8) | uint64_t(regs.obp2));
+    hash = mix(hash, (uint64_t(m_generation.palettes) << 1) | (CGB ? 1 : 0));
 
-    // VRAM banking only happens in CGB mode, so hardcode bank 0 and only look up
-    // the actual bank if CGB mode is active.
-    MemoryBank bank = BANK_0;
-    if (m_mmc.isCGB()) {
-        bank = (attributes & BG_TILE_BANK) ? BANK_1 : BANK_0;
+    // Fold in the generation of every tile that the background and window are
+    // going to pull pixels out of on this line along with the rows of the map
+    // that pointed us at those tiles.
+    auto addTiles = [&](TileMapIndex map, uint16_t row, uint16_t column) {
+        row %= (TILE_MAP_ROWS * TILE_PIXELS_PER_COL);
+
+        uint16_t yOffset = row / TILE_PIXELS_PER_COL;
+        hash = mix(hash, m_generation.maps[map][yOffset]);
+
+        uint16_t first = column / TILE_PIXELS_PER_ROW;
+        uint16_t count = (PIXELS_PER_ROW / TILE_PIXELS_PER_ROW) + 1;
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t xOffset = (first + i) % TILE_MAP_COLUMNS;
+
+            uint16_t offset  = (TILEMAP_0 == map) ? TILE_MAP_0_OFFSET : TILE_MAP_1_OFFSET;
+            uint16_t pointer = offset + ((yOffset * TILE_MAP_COLUMNS) + xOffset) - m_offset;
+
+            MemoryBank bank = BANK_0;
+            if constexpr (CGB) {
+                bank = (vram(BANK_1, pointer) & BG_TILE_BANK) ? BANK_1 : BANK_0;
+            }
+
+            hash = mix(hash, m_generation.tiles[bank][tileIndex(set, vram(BANK_0, pointer))]);
+        }
+    };
+
+    if (isBackgroundEnabled()) {
+        addTiles(background, regs.y + regs.line, regs.x);
+
+        if (isWindowEnabled() && (regs.line >= regs.winY)) {
+            addTiles(window, regs.line - regs.winY, 0);
+        }
+    }
+
+    // Lastly, mix in the attributes of every sprite that touches this line and
+    // the tiles that they are drawn with.
+    if (areSpritesEnabled()) {
+        uint8_t height = (regs.control & SPRITE_SIZE) ? SPRITE_HEIGHT_EXTENDED : SPRITE_HEIGHT_NORMAL;
+
+        for (shared_ptr<SpriteData> & data : m_sprites) {
+            if (!data) { continue; }
+
+            data->height = height;
+            if (!data->isVisible()) { continue; }
+
+            hash = mix(hash, (uint64_t(data->address) << 32) | (uint64_t(data->x) << 24)
+                           | (uint64_t(data->y) << 16) | (uint64_t(data->tile) << 8)
+                           | uint64_t(data->flags));
+
+            MemoryBank bank = BANK_0;
+            if constexpr (CGB) {
+                bank = (data->flags & TILE_BANK_CGB) ? BANK_1 : BANK_0;
+            }
+
+            uint8_t number = (SPRITE_HEIGHT_EXTENDED == height) ? (data->tile & 0xFE) : data->tile;
+            hash = mix(hash, m_generation.tiles[bank][number]);
+            if (SPRITE_HEIGHT_EXTENDED == height) {
+                hash = mix(hash, m_generation.tiles[bank][number + 1]);
+            }
+        }
     }
 
-    // The actual background maps, live in bank 0, so make sure that the tile address
-    // comes from bank 0.  Look that tile up and return it with its corresponding
-    // attributes.
-    return { attributes, getTile(bank, sIndex, read(BANK_0, pointer)) };
+    return hash;
 }
 
 void GPU::toRGB(
@@ -413,92 +1193,149 @@ void GPU::toRGB(
     }
 }
 
-bool GPU::isWindowSelected(uint8_t x, uint8_t y)
+template <bool CGB>
+void GPU::drawBackground(TileSetIndex set, TileMapIndex background, TileMapIndex window)
 {
-    // We are trying to figure out if the window is visible at the given x and y,
-    // so the first thing that we need to check is if the window is even enabled.
-    if (!isWindowEnabled()) { return false; }
+    const LineRegisters & regs = m_render.regs;
+
+    uint16_t offset = regs.line * PIXELS_PER_ROW;
 
-    if ((y < m_winY) || (y >= PIXELS_PER_COL)) { return false; }
+    // Make sure that the line starts out blank when the background is turned
+    // off.  The buffer doesn't get replaced on frames that are skipped, so it
+    // could otherwise still be holding pixels from an older frame.
+    if (!isBackgroundEnabled()) {
+        std::fill(m_buffer.begin() + offset, m_buffer.begin() + offset + PIXELS_PER_ROW, GB::RGB());
+        std::fill(m_bg.begin() + offset, m_bg.begin() + offset + PIXELS_PER_ROW, GB::RGB());
+        return;
+    }
 
-    if (((x + WINDOW_ROW_OFFSET) < m_winX)
-        || (x >= (PIXELS_PER_ROW + WINDOW_ROW_OFFSET))) { return false; }
+    // The map images only hold color indices, so figure out what each one of
+    // them looks like on this line.  A DMG only has the 4 colors and they go
+    // through the background palette register first.
+    MapColors colors;
+    if constexpr (CGB) {
+        for (size_t i = 0; i < colors.size(); i++) {
+            colors[i] = m_render.palettes->bg.at(i / GPU_COLORS_PER_PALETTE)
+                .at(i % GPU_COLORS_PER_PALETTE).second;
+        }
+    } else {
+        for (uint8_t i = 0; i < GPU_COLORS_PER_PALETTE; i++) {
+            colors[i] = m_dmg.at((regs.palette >> (i * 2)) & 0x03).second;
+        }
+    }
 
-    return true;
+    // Once the window starts on a line it covers the rest of it, so the line
+    // is the background up to that point and the window after it.
+    uint8_t split = uint8_t(PIXELS_PER_ROW);
+    if (isWindowEnabled() && (regs.line >= regs.winY)) {
+        int start = int(regs.winX) - WINDOW_ROW_OFFSET;
+        split = uint8_t(std::clamp(start, 0, int(PIXELS_PER_ROW)));
+    }
+
+    drawMap<CGB>(background, set, regs.y + regs.line, regs.x, 0, split, colors);
+    drawMap<CGB>(
+        window,
+        set,
+        regs.line - regs.winY,
+        split + WINDOW_ROW_OFFSET - regs.winX,
+        split,
+        uint8_t(PIXELS_PER_ROW),
+        colors);
 }
 
-void GPU::drawBackground(TileSetIndex set, TileMapIndex background, TileMapIndex window)
+template <bool CGB>
+void GPU::drawMap(
+    TileMapIndex map,
+    TileSetIndex set,
+    uint16_t row,
+    uint16_t column,
+    uint8_t first,
+    uint8_t last,
+    const MapColors & colors)
 {
-    if (!isBackgroundEnabled()) { return; }
+    if (first >= last) { return; }
+
+    // Make sure that the pixels walk back around to the other side of the map
+    // if they go off of the edge.
+    row    %= TILE_MAP_PIXELS;
+    column %= TILE_MAP_PIXELS;
+
+    // Bring every tile that this run of pixels goes through up to date before
+    // we go and copy anything out of the image.
+    uint16_t yOffset = row / TILE_PIXELS_PER_COL;
+    uint16_t xOffset = column / TILE_PIXELS_PER_ROW;
+
+    uint16_t count = ((column % TILE_PIXELS_PER_ROW) + (last - first) + TILE_PIXELS_PER_ROW - 1)
+        / TILE_PIXELS_PER_ROW;
+    for (uint16_t i = 0; i < count; i++) {
+        updateMapTile<CGB>(map, set, (xOffset + i) % TILE_MAP_COLUMNS, yOffset);
+    }
 
-    struct Cache { uint16_t x; TileRow rgb; const ColorPalette *p; };
-    Cache winCache = { .x = 0xFFFF, .rgb = {}, .p = nullptr };
-    Cache bgCache  = { .x = 0xFFFF, .rgb = {}, .p = nullptr };
+    const uint8_t *pixels = m_maps[map][set].pixels.data() + (row * TILE_MAP_PIXELS);
 
-    uint16_t offset = m_scanline * PIXELS_PER_ROW;
+    uint16_t offset = m_render.regs.line * PIXELS_PER_ROW;
+    for (uint8_t pixel = first; pixel < last; pixel++) {
+        uint8_t index = pixels[(column + (pixel - first)) % TILE_MAP_PIXELS];
 
-    for (uint8_t pixel = 0; pixel < PIXELS_PER_ROW; pixel++) {
-        bool win = isWindowSelected(pixel, m_scanline);
+        m_buffer[offset + pixel] = colors[index];
 
-        // Figure out the row and column that we're actually talking about and
-        // make sure that if the pixels walk off the edge of our background map
-        // that we wrap back around.
-        uint16_t col = win ? (pixel - m_winX + WINDOW_ROW_OFFSET) : (m_x + pixel);
-        uint16_t row = win ? (m_scanline - m_winY) : (m_y + m_scanline);
+        // We are also going to keep track of what the background color is for each
+        // pixel so that we can use this data later on for when we are rendering the
+        // sprites.  See the sprite render function for its usage.
+        m_bg[offset + pixel] = colors[index & ~0x03];
+    }
+}
 
-        col %= (TILE_MAP_ROWS * TILE_PIXELS_PER_ROW);
-        row %= (TILE_MAP_ROWS * TILE_PIXELS_PER_ROW);
+template <bool CGB>
+void GPU::updateMapTile(TileMapIndex map, TileSetIndex set, uint16_t x, uint16_t y)
+{
+    uint16_t offset  = (TILEMAP_0 == map) ? TILE_MAP_0_OFFSET : TILE_MAP_1_OFFSET;
+    uint16_t pointer = offset + ((y * TILE_MAP_COLUMNS) + x) - m_offset;
 
-        // Figure out the coordinates of the tile that we need to look up in
-        // order to draw the pixels that we are after, which may or may not be
-        // the whole row from this tile.
-        uint16_t xOffset = col / TILE_PIXELS_PER_ROW;
-        uint16_t yOffset = row / TILE_PIXELS_PER_COL;
+    // The tile numbers live in bank 0 and the attributes live in bank 1, but
+    // the attributes (and VRAM banking) only exist on the CGB.
+    uint8_t number     = vram(BANK_0, pointer);
+    uint8_t attributes = (CGB) ? vram(BANK_1, pointer) : 0;
 
-        auto & cache = (win) ? winCache : bgCache;
+    MemoryBank bank = (attributes & BG_TILE_BANK) ? BANK_1 : BANK_0;
 
-        // First we need to see if we've previously looked up this tile.  If not,
-        // we need to look this tile up and stick it in our cache.
-        if (cache.x != xOffset) {
-            cache.x = xOffset;
+    uint32_t generation = m_generation.tiles[bank][tileIndex(set, number)];
 
-            const auto & [atts, tile] =
-                lookup(((win) ? window : background), set, xOffset, yOffset);
+    MapImage & image = m_maps[map][set];
+    MapEntry & entry = image.entries[(y * TILE_MAP_COLUMNS) + x];
+    if (entry.valid && (entry.tile == number) && (entry.attributes == attributes)
+        && (entry.generation == generation)) {
+        return;
+    }
 
-            // Lookup the RGB palette data if we're in CGB mode, otherwise just use
-            // the global DMG palette.
-            uint8_t index = atts & BG_PALETTE_NUMBER;
-            const ColorPalette & rgb =
-                (m_mmc.isCGB()) ? m_palettes.bg.at(index) : DMG_PALETTE;
+    entry = { true, number, attributes, generation };
 
-            cache.p = &rgb;
+    const Tile & tile = getTile(bank, set, number);
 
-            // Now that we have the tile that we are interested in, we need to get
-            // the RGB values that are associated with the row in the tile that we
-            // need to add to our screen buffer.
-            optional<uint8_t> palette =
-                (m_mmc.isCGB()) ? std::nullopt : optional<uint8_t>(m_palette);
+    bool flipX = attributes & BG_FLIP_X;
+    bool flipY = attributes & BG_FLIP_Y;
 
-            bool flipX = (m_mmc.isCGB()) ? atts & BG_FLIP_X : false;
-            bool flipY = (m_mmc.isCGB()) ? atts & BG_FLIP_Y : false;
+    uint8_t palette = uint8_t((attributes & BG_PALETTE_NUMBER) * GPU_COLORS_PER_PALETTE);
 
-            row %= TILE_PIXELS_PER_COL;
-            if (flipY) { row = TILE_PIXELS_PER_COL - row - 1; }
+    for (uint8_t i = 0; i < TILE_PIXELS_PER_COL; i++) {
+        uint8_t row = (flipY) ? (TILE_PIXELS_PER_COL - i - 1) : i;
 
-            toRGB(cache.rgb, rgb, palette, tile, row, true, flipX);
-        }
+        uint8_t lower = *tile.at(row * 2);
+        uint8_t upper = *tile.at((row * 2) + 1);
 
-        // We are also going to keep track of what the background color is for each
-        // pixel so that we can use this data later on for when we are rendering the
-        // sprites.  See the sprite render function for its usage.
-        uint8_t bgIdx = (m_mmc.isCGB()) ? 0 : m_palette & 0x3;
-        m_bg[offset + pixel] = (*cache.p)[bgIdx].second;
+        uint8_t *pixels = image.pixels.data()
+            + (((y * TILE_PIXELS_PER_COL) + i) * TILE_MAP_PIXELS) + (x * TILE_PIXELS_PER_ROW);
 
-        // Move the RGB values from the iterator in to our buffer.
-        m_buffer[offset + pixel] = cache.rgb[col % TILE_PIXELS_PER_ROW];
+        for (uint8_t j = 0; j < TILE_PIXELS_PER_ROW; j++) {
+            // The left most pixel starts at the most significant bit and its
+            // two bits are spread across the two bytes of the row.
+            uint8_t shift = (flipX) ? j : (7 - j);
+            pixels[j] = palette | (((upper >> shift) & 0x01) << 1) | ((lower >> shift) & 0x01);
+        }
     }
 }
 
+template <bool CGB>
 void GPU::draw(TileSetIndex set, TileMapIndex background, TileMapIndex window)
 {
     // Draw the 3 layers of the screen in order from lowest priority to highest
@@ -507,12 +1344,15 @@ void GPU::draw(TileSetIndex set, TileMapIndex background, TileMapIndex window)
     // routine itself.
 
     // Background -> Window -> Sprites
-    drawBackground(set, background, window);
-    drawSprites(m_buffer, m_bg);
+    drawBackground<CGB>(set, background, window);
+    drawSprites<CGB>(m_buffer, m_bg);
 }
 
+template <bool CGB>
 void GPU::readSprite(SpriteData & data)
 {
+    const LineRegisters & regs = m_render.regs;
+
     // If the sprite height is extended, then we need to mask out the lower bit and
     // take that as upper tile in the sprite.  The new masked tile number + 1 is the
     // address of the lower number.
@@ -524,7 +1364,7 @@ void GPU::readSprite(SpriteData & data)
     // Figure out which VRAM bank the sprite tile is sitting in.  If we aren't in
     // CGB mode, then we always need to use bank 0.
     MemoryBank bank = BANK_0;
-    if (m_mmc.isCGB()) {
+    if constexpr (CGB) {
         bank = (data.flags & TILE_BANK_CGB) ? BANK_1 : BANK_0;
     }
 
@@ -532,12 +1372,12 @@ void GPU::readSprite(SpriteData & data)
     bool flipY = data.flags & FLIP_Y;
 
     // Figure out which row we are trying to render.
-    uint8_t row = m_scanline - (data.y - SPRITE_Y_OFFSET);
+    uint8_t row = regs.line - (data.y - SPRITE_Y_OFFSET);
     if (data.y < SPRITE_Y_OFFSET) {
         // Special case for when the top of a sprite is off the screen.  If the sprite
         // isn't partially on screen, then we can bail here without actually looking
         // up the RGB values.
-        row = SPRITE_Y_OFFSET - data.y + m_scanline;
+        row = SPRITE_Y_OFFSET - data.y + regs.line;
         if (row >= data.height) { return; }
     }
 
@@ -550,10 +1390,11 @@ void GPU::readSprite(SpriteData & data)
 
     const Tile & tile = getTile(bank, TILESET_0, number);
 
-    auto colors = data.palette();
+    auto colors = data.palette<CGB>();
     toRGB(data.colors, colors.second, colors.first, tile, row, false, flipX);
 }
 
+template <bool CGB>
 void GPU::drawSprites(ColorArray & display, ColorArray & bg)
 {
     if (!areSpritesEnabled()) { return; }
@@ -564,7 +1405,7 @@ void GPU::drawSprites(ColorArray & display, ColorArray & bg)
     for (shared_ptr<SpriteData> & data : m_sprites) {
         if (!data) { continue; }
 
-        data->height = (m_control & SPRITE_SIZE) ? SPRITE_HEIGHT_EXTENDED : SPRITE_HEIGHT_NORMAL;
+        data->height = (m_render.regs.control & SPRITE_SIZE) ? SPRITE_HEIGHT_EXTENDED : SPRITE_HEIGHT_NORMAL;
         if (data->isVisible()) {
             enabled.emplace_back(data);
         }
@@ -580,13 +1421,13 @@ void GPU::drawSprites(ColorArray & display, ColorArray & bg)
     // Has higher priority).  If the x position matches, then the address is used to
     // determine the priority (same rule as CGB mode).
     std::sort(enabled.begin(), enabled.end(),
-            [this](const shared_ptr<SpriteData> & a, const shared_ptr<SpriteData> & b) {
-                return (this->m_mmc.isCGB() || (a->x == b->x))
+            [](const shared_ptr<SpriteData> & a, const shared_ptr<SpriteData> & b) {
+                return (CGB || (a->x == b->x))
                     ? (a->address < b->address) : (a->x < b->x);
         });
 
     for (const shared_ptr<SpriteData> & sprite : enabled) {
-        sprite->render(display, bg);
+        sprite->render<CGB>(display, bg);
     }
 }
 
@@ -616,27 +1457,31 @@ void GPU::writePalette(CgbColors & colors, uint8_t index, uint8_t value)
     assert(bytes.size() == 2);
 
     // Set the requested byte to the value that was passed in.
+    // The render thread has its own copy of the palettes, so it bumps the
+    // generation itself once it picks up the change.
+    if (bytes[index & 0x01] != value) {
+        if (isThreaded()) {
+            m_pipeline.palettes = true;
+        } else {
+            m_generation.palettes++;
+        }
+    }
     bytes[index & 0x01] = value;
 
-    // Define a lambda function to convert the mask to its RGB value.  The values
-    // stored in the mask are RGB555, so we need to normalize each value to 1,
-    // and then apply that normalized number to an 8 bit RGB value to get the
-    // value that we are going to store in our RGB8888 structure.
-    auto convert = [](uint8_t value) -> uint8_t {
-        double normalized = double(value) / double(0x1F);
-        return uint8_t(0xFF * normalized);
-    };
+    // The two bytes make up an RGB555 color, which the color table already
+    // has the RGB8888 translation for.
+    rgb = (*m_colors)[uint16_t((bytes[1] << 8) | bytes[0])];
+}
 
-    // Sticking the two bytes in to a 16 bit number makes the color extraction
-    // easier.
-    uint16_t bits = (bytes[1] << 8) | bytes[0];
+void GPU::writePalette(
+    CgbColors & colors, uint8_t palette, const GameBoyInterface::DmgPalette & shades)
+{
+    for (uint8_t i = 0; i < GPU_COLORS_PER_PALETTE; i++) {
+        uint8_t index = uint8_t(((palette * GPU_COLORS_PER_PALETTE) + i) * 2);
 
-    // Extract each color and convert it to RGB8888.
-    // RGB555 format (D = don't care): DBBBBBGGGGGRRRRR
-    rgb.red   = convert(bits & 0x1F);
-    rgb.green = convert((bits >> 5) & 0x1F);
-    rgb.blue  = convert((bits >> 10) & 0x1F);
-    rgb.alpha = 0xFF;
+        writePalette(colors, index, uint8_t(shades.at(i) & 0xFF));
+        writePalette(colors, index + 1, uint8_t(shades.at(i) >> 8));
+    }
 }
 
 uint8_t & GPU::readBgPalette(uint8_t index)
@@ -683,16 +1528,17 @@ GPU::SpriteData::SpriteData(
 
 }
 
+template <bool CGB>
 pair<optional<uint8_t>, const ColorPalette&> GPU::SpriteData::palette() const
 {
-    if (m_gpu.m_mmc.isCGB()) {
+    if constexpr (CGB) {
         uint8_t index = this->flags & PALETTE_NUMBER_CGB;
-        assert(index < m_gpu.m_palettes.sprite.size());
+        assert(index < m_gpu.m_render.palettes->sprite.size());
 
-        return { std::nullopt, m_gpu.m_palettes.sprite.at(index) };
+        return { std::nullopt, m_gpu.m_render.palettes->sprite.at(index) };
     } else {
         uint8_t palette = ((this->flags & PALETTE_NUMBER_DMG) ? *mono.at(1) : *mono.at(0));
-        return { palette, DMG_PALETTE };
+        return { palette, m_gpu.m_dmg };
     }
 }
 
@@ -708,7 +1554,7 @@ bool GPU::SpriteData::isVisible() const
     // We need to figure out if the sprite y <= row < sprite y + height.  The y coordinate
     // of each sprite is offset, so we need to offset our scanline by that same number in
     // order to figure out what row we are rendering relative to the sprite data.
-    uint8_t row = m_gpu.m_scanline + SPRITE_Y_OFFSET;
+    uint8_t row = m_gpu.m_render.regs.line + SPRITE_Y_OFFSET;
     if ((row >= this->y) && (row < (this->y + this->height))) {
         return true;
     }
@@ -716,9 +1562,10 @@ bool GPU::SpriteData::isVisible() const
     return false;
 }
 
+template <bool CGB>
 void GPU::SpriteData::render(ColorArray & display, ColorArray & bg)
 {
-    m_gpu.readSprite(*this);
+    m_gpu.readSprite<CGB>(*this);
 
     for (size_t i = 0; i < this->colors.size(); i++) {
         // Look at the alpha blend and make sure that this sprite pixel isn't supposed to be
@@ -732,7 +1579,7 @@ void GPU::SpriteData::render(ColorArray & display, ColorArray & bg)
         if (x >= PIXELS_PER_ROW) { continue; }
 
         // Grab the actual index in to the display buffer.
-        uint16_t index = (m_gpu.m_scanline * PIXELS_PER_ROW) + x;
+        uint16_t index = (m_gpu.m_render.regs.line * PIXELS_PER_ROW) + x;
         assert(index < display.size());
 
         // Check the sprite's priority.  If the sprite priority bit is set, the pixels are
@@ -14,13 +14,20 @@
 #include <memory>
 #include <unordered_map>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <optional>
 #include <cassert>
 
 #include "interrupt.h"
 #include "memmap.h"
 #include "memoryregion.h"
 #include "gbrgb.h"
+#include "gameboyinterface.h"
+#include "colortable.h"
 
 #define GPU_SPRITE_COUNT 40
 #define GPU_TILES_PER_SET 256
@@ -28,6 +35,9 @@
 #define GPU_COLORS_PER_PALETTE 4
 #define GPU_CGB_PALETTE_COUNT 8
 #define GPU_BANK_COUNT 2
+#define GPU_TILES_PER_BANK 384
+#define GPU_TILE_MAP_COUNT 2
+#define GPU_TILE_MAP_ROWS 32
 
 class MemoryController;
 
@@ -42,30 +52,101 @@ using CgbColors    = std::array<ColorPalette, GPU_CGB_PALETTE_COUNT>;
 class GPU : public MemoryRegion {
 public:
     explicit GPU(MemoryController & memory);
-    ~GPU() = default;
+    ~GPU();
 
     void cycle(uint8_t ticks);
     void reset() override;
 
-    inline uint8_t scanline() const { return m_scanline; }
+    // Along with VRAM, a state has the timing and the CGB palettes.  The
+    // frame that's in progress doesn't get saved, so it's skipped instead of
+    // being shown half drawn after a load.
+    void saveState(StateWriter & state) const override;
+    bool loadState(StateReader & state) override;
 
-    inline ColorArray && getColorMap()
+    inline uint8_t scanline() const { return m_line; }
+
+    uint8_t & readScanline();
+    uint8_t & readStatus();
+
+    inline ColorArray getColorMap()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return std::move(m_screen);
+    }
+
+    inline ColorArray getColorMap(GameBoyInterface::FrameInfo & frame)
     {
         std::lock_guard<std::mutex> guard(m_lock);
+        frame = m_frame;
         return std::move(m_screen);
     }
 
+    inline GameBoyInterface::FrameInfo frameInfo()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return m_frame;
+    }
+
+    void setFrameSkip(GameBoyInterface::FrameSkipMode mode, uint8_t ratio);
+    inline void setDeterministic(bool enable) { m_skip.deterministic = enable; }
+    void setThreadedRendering(bool enable);
+    void setModel(bool cgb);
+    void setHeadless(bool enable);
+
+    void setColorCorrection(GameBoyInterface::ColorCorrection curve);
+    void setDmgPalette(const GameBoyInterface::DmgPalette & palette);
+
+    inline void requestFrame() { m_headless.requested.store(true, std::memory_order_release); }
+
+    inline uint64_t frames() const
+        { return m_stats.frames.load(std::memory_order_relaxed); }
+
+    // Set when the GPU goes in to the vblank, and cleared when whoever is
+    // running the CPU notices it.
+    inline bool vblank()
+    {
+        bool entered = m_vblank;
+        m_vblank = false;
+        return entered;
+    }
+
+    inline uint64_t linesDrawn() const
+        { return m_stats.drawn.load(std::memory_order_relaxed); }
+    inline uint64_t linesReused() const
+        { return m_stats.reused.load(std::memory_order_relaxed); }
+
     void write(uint16_t address, uint8_t value) override;
     uint8_t & read(uint16_t address) override;
 
+    // Leaves VRAM and the CGB palettes the way that the BIOS leaves them when
+    // it hands the console over to the cartridge.  The title is whether or
+    // not the cartridge is a CGB game.
+    void boot(bool cgb, bool title);
+
     void writeBgPalette(uint8_t index, uint8_t value);
     void writeSpritePalette(uint8_t index, uint8_t value);
 
     uint8_t & readBgPalette(uint8_t index);
     uint8_t & readSpritePalette(uint8_t index);
 
+    // Turning the display back on starts the frame over from the top, and a
+    // new LYC gets compared against the line that we're on right away.
+    void writeControl(uint8_t value);
+    void writeCompare(uint8_t value);
+
 private:
-    static const ColorPalette DMG_PALETTE;
+    static const GameBoyInterface::DmgPalette DMG_PALETTE;
+
+    static const GameBoyInterface::DmgPalette BOOT_PALETTE;
+    static const GameBoyInterface::DmgPalette COMPAT_BG_PALETTE;
+    static const GameBoyInterface::DmgPalette COMPAT_SPRITE_PALETTE;
+
+    static const uint16_t LOGO_ADDRESS;
+    static const uint16_t LOGO_LENGTH;
+    static const uint16_t LOGO_TILES;
+    static const uint16_t LOGO_MAP;
+    static const uint8_t LOGO_MAP_COLUMNS;
+    static const std::array<uint8_t, 8> LOGO_TRADEMARK;
 
     static const uint8_t BANK_COUNT;
 
@@ -84,6 +165,8 @@ private:
     static const uint16_t TILE_MAP_0_OFFSET;
     static const uint16_t TILE_MAP_1_OFFSET;
 
+    static const uint16_t TILE_MAP_PIXELS;
+
     static const uint16_t BG_ATTRIBUTES_TABLE;
 
     static const uint16_t SPRITE_ATTRIBUTES_TABLE;
@@ -101,7 +184,6 @@ private:
     static const uint16_t OAM_TICKS;
     static const uint16_t VRAM_TICKS;
     static const uint16_t HBLANK_TICKS;
-    static const uint16_t VBLANK_TICKS;
 
     static const uint16_t SCANLINE_MAX;
     static const uint16_t SCANLINE_TICKS;
@@ -113,8 +195,14 @@ private:
 
     static const uint8_t WINDOW_ROW_OFFSET;
 
+    static const size_t PIPELINE_DEPTH;
+
     using TileRow = std::array<GB::RGB, TILE_PIXELS_PER_ROW>;
 
+    // The pixels in the map images are the 2 bit color with the CGB palette
+    // number above it, so this has a color for every value that they can be.
+    using MapColors = std::array<GB::RGB, GPU_CGB_PALETTE_COUNT * GPU_COLORS_PER_PALETTE>;
+
     struct SpriteData {
         GPU & m_gpu;
 
@@ -142,13 +230,54 @@ private:
 
         std::string toString() const;
         bool isVisible() const;
-        void render(ColorArray & display, ColorArray & bg);
+        template <bool CGB> void render(ColorArray & display, ColorArray & bg);
 
-        std::pair<std::optional<uint8_t>, const ColorPalette&> palette() const;
+        template <bool CGB> std::pair<std::optional<uint8_t>, const ColorPalette&> palette() const;
     };
 
     enum MemoryBank { BANK_0 = 0, BANK_1 = 1 };
 
+    struct Palettes {
+        CgbColors bg;
+        CgbColors sprite;
+    };
+
+    // All of the registers that the renderer needs in order to draw a line.
+    // These get captured when the line finishes its pixel transfer, so the
+    // renderer never has to look at the live registers.
+    struct LineRegisters {
+        uint8_t line;
+        uint8_t control;
+        uint8_t x;
+        uint8_t y;
+        uint8_t winX;
+        uint8_t winY;
+        uint8_t palette;
+        uint8_t obp1;
+        uint8_t obp2;
+    };
+
+    enum RenderCommand { DRAW_LINE, SKIP_LINE, PRESENT_FRAME };
+
+    // When rendering happens on its own thread, the CPU thread hands over one
+    // of these for each line.  Along with the registers, it carries whatever
+    // VRAM, OAM and palette data changed since the previous line so that the
+    // render thread can bring its own copy of that memory up to date.
+    struct Scanline {
+        struct Patch {
+            MemoryBank bank;
+            uint16_t index;
+            std::vector<uint8_t> bytes;
+        };
+
+        RenderCommand command;
+        LineRegisters regs;
+
+        std::vector<Patch> vram;
+        std::optional<std::array<uint8_t, GRAPHICS_RAM_SIZE>> oam;
+        std::optional<Palettes> palettes;
+    };
+
     enum TileMapIndex { TILEMAP_0 = 0, TILEMAP_1 = 1, };
     enum TileSetIndex { TILESET_0 = 0, TILESET_1 = 1, };
 
@@ -165,10 +294,10 @@ private:
         DISPLAY_ENABLE    = 0x80,
     };
 
-    inline bool isBackgroundEnabled() const { return (m_control & BACKGROUND_ENABLE); }
-    inline bool areSpritesEnabled()   const { return (m_control & SPRITE_ENABLE);     }
-    inline bool isWindowEnabled()     const { return (m_control & WINDOW_ENABLE);     }
-    inline bool isDisplayEnabled()    const { return (m_control & DISPLAY_ENABLE);    }
+    inline bool isBackgroundEnabled() const { return (m_render.regs.control & BACKGROUND_ENABLE); }
+    inline bool areSpritesEnabled()   const { return (m_render.regs.control & SPRITE_ENABLE);     }
+    inline bool isWindowEnabled()     const { return (m_render.regs.control & WINDOW_ENABLE);     }
+    inline bool isDisplayEnabled()    const { return (m_control & DISPLAY_ENABLE);                }
 
     enum StatusBitMask {
         RENDER_MODE           = 0x03,
@@ -210,35 +339,161 @@ private:
     uint8_t & m_control;
     uint8_t & m_status;
     uint8_t & m_palette;
+    uint8_t & m_obp1;
+    uint8_t & m_obp2;
     uint8_t & m_x;
     uint8_t & m_y;
     uint8_t & m_winX;
     uint8_t & m_winY;
     uint8_t & m_scanline;
+    uint8_t & m_lyc;
 
     RenderState m_state;
 
-    uint32_t m_ticks;
-    uint16_t m_vscan;
+    // The line that the GPU is working on.  LY itself is only brought up to
+    // date when the CPU reads it (see readScanline).
+    uint8_t m_line;
+
+    bool m_vblank;
+
+    // All of the timing is kept as absolute timestamps in ticks since the last
+    // reset.  The deadline is when the next mode transition happens and the
+    // frame timestamp is when line 0 of the current frame started.
+    struct {
+        uint64_t cycles;
+        uint64_t deadline;
+        uint64_t frame;
+    } m_clock;
 
     std::mutex m_lock;
 
     ColorArray m_screen;
+    GameBoyInterface::FrameInfo m_frame;
     ColorArray m_buffer;
     ColorArray m_bg;
 
     std::array<TileBank, GPU_BANK_COUNT> m_tiles;
     std::array<std::shared_ptr<SpriteData>, GPU_SPRITE_COUNT> m_sprites;
 
+    Palettes m_palettes;
+
+    const ColorTable *m_colors;
+
+    // The scanline renderer is specialized on the hardware model, and the
+    // cartridge picks the one that gets used when it's loaded.
+    void (GPU::*m_renderLine)();
+
+    GameBoyInterface::DmgPalette m_dmgColors;
+    ColorPalette m_dmg;
+
+    // The memory that the renderer pulls from.  When rendering inline, this
+    // points straight at VRAM, OAM and the palettes.  When rendering on the
+    // render thread, it points at the shadow copies that the render thread
+    // keeps up to date from the scanline snapshots.
     struct {
-        CgbColors bg;
-        CgbColors sprite;
-    } m_palettes;
+        std::vector<std::vector<uint8_t>> *vram;
+        const uint8_t *oam;
+        const Palettes *palettes;
+
+        LineRegisters regs;
+    } m_render;
+
+    struct {
+        std::vector<std::vector<uint8_t>> vram;
+        std::array<uint8_t, GRAPHICS_RAM_SIZE> oam;
+        Palettes palettes;
+    } m_shadow;
+
+    struct {
+        std::thread thread;
+        std::mutex lock;
+        std::condition_variable cv;
+        std::deque<Scanline> queue;
+
+        bool running;
+        bool busy;
+
+        // Everything below is only touched by the CPU thread.  The dirty
+        // ranges are [first, last) in to each VRAM bank and the OAM copy is
+        // what the render thread was last told OAM looks like.
+        std::array<std::pair<uint16_t, uint16_t>, GPU_BANK_COUNT> dirty;
+        std::array<uint8_t, GRAPHICS_RAM_SIZE> oam;
+        bool palettes;
+    } m_pipeline;
+
+    struct {
+        GameBoyInterface::FrameSkipMode mode;
+        uint8_t ratio;
+        uint8_t count;
+        bool active;
+
+        // Automatic skipping goes by when the host grabs the frames, so a
+        // deterministic console draws all of them instead.
+        bool deterministic;
+    } m_skip;
+
+    // Every write to VRAM bumps the generation of the tile or the tile map row
+    // that it landed in (palette writes bump their own counter).  These feed
+    // the per scanline signatures that let us reuse lines that haven't changed
+    // since the last time they were drawn.
+    struct {
+        std::array<std::array<uint32_t, GPU_TILES_PER_BANK>, GPU_BANK_COUNT> tiles;
+        std::array<std::array<uint32_t, GPU_TILE_MAP_ROWS>, GPU_TILE_MAP_COUNT> maps;
+        uint32_t palettes;
+    } m_generation;
+
+    struct {
+        std::vector<uint64_t> signatures;
+        std::vector<bool> valid;
+
+        ColorArray pixels;
+    } m_lines;
+
+    // Both of the tile maps are kept drawn out as a full 256x256 image for
+    // each tile set, so drawing the background is just copying out a row.
+    // Every tile remembers what it was drawn from, which lets us redraw only
+    // the tiles whose map entry, attributes or pixels have changed since.
+    struct MapEntry {
+        bool valid;
+        uint8_t tile;
+        uint8_t attributes;
+        uint32_t generation;
+    };
+
+    struct MapImage {
+        std::vector<uint8_t> pixels;
+        std::array<MapEntry, GPU_TILE_MAP_ROWS * GPU_TILE_MAP_ROWS> entries;
+    };
+
+    std::array<std::array<MapImage, GPU_TILE_SET_COUNT>, GPU_TILE_MAP_COUNT> m_maps;
 
-    void draw(TileSetIndex set, TileMapIndex background, TileMapIndex window);
+    // Headless instances skip every frame unless one gets asked for, and
+    // they give back all of the memory that the frame buffers were using.
+    struct {
+        bool enabled;
+        std::atomic<bool> requested;
+    } m_headless;
 
-    std::pair<const uint8_t&, const Tile&>
-        lookup(TileMapIndex mIndex, TileSetIndex sIndex, uint16_t x, uint16_t y);
+    struct {
+        std::atomic<uint64_t> drawn;
+        std::atomic<uint64_t> reused;
+        std::atomic<uint64_t> frames;
+    } m_stats;
+
+    template <bool CGB> void draw(TileSetIndex set, TileMapIndex background, TileMapIndex window);
+
+    template <bool CGB>
+        void drawMap(
+            TileMapIndex map,
+            TileSetIndex set,
+            uint16_t row,
+            uint16_t column,
+            uint8_t first,
+            uint8_t last,
+            const MapColors & colors);
+    template <bool CGB>
+        void updateMapTile(TileMapIndex map, TileSetIndex set, uint16_t x, uint16_t y);
+    void invalidateMaps();
 
     void toRGB(
         TileRow & colors,
@@ -249,12 +504,40 @@ private:
         bool white,
         bool flip) const;
 
-    void handleHBlank();
-    void handleVBlank(uint8_t ticks);
-    void handleOAM();
-    void handleVRAM();
+    uint16_t transition();
+
+    uint16_t enterHBlank();
+    uint16_t enterVBlank();
+    uint16_t enterOAM();
+    uint16_t enterVRAM();
+
+    uint16_t nextVBlankLine();
+
+    void compare();
+
+    uint8_t currentLine() const;
+    RenderState currentMode() const;
+
+    inline bool isThreaded() const { return m_pipeline.thread.joinable(); }
+
+    LineRegisters capture() const;
+
+    void submit(RenderCommand command);
+    void execute(Scanline & scanline);
+    void render();
+    void flush();
+    void present();
+
+    void markDirty(MemoryBank bank, uint16_t index);
+    void clearDirty();
 
-    RenderState next();
+    void bindRenderMemory(bool shadow);
+
+    void allocate();
+    void release();
+
+    inline const uint8_t & vram(MemoryBank bank, uint16_t index) const
+        { return (*m_render.vram)[int(bank)][index]; }
 
     void write(MemoryBank bank, uint16_t index, uint8_t value);
     uint8_t & read(MemoryBank bank, uint16_t index);
@@ -270,20 +553,40 @@ private:
     inline void updateRenderStateStatus(RenderState state)
         { m_status = ((m_status & 0xFC) | uint8_t(state)); }
 
-    void updateScreen();
+    template <bool CGB> void updateScreen();
+
+    template <bool CGB> uint64_t signature(TileSetIndex set, TileMapIndex background, TileMapIndex window);
 
-    bool isWindowSelected(uint8_t x, uint8_t y);
+    void touch(MemoryBank bank, uint16_t index, uint8_t value);
 
-    void drawSprites(ColorArray & display, ColorArray & bg);
-    void drawBackground(TileSetIndex set, TileMapIndex background, TileMapIndex window);
+    inline uint16_t tileIndex(TileSetIndex set, uint8_t tile) const
+        { return (TILESET_0 == set) ? tile : uint16_t(TILES_PER_SET + int8_t(tile)); }
 
-    void readSprite(SpriteData & data);
+    static inline uint64_t mix(uint64_t hash, uint64_t value)
+    {
+        hash = (hash ^ value) * 0x100000001B3ULL;
+        return hash ^ (hash >> 29);
+    }
+
+    void startFrame();
+    bool isFrameSkipped();
+
+    template <bool CGB> void drawSprites(ColorArray & display, ColorArray & bg);
+    template <bool CGB>
+        void drawBackground(TileSetIndex set, TileMapIndex background, TileMapIndex window);
+
+    template <bool CGB> void readSprite(SpriteData & data);
 
     void writePalette(CgbColors & colors, uint8_t index, uint8_t value);
+    void writePalette(CgbColors & colors, uint8_t palette,
+                      const GameBoyInterface::DmgPalette & shades);
+    void updateColors();
     uint8_t & readPalette(CgbColors & colors, uint8_t index);
 
     void initSpriteCache();
     void initTileCache();
+
+    void drawLogo();
 };
 
 #endif /* SRC_GPU_H_ */
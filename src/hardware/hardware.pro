@@ -26,6 +26,9 @@ INCLUDEPATH += serial
 TARGET = hardware
 
 PUBLIC_HEADERS += gameboyinterface.h
+PUBLIC_HEADERS += scheduler.h
+PUBLIC_HEADERS += vecenv.h
+PUBLIC_HEADERS += movie.h
 
 HEADERS += memory/memoryregion.h
 HEADERS += memory/mappedio.h
@@ -45,6 +48,7 @@ SOURCES += memory/removable.cpp
 HEADERS += processor.h
 HEADERS += memorycontroller.h
 HEADERS += gpu.h
+HEADERS += colortable.h
 HEADERS += timermodule.h
 HEADERS += gameboy.h
 HEADERS += joypad.h
@@ -54,9 +58,13 @@ HEADERS += cartridge.h
 HEADERS += consolelink.h
 HEADERS += pipelink.h
 HEADERS += socketlink.h
+HEADERS += mpscqueue.h
+HEADERS += savestate.h
+HEADERS += disassembler.h
 HEADERS += $$PUBLIC_HEADERS
 
 SOURCES += gpu.cpp
+SOURCES += colortable.cpp
 SOURCES += memorycontroller.cpp
 SOURCES += processor.cpp
 SOURCES += opcodes.cpp
@@ -66,6 +74,10 @@ SOURCES += joypad.cpp
 SOURCES += cartridge.cpp
 SOURCES += consolelink.cpp
 SOURCES += gameboyinterface.cpp
+SOURCES += scheduler.cpp
+SOURCES += vecenv.cpp
+SOURCES += disassembler.cpp
+SOURCES += movie.cpp
 
 unix: {
     HEADERS += serial/pipelink_linux.h
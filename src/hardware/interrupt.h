@@ -9,8 +9,13 @@
 #define INTERRUPT_H_
 
 #include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #include "memmap.h"
-#include "memorycontroller.h"
+#include "savestate.h"
 
 enum class InterruptVector : uint16_t {
     VBLANK = 0x40,
@@ -32,41 +37,151 @@ enum class InterruptMask : uint8_t {
     NONE = 0x00,
 };
 
-struct Interrupts {
-    Interrupts(uint8_t & m, uint8_t & s)
-        : enable(true), mask(m), status(s) { }
-    ~Interrupts() = default;
+// Owns IF, IE and IME.  Everything that changes any of them goes through
+// here, so whether or not the CPU has anything to do about interrupts is
+// worked out when they change instead of on every instruction.
+class InterruptController final {
+public:
+    InterruptController(uint8_t & mask, uint8_t & status)
+        : m_mask(mask), m_status(status) { reset(); }
+    ~InterruptController() = default;
+
+    InterruptController(const InterruptController &) = delete;
+    InterruptController & operator=(const InterruptController &) = delete;
+
+    inline void reset()
+    {
+        m_mask = m_status = 0x00;
+
+        m_enabled  = true;
+        m_enabling = false;
+
+        update();
+    }
+
+    // This is the only thing that the CPU looks at before an instruction,
+    // unless something is actually going on.
+    inline bool isPending() const { return m_pending; }
+    inline bool isEnabled() const { return m_enabled; }
+
+    inline uint8_t mask() const { return m_mask; }
+    inline uint8_t status() const { return m_status; }
+
+    inline void raise(InterruptMask interrupt)
+    {
+        m_status |= uint8_t(interrupt);
+        update();
+    }
+
+    inline void writeMask(uint8_t value)
+    {
+        m_mask = value;
+        update();
+    }
+
+    inline void writeStatus(uint8_t value)
+    {
+        m_status = (m_status & ~ACTIVE_MASK) | (value & ACTIVE_MASK);
+        update();
+    }
+
+    // EI doesn't turn interrupts on until the instruction after it is done,
+    // while DI and RETI both take effect right away.
+    inline void enable()
+    {
+        m_enabling = true;
+        update();
+    }
+
+    inline void disable()
+    {
+        m_enabled = m_enabling = false;
+        update();
+    }
+
+    inline void restore()
+    {
+        m_enabled  = true;
+        m_enabling = false;
+        update();
+    }
 
-    bool enable;
+    // Finishes an EI the next time around, which tells the CPU to hold off on
+    // servicing anything for one more instruction.
+    inline bool settle()
+    {
+        if (!m_enabling) { return false; }
 
-    uint8_t & mask;
-    uint8_t & status;
+        m_enabled  = true;
+        m_enabling = false;
+        update();
 
-    inline void reset() { enable = true; mask = status = 0x00; }
+        return true;
+    }
 
-    static void set(MemoryController & memory, InterruptMask interrupt)
+    // The lowest bit that is set has the highest priority.
+    inline InterruptVector next() const
     {
-        uint8_t & current = memory.read(INTERRUPT_FLAGS_ADDRESS);
-        current |= uint8_t(interrupt);
+        uint8_t active = m_mask & m_status & ACTIVE_MASK;
+        if (!active) { return InterruptVector::INVALID; }
+
+        return InterruptVector(uint16_t(InterruptVector::VBLANK) + (VECTOR_SPACING * lowest(active)));
     }
 
-    static void clear(MemoryController & memory, InterruptMask interrupt)
+    // Jumping to an ISR turns interrupts off and clears the one that it's for.
+    inline void acknowledge(InterruptVector vector)
     {
-        uint8_t & current = memory.read(INTERRUPT_FLAGS_ADDRESS);
-        current &= ~uint8_t(interrupt);
+        uint16_t bit = (uint16_t(vector) - uint16_t(InterruptVector::VBLANK)) / VECTOR_SPACING;
+
+        m_status &= ~uint8_t(1 << bit);
+        m_enabled = false;
+
+        update();
     }
 
-    static InterruptMask toMask(InterruptVector vector)
+    // IF and IE live in memory, so anything that puts memory back without
+    // going through us (e.g. a save state) has to let us know.
+    inline void refresh() { update(); }
+
+    // IF and IE are saved along with the rest of memory.
+    void saveState(StateWriter & state) const
+    {
+        state.put(m_enabled);
+        state.put(m_enabling);
+    }
+
+    bool loadState(StateReader & state)
+    {
+        bool loaded = state.get(m_enabled) && state.get(m_enabling);
+
+        update();
+        return loaded;
+    }
+
+private:
+    static constexpr uint8_t ACTIVE_MASK    = 0x1F;
+    static constexpr uint8_t VECTOR_SPACING = 0x08;
+
+    uint8_t & m_mask;
+    uint8_t & m_status;
+
+    bool m_enabled;
+    bool m_enabling;
+
+    bool m_pending;
+
+    inline void update()
+        { m_pending = m_enabling || (m_mask & m_status & ACTIVE_MASK); }
+
+    static inline uint8_t lowest(uint8_t value)
     {
-        switch (vector) {
-        case InterruptVector::VBLANK: return InterruptMask::VBLANK;
-        case InterruptVector::LCD:    return InterruptMask::LCD;
-        case InterruptVector::TIMER:  return InterruptMask::TIMER;
-        case InterruptVector::SERIAL: return InterruptMask::SERIAL;
-        case InterruptVector::JOYPAD: return InterruptMask::JOYPAD;
-
-        default: return InterruptMask::NONE;
-        }
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward(&index, value);
+        return uint8_t(index);
+#else
+        return uint8_t(__builtin_ctz(value));
+#endif
     }
 };
 
@@ -1,62 +1,133 @@
-#include <map>
-#include <mutex>
-#include <unordered_map>
+#include <cstdint>
+#include <algorithm>
 
 #include "joypad.h"
 #include "memorycontroller.h"
 #include "memmap.h"
+#include "interrupt.h"
 
-using std::unordered_map;
+JoyPad::JoyPad(MemoryController & memory)
+    : m_memory(memory),
+      m_register(memory.ioRegister(JOYPAD_INPUT_ADDRESS)),
+      m_due(UINT64_MAX),
+      m_listener(nullptr)
+{
+    m_shadow[0] = m_shadow[1] = BUTTONS_IDLE;
+}
 
-const unordered_map<JoyPad::ShadowSelect, int> JoyPad::SHADOW_MAP = {
-    { SHADOW_DIRS,    0 },
-    { SHADOW_BUTTONS, 1 },
-};
+void JoyPad::push(GameBoyInterface::JoyPadButton button, bool pressed, uint64_t delay)
+{
+    Event event;
+    event.ticks   = delay;
+    event.button  = button;
+    event.pressed = pressed;
 
-const unordered_map<GameBoyInterface::JoyPadButton, JoyPad::ShadowSelect> JoyPad::BUTTON_MAP = {
-    { GameBoyInterface::JOYPAD_A,      SHADOW_BUTTONS },
-    { GameBoyInterface::JOYPAD_B,      SHADOW_BUTTONS },
-    { GameBoyInterface::JOYPAD_SELECT, SHADOW_BUTTONS },
-    { GameBoyInterface::JOYPAD_START,  SHADOW_BUTTONS },
-    { GameBoyInterface::JOYPAD_RIGHT,  SHADOW_DIRS    },
-    { GameBoyInterface::JOYPAD_LEFT,   SHADOW_DIRS    },
-    { GameBoyInterface::JOYPAD_UP,     SHADOW_DIRS    },
-    { GameBoyInterface::JOYPAD_DOWN,   SHADOW_DIRS    },
-};
+    m_queue.push(event);
+}
 
-JoyPad::JoyPad(MemoryController & memory)
-    : m_register(memory.read(JOYPAD_INPUT_ADDRESS))
+void JoyPad::deliver(uint64_t ticks)
 {
-    m_shadow[0] = m_shadow[1] = BUTTONS_IDLE;
+    // The delay turns in to a time once we know when the event got picked
+    // up.  Anything that lands at the same time as something that was already
+    // waiting goes in after it.
+    Event event;
+    while (m_queue.pop(event)) {
+        event.ticks += ticks;
+
+        auto position = std::upper_bound(m_pending.begin(), m_pending.end(), event.ticks,
+            [](uint64_t value, const Event & entry) { return value < entry.ticks; });
+        m_pending.insert(position, event);
+    }
+
+    auto landed = m_pending.begin();
+    for (; (landed != m_pending.end()) && (landed->ticks <= ticks); ++landed) {
+        apply(landed->button, landed->pressed);
+    }
+    m_pending.erase(m_pending.begin(), landed);
+
+    m_due = (m_pending.empty()) ? UINT64_MAX : m_pending.front().ticks;
 }
 
-void JoyPad::cycle(uint8_t)
+void JoyPad::apply(GameBoyInterface::JoyPadButton button, bool pressed)
 {
-    uint8_t state = BUTTONS_IDLE;
+    uint8_t previous = lines();
 
-    if (!(m_register & SHADOW_DIRS)) {
-        state =
-            m_shadow[SHADOW_MAP.at(SHADOW_DIRS)].load(std::memory_order_acquire);
-    } else if (!(m_register & SHADOW_BUTTONS)) {
-        state =
-            m_shadow[SHADOW_MAP.at(SHADOW_BUTTONS)].load(std::memory_order_acquire);
+    // The directions are the low nibble of the button and the rest are the
+    // high nibble.
+    int index = (button & 0x0F) ? 0 : 1;
+    uint8_t bit = uint8_t(button >> (4 * index));
+
+    if (pressed) {
+        m_shadow[index] &= ~bit;
+    } else {
+        m_shadow[index] |= bit;
     }
 
-    m_register = (m_register & 0xF0) | state;
+    if (m_listener) { m_listener(button, pressed); }
+
+    interrupt(previous);
+}
+
+uint8_t & JoyPad::read()
+{
+    m_register = (m_register & 0xF0) | lines();
+    return m_register;
+}
+
+void JoyPad::write(uint8_t value)
+{
+    // Selecting a row with a button that is already held down pulls a line
+    // low just like pressing it does.
+    uint8_t previous = lines();
+
+    m_register = (m_register & ~SELECT_MASK) | (value & SELECT_MASK);
+    m_register = (m_register & 0xF0) | lines();
+
+    interrupt(previous);
+}
+
+uint8_t JoyPad::lines() const
+{
+    // Both rows can be selected at once, in which case a line is low if a
+    // button on either row is held down.
+    uint8_t state = BUTTONS_IDLE;
+    if (!(m_register & SHADOW_DIRS))    { state &= m_shadow[0]; }
+    if (!(m_register & SHADOW_BUTTONS)) { state &= m_shadow[1]; }
+
+    return state;
 }
 
-void JoyPad::clr(GameBoyInterface::JoyPadButton button)
+void JoyPad::interrupt(uint8_t previous)
 {
-    ShadowSelect select = BUTTON_MAP.at(button);
+    // Only a line going from high to low raises the interrupt.
+    if (previous & ~lines() & BUTTONS_IDLE) {
+        m_memory.interrupts().raise(InterruptMask::JOYPAD);
+    }
+}
 
-    int index = SHADOW_MAP.at(select);
-    m_shadow[index] |= (button >> (4 * index));
+void JoyPad::saveState(StateWriter & state) const
+{
+    for (uint8_t shadow : m_shadow) {
+        state.put(shadow);
+    }
 }
 
-void JoyPad::set(GameBoyInterface::JoyPadButton button)
+bool JoyPad::loadState(StateReader & state)
 {
-    ShadowSelect select = BUTTON_MAP.at(button);
+    // The buttons that were held down when the state was saved are part of
+    // the state, so whatever is being held down right now gets dropped (and
+    // so does anything that was on its way).
+    Event event;
+    while (m_queue.pop(event)) { }
+
+    m_pending.clear();
+    m_due = UINT64_MAX;
 
-    int index = SHADOW_MAP.at(select);
-    m_shadow[index].fetch_and(~button >> (4 * index), std::memory_order_release);
+    for (auto & shadow : m_shadow) {
+        uint8_t buttons = BUTTONS_IDLE;
+        if (!state.get(buttons)) { return false; }
+
+        shadow = buttons;
+    }
+    return true;
 }
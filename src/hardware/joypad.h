@@ -2,23 +2,45 @@
 #define _JOYPAD_H
 
 #include <cstdint>
+#include <cstddef>
 #include <array>
-#include <unordered_map>
-#include <atomic>
+#include <vector>
+#include <functional>
 
 #include "gameboyinterface.h"
+#include "savestate.h"
+#include "mpscqueue.h"
 
 class MemoryController;
 
+// The buttons get pushed from whatever thread is handling the input, but they
+// only ever change the console in between instructions on the thread that is
+// running it.  Each one says how many cycles from when it gets picked up that
+// it should land, so somebody driving the console can time their input down
+// to the instruction.  P1 only gets worked out when the CPU touches it.
 class JoyPad final {
 public:
+    using Listener = std::function<void(GameBoyInterface::JoyPadButton button, bool pressed)>;
+
     explicit JoyPad(MemoryController & memory);
     ~JoyPad() = default;
 
-    void cycle(uint8_t ticks);
+    // This is on the path of every instruction, so all that it does is check
+    // whether there's anything to deliver.
+    inline void update(uint64_t ticks)
+        { if ((ticks >= m_due) || !m_queue.empty()) { deliver(ticks); } }
+
+    void push(GameBoyInterface::JoyPadButton button, bool pressed, uint64_t delay = 0);
+
+    // Gets told about every button as it lands, on the thread that is running
+    // the console.
+    inline void setListener(Listener listener) { m_listener = std::move(listener); }
+
+    uint8_t & read();
+    void write(uint8_t value);
 
-    void set(GameBoyInterface::JoyPadButton button);
-    void clr(GameBoyInterface::JoyPadButton button);
+    void saveState(StateWriter & state) const;
+    bool loadState(StateReader & state);
 
 private:
     static constexpr uint8_t BUTTONS_IDLE = 0x0F;
@@ -28,12 +50,37 @@ private:
         SHADOW_BUTTONS = 0x20,
     };
 
-    static const std::unordered_map<ShadowSelect, int> SHADOW_MAP;
-    static const std::unordered_map<GameBoyInterface::JoyPadButton, ShadowSelect> BUTTON_MAP;
+    static constexpr uint8_t SELECT_MASK = SHADOW_DIRS | SHADOW_BUTTONS;
+
+    struct Event {
+        uint64_t ticks;
+
+        GameBoyInterface::JoyPadButton button;
+        bool pressed;
+    };
+
+    MemoryController & m_memory;
 
     uint8_t & m_register;
 
-    std::array<std::atomic<uint8_t>, 2> m_shadow;
+    // The directions are in the first one and the buttons are in the second,
+    // and a button that is held down is a 0.
+    std::array<uint8_t, 2> m_shadow;
+
+    MpscQueue<Event> m_queue;
+
+    // Everything that has been picked up off of the queue but hasn't landed
+    // yet, in the order that it lands.
+    std::vector<Event> m_pending;
+    uint64_t m_due;
+
+    Listener m_listener;
+
+    void deliver(uint64_t ticks);
+    void apply(GameBoyInterface::JoyPadButton button, bool pressed);
+
+    uint8_t lines() const;
+    void interrupt(uint8_t previous);
 };
 
 #endif
@@ -64,6 +64,10 @@
 #define SOUND_CONTROLLER_CH3_LEVEL    0xFF1C
 #define SOUND_CONTROLLER_CH3_FREQ_LO  0xFF1D
 #define SOUND_CONTROLLER_CH3_FREQ_HI  0xFF1E
+#define SOUND_CONTROLLER_CH4_LENGTH   0xFF20
+#define SOUND_CONTROLLER_CH4_ENVELOPE 0xFF21
+#define SOUND_CONTROLLER_CH4_POLY     0xFF22
+#define SOUND_CONTROLLER_CH4_COUNTER  0xFF23
 #define SOUND_CONTROLLER_CH3_ARB      0xFF30
 
 #define SOUND_CONTROLLER_ARB_BYTES 16
@@ -73,6 +77,7 @@
 #define GPU_SCROLLY_ADDRESS      0xFF42
 #define GPU_SCROLLX_ADDRESS      0xFF43
 #define GPU_SCANLINE_ADDRESS     0xFF44
+#define GPU_LYC_ADDRESS          0xFF45
 #define GPU_DMA_OAM              0xFF46
 #define GPU_PALETTE_ADDRESS      0xFF47
 #define GPU_OBP1_ADDRESS         0xFF48
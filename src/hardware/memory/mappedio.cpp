@@ -8,8 +8,7 @@ MappedIO::MappedIO(
     uint16_t size,
     uint16_t offset)
     : MemoryRegion(gameboy.mmc(), size, offset),
-      m_gameboy(gameboy),
-      m_rtcReset(false)
+      m_gameboy(gameboy)
 {
     MemoryRegion::write(JOYPAD_INPUT_ADDRESS, 0xFF);
 }
@@ -17,6 +16,13 @@ MappedIO::MappedIO(
 uint8_t & MappedIO::read(uint16_t address)
 {
     switch (address) {
+    case GPU_STATUS_ADDRESS:   return m_gameboy.gpu().readStatus();
+    case GPU_SCANLINE_ADDRESS: return m_gameboy.gpu().readScanline();
+    case JOYPAD_INPUT_ADDRESS: return m_gameboy.joypad().read();
+
+    case CPU_TIMER_DIV_ADDRESS:     return m_gameboy.cpu().timer().readDivider();
+    case CPU_TIMER_COUNTER_ADDRESS: return m_gameboy.cpu().timer().readCounter();
+
     case GPU_BG_PALETTE_DATA: {
         uint8_t pointer = m_parent.read(GPU_BG_PALETTE_INDEX) & 0x3F;
 
@@ -40,13 +46,20 @@ void MappedIO::write(uint16_t address, uint8_t value)
 
     switch (address) {
     case GPU_STATUS_ADDRESS:        writeBytes(address, value, 0x78); break;
-    case JOYPAD_INPUT_ADDRESS:      writeBytes(address, value, 0x30); break;
-    case INTERRUPT_MASK_ADDRESS:    writeBytes(address, value, 0x1F); break;
-    case INTERRUPT_FLAGS_ADDRESS:   writeBytes(address, value, 0x1F); break;
-    case CPU_TIMER_CONTROL_ADDRESS: writeBytes(address, value, 0x07); break;
-
-    case CPU_TIMER_DIV_ADDRESS: {
-        m_rtcReset = true;
+    case GPU_CONTROL_ADDRESS:       m_gameboy.gpu().writeControl(value); break;
+    case GPU_LYC_ADDRESS:           m_gameboy.gpu().writeCompare(value); break;
+    case JOYPAD_INPUT_ADDRESS:      m_gameboy.joypad().write(value);  break;
+    case INTERRUPT_FLAGS_ADDRESS:   m_parent.interrupts().writeStatus(value); break;
+
+    case CPU_TIMER_DIV_ADDRESS:     m_gameboy.cpu().timer().writeDivider();       break;
+    case CPU_TIMER_COUNTER_ADDRESS: m_gameboy.cpu().timer().writeCounter(value);  break;
+    case CPU_TIMER_MODULO_ADDRESS:  m_gameboy.cpu().timer().writeModulo(value);   break;
+    case CPU_TIMER_CONTROL_ADDRESS: m_gameboy.cpu().timer().writeControl(value);  break;
+
+    // Only the switch request can be written, and only on a CGB.  The current
+    // speed belongs to the CPU, which flips it when it runs a STOP.
+    case CGB_SPEED_SWITCH_ADDRESS: {
+        if (m_parent.isCGB()) { writeBytes(address, value, 0x01); }
         break;
     }
 
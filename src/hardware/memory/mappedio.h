@@ -26,14 +26,8 @@ public:
 
     inline uint8_t resetValue() const override { return 0xFF; }
 
-    inline bool isRtcResetRequested() const { return m_rtcReset; }
-
-    inline void clearRtcReset() { m_rtcReset = false; }
-
 private:
     GameBoy & m_gameboy;
-
-    bool m_rtcReset;
 };
 
 #endif
@@ -63,6 +63,21 @@ void MemoryRegion::reset()
     }
 }
 
+void MemoryRegion::saveState(StateWriter & state) const
+{
+    for (const auto & bank : m_memory) {
+        state.put(bank);
+    }
+}
+
+bool MemoryRegion::loadState(StateReader & state)
+{
+    for (auto & bank : m_memory) {
+        if (!state.get(bank)) { return false; }
+    }
+    return true;
+}
+
 void MemoryRegion::write(uint16_t address, uint8_t value)
 {
     assert(!m_memory.empty());
@@ -4,6 +4,8 @@
 #include <vector>
 #include <cstdint>
 
+#include "savestate.h"
+
 class MemoryController;
 
 class MemoryRegion {
@@ -44,6 +46,11 @@ public:
 
     void resize(uint16_t size);
 
+    // Every region saves the memory that it holds on to, and the ones that
+    // keep more state than that tack it on to the end.
+    virtual void saveState(StateWriter & state) const;
+    virtual bool loadState(StateReader & state);
+
     inline std::vector<std::vector<uint8_t>> & memory() { return m_memory; }
 
     uint8_t & operator[](uint32_t index);
@@ -1,5 +1,6 @@
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "removable.h"
 #include "cartridge.h"
@@ -9,9 +10,22 @@ using std::string;
 
 uint8_t Removable::EMPTY = 0xFF;
 
-void Removable::load(const string & filename)
+const std::vector<Cartridge::RamBank> Removable::NO_RAM;
+const std::vector<uint8_t> Removable::NO_ROM;
+
+void Removable::load(const string & filename, EmuMode mode, const Cartridge::RealTimeClock & clock)
+{
+    m_cartridge = std::make_unique<Cartridge>(filename, mode, clock);
+}
+
+const std::vector<Cartridge::RamBank> & Removable::ram() const
 {
-    m_cartridge = std::make_unique<Cartridge>(filename);
+    return (m_cartridge) ? m_cartridge->ram() : NO_RAM;
+}
+
+const std::vector<uint8_t> & Removable::rom() const
+{
+    return (m_cartridge) ? m_cartridge->rom() : NO_ROM;
 }
 
 bool Removable::isValid() const
@@ -19,6 +33,24 @@ bool Removable::isValid() const
     return (m_cartridge) ? m_cartridge->isValid() : false;
 }
 
+void Removable::saveState(StateWriter & state) const
+{
+    state.put(bool(m_cartridge));
+    if (m_cartridge) { m_cartridge->saveState(state); }
+}
+
+bool Removable::loadState(StateReader & state)
+{
+    bool loaded = false;
+    if (!state.get(loaded)) { return false; }
+
+    // There is no getting a cartridge back out of a save state, so it has
+    // to be the same one that was in there when the state was saved.
+    if (loaded != bool(m_cartridge)) { return state.fail(); }
+
+    return (m_cartridge) ? m_cartridge->loadState(state) : true;
+}
+
 void Removable::write(uint16_t address, uint8_t value)
 {
     if (m_cartridge && m_cartridge->isValid()) {
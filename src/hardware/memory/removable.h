@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "memoryregion.h"
 #include "cartridge.h"
@@ -23,21 +24,33 @@ public:
 
     bool isAddressed(uint16_t address) const override;
 
-    void load(const std::string & filename);
+    void load(const std::string & filename, EmuMode mode, const Cartridge::RealTimeClock & clock);
     bool isValid() const;
 
     inline void reset() override { }
 
+    // The cartridge keeps its banking and RAM on its own, so that's what a
+    // save state gets instead of our (empty) memory.
+    void saveState(StateWriter & state) const override;
+    bool loadState(StateReader & state) override;
+
     inline bool isCGB() const
         { return (m_cartridge) ? m_cartridge->isCGB() : false; }
+    inline bool supportsCGB() const
+        { return (m_cartridge) ? m_cartridge->supportsCGB() : false; }
 
     inline uint8_t romBank() const
         { return (m_cartridge) ? m_cartridge->romBank() : 0; }
     inline uint8_t ramBank() const
         { return (m_cartridge) ? m_cartridge->ramBank() : 0; }
 
+    const std::vector<Cartridge::RamBank> & ram() const;
+    const std::vector<uint8_t> & rom() const;
+
 private:
     static uint8_t EMPTY;
+    static const std::vector<Cartridge::RamBank> NO_RAM;
+    static const std::vector<uint8_t> NO_ROM;
 
     std::unique_ptr<Cartridge> m_cartridge;
 };
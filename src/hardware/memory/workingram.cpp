@@ -10,13 +10,20 @@ const uint8_t WorkingRam::BANK_COUNT = 8;
 const uint16_t WorkingRam::BANK_SELECT_ADDRESS = 0xFF70;
 
 WorkingRam::WorkingRam(MemoryController & parent, uint16_t size, uint16_t offset)
-    : MemoryRegion(parent, size / 2, offset, BANK_COUNT - 1)
+    : MemoryRegion(parent, size / 2, offset, BANK_COUNT - 1),
+      m_bank(&WorkingRam::bank<false>)
 {
 }
 
+void WorkingRam::setModel(bool cgb)
+{
+    m_bank = (cgb) ? &WorkingRam::bank<true> : &WorkingRam::bank<false>;
+}
+
+template <bool CGB>
 vector<uint8_t> & WorkingRam::bank(uint16_t index)
 {
-    if (!m_parent.isCGB()) { return m_memory[index / m_size]; }
+    if constexpr (!CGB) { return m_memory[index / m_size]; }
 
     uint8_t selected =
         (index < m_size) ? 0 : std::max(0x01, int(m_parent.peek(BANK_SELECT_ADDRESS)));
@@ -34,7 +41,7 @@ void WorkingRam::write(uint16_t address, uint8_t value)
     uint16_t index = address - m_offset;
     assert(index < (m_size * 2));
 
-    bank(index)[index % m_size] = value;
+    (this->*m_bank)(index)[index % m_size] = value;
 }
 
 uint8_t & WorkingRam::read(uint16_t address)
@@ -46,7 +53,7 @@ uint8_t & WorkingRam::read(uint16_t address)
     uint16_t index = address - m_offset;
     assert(index < (m_size * 2));
 
-    return bank(index)[index % m_size];
+    return (this->*m_bank)(index)[index % m_size];
 }
 
 bool WorkingRam::isAddressed(uint16_t address) const
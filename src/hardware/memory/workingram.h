@@ -18,13 +18,19 @@ public:
 
     bool isAddressed(uint16_t address) const override;
 
+    void setModel(bool cgb);
+
 private:
     static const uint8_t BANK_COUNT;
     static const uint16_t BANK_SELECT_ADDRESS;
 
     bool isShadowAddressed(uint16_t address) const;
 
-    std::vector<uint8_t> & bank(uint16_t index);
+    // Bank lookups happen on every access, so the model check is done once
+    // when the cartridge is loaded instead of on every read and write.
+    std::vector<uint8_t> & (WorkingRam::*m_bank)(uint16_t index);
+
+    template <bool CGB> std::vector<uint8_t> & bank(uint16_t index);
 };
 
 #endif
@@ -32,6 +32,50 @@ uint8_t MemoryController::DUMMY = 0xFF;
 
 const uint16_t MemoryController::MBC_TYPE_ADDRESS = 0x0147;
 
+const uint8_t MemoryController::DMG_WORKING_RAM_BANKS = 2;
+const uint8_t MemoryController::DMG_VIDEO_RAM_BANKS   = 1;
+
+// The bits that aren't used read back as 1s.
+const uint8_t MemoryController::CGB_SPEED_SWITCH_IDLE = 0x7E;
+
+// The CGB BIOS leaves the serial port on the internal clock.
+const uint8_t MemoryController::DMG_SERIAL_CONTROL_BOOT = 0x7E;
+const uint8_t MemoryController::CGB_SERIAL_CONTROL_BOOT = 0x7F;
+
+// Where the BIOS leaves the registers that nothing else keeps track of.  The
+// GPU, the timer, the joypad and the interrupts all set up their own.
+const vector<std::pair<uint16_t, uint8_t>> MemoryController::BOOT_REGISTERS = {
+    { SERIAL_DATA_ADDRESS,           0x00 },
+    { SOUND_CONTROLLER_CH1_SWEEP,    0x80 },
+    { SOUND_CONTROLLER_CH1_PATTERN,  0xBF },
+    { SOUND_CONTROLLER_CH1_ENVELOPE, 0xF3 },
+    { SOUND_CONTROLLER_CH1_FREQ_LO,  0xFF },
+    { SOUND_CONTROLLER_CH1_FREQ_HI,  0xBF },
+    { SOUND_CONTROLLER_CH2_PATTERN,  0x3F },
+    { SOUND_CONTROLLER_CH2_ENVELOPE, 0x00 },
+    { SOUND_CONTROLLER_CH2_FREQ_LO,  0xFF },
+    { SOUND_CONTROLLER_CH2_FREQ_HI,  0xBF },
+    { SOUND_CONTROLLER_CH3_ENABLE,   0x7F },
+    { SOUND_CONTROLLER_CH3_LENGTH,   0xFF },
+    { SOUND_CONTROLLER_CH3_LEVEL,    0x9F },
+    { SOUND_CONTROLLER_CH3_FREQ_LO,  0xFF },
+    { SOUND_CONTROLLER_CH3_FREQ_HI,  0xBF },
+    { SOUND_CONTROLLER_CH4_LENGTH,   0xFF },
+    { SOUND_CONTROLLER_CH4_ENVELOPE, 0x00 },
+    { SOUND_CONTROLLER_CH4_POLY,     0x00 },
+    { SOUND_CONTROLLER_CH4_COUNTER,  0xBF },
+    { SOUND_CONTROLLER_CHANNEL,      0x77 },
+    { SOUND_CONTROLLER_OUTPUT,       0xF3 },
+    { SOUND_CONTROLLER_ENABLE,       0xF1 },
+    { GPU_SCROLLY_ADDRESS,           0x00 },
+    { GPU_SCROLLX_ADDRESS,           0x00 },
+    { GPU_LYC_ADDRESS,               0x00 },
+    { GPU_DMA_OAM,                   0xFF },
+    { GPU_PALETTE_ADDRESS,           0xFC },
+    { GPU_WINDOW_Y_ADDRESS,          0x00 },
+    { GPU_WINDOW_X_ADDRESS,          0x00 },
+};
+
 MemoryController::MemoryController(GameBoy & parent)
     : m_bios(*this, 0, BIOS_OFFSET),
       m_cartridge(*this),
@@ -40,6 +84,8 @@ MemoryController::MemoryController(GameBoy & parent)
       m_io(parent, IO_SIZE, IO_OFFSET),
       m_zero(*this, ZRAM_SIZE, ZRAM_OFFSET),
       m_unusable(*this, UNUSABLE_MEM_SIZE, UNUSABLE_MEM_OFFSET),
+      m_interrupts(m_zero.MemoryRegion::read(INTERRUPT_MASK_ADDRESS),
+                   m_io.MemoryRegion::read(INTERRUPT_FLAGS_ADDRESS)),
       m_parent(parent)
 {
     init();
@@ -59,23 +105,63 @@ void MemoryController::reset()
     for (auto & region : m_memory) {
         region.get().reset();
     }
+    m_interrupts.refresh();
 }
 
 void MemoryController::setCartridge(const string & filename)
 {
     reset();
 
-    m_cartridge.load(filename);
+    const ConfigSnapshot & config = m_parent.config();
+
+    // A deterministic console's cartridge clock only ever sees emulated time.
+    Cartridge::RealTimeClock clock = { nullptr, 0 };
+    if (config.getBool(ConfigKey::DETERMINISTIC)) {
+        clock.ticks = [this]() { return m_parent.ticks(); };
+        clock.start = uint32_t(config.getInt(ConfigKey::RTC_START));
+    }
+
+    m_cartridge.load(filename, config.getEnum<EmuMode>(ConfigKey::EMU_MODE), clock);
 
     // We just changed the cartridge, so we are going to change the BIOS to
     // match whether or not the cartridge we just loaded is a CGB game or
-    // not
-    const auto & image = (m_cartridge.isCGB()) ? CGB_BIOS_REGION : DMG_BIOS_REGION;
+    // not.  There's no point when it's going to be skipped.
+    if (!config.getBool(ConfigKey::FAST_BOOT)) {
+        const auto & image = (m_cartridge.isCGB()) ? CGB_BIOS_REGION : DMG_BIOS_REGION;
+
+        // We are going to rewrite the BIOS memory, which has no banking, so
+        // we always need to grab the first entry in the memory vector.
+        m_bios.resize(uint16_t(image.size()));
+        std::copy(image.begin(), image.end(), m_bios.memory()[0].begin());
+    }
+
+    // The rendering and working RAM banking paths are compiled separately for
+    // each model, so pick the ones that match the cartridge.
+    m_parent.gpu().setModel(m_cartridge.isCGB());
+    m_working.setModel(m_cartridge.isCGB());
+
+    // Every CGB game starts out at normal speed without a switch pending, and
+    // the register doesn't exist at all on a DMG.
+    initialize(CGB_SPEED_SWITCH_ADDRESS, (m_cartridge.isCGB()) ? CGB_SPEED_SWITCH_IDLE : 0xFF);
+}
+
+void MemoryController::boot()
+{
+    unlockBiosRegion();
+
+    for (const auto & [address, value] : BOOT_REGISTERS) {
+        initialize(address, value);
+    }
+
+    bool cgb = m_cartridge.isCGB();
+    initialize(SERIAL_CONTROL_ADDRESS, (cgb) ? CGB_SERIAL_CONTROL_BOOT : DMG_SERIAL_CONTROL_BOOT);
 
-    // We are going to rewrite the BIOS memory, which has no banking, so we
-    // always need to grab the first entry in the memory vector.
-    m_bios.resize(uint16_t(image.size()));
-    std::copy(image.begin(), image.end(), m_bios.memory()[0].begin());
+    // Both of the rows of buttons are left selected, and the vblank that the
+    // BIOS was waiting on is still pending.
+    m_parent.joypad().write(0x00);
+    m_interrupts.writeStatus(uint8_t(InterruptMask::VBLANK));
+
+    m_parent.gpu().boot(cgb, m_cartridge.supportsCGB());
 }
 
 optional<reference_wrapper<MemoryRegion>> MemoryController::find(uint16_t address) const
@@ -99,10 +185,17 @@ void MemoryController::initialize(uint16_t address, uint8_t value)
     region.enableInit();
     region.write(address, value);
     region.disableInit();
+
+    m_interrupts.refresh();
 }
 
 void MemoryController::write(uint16_t address, uint8_t value)
 {
+    if (INTERRUPT_MASK_ADDRESS == address) {
+        m_interrupts.writeMask(value);
+        return;
+    }
+
     auto found = find(address);
     if (!found) {
         FATAL("Unhandled address 0x%04x\n", address);
@@ -152,3 +245,82 @@ void MemoryController::saveBIOS(const string & filename)
     out.write(reinterpret_cast<const char*>(bios.data()), bios.size());
     out.close();
 }
+
+vector<GameBoyInterface::MemorySpan> MemoryController::getMemory(GameBoyInterface::MemoryArea area)
+{
+    vector<GameBoyInterface::MemorySpan> spans;
+
+    // The regions always have every bank that a CGB has, but a DMG only
+    // ever uses the first few of them.
+    auto banks = [&](MemoryRegion & region, size_t dmg) {
+        auto & memory = region.memory();
+
+        size_t count = (isCGB()) ? memory.size() : std::min(dmg, memory.size());
+        for (size_t i = 0; i < count; i++) {
+            spans.push_back({ memory[i].data(), memory[i].size() });
+        }
+    };
+
+    switch (area) {
+    default:
+        assert(0);
+        [[fallthrough]];
+
+    case GameBoyInterface::MemoryArea::WRAM:
+        banks(m_working, DMG_WORKING_RAM_BANKS);
+        break;
+
+    case GameBoyInterface::MemoryArea::VRAM:
+        banks(m_parent.gpu(), DMG_VIDEO_RAM_BANKS);
+        break;
+
+    case GameBoyInterface::MemoryArea::OAM:
+        banks(m_oam, 1);
+        break;
+
+    // The last byte of the region is the interrupt mask.
+    case GameBoyInterface::MemoryArea::HRAM:
+        spans.push_back({ m_zero.memory()[0].data(), m_zero.memory()[0].size() - 1 });
+        break;
+
+    case GameBoyInterface::MemoryArea::CART_RAM:
+        for (const Cartridge::RamBank & bank : m_cartridge.ram()) {
+            spans.push_back({ bank.data(), bank.size() });
+        }
+        break;
+    }
+
+    return spans;
+}
+
+void MemoryController::saveState(StateWriter & state) const
+{
+    state.put(inBios());
+
+    const MemoryRegion *regions[] = { &m_cartridge, &m_working, &m_oam, &m_io, &m_zero };
+    for (const MemoryRegion *region : regions) {
+        region->saveState(state);
+    }
+}
+
+bool MemoryController::loadState(StateReader & state)
+{
+    bool bios = false;
+    if (!state.get(bios)) { return false; }
+
+    MemoryRegion *regions[] = { &m_cartridge, &m_working, &m_oam, &m_io, &m_zero };
+    for (MemoryRegion *region : regions) {
+        if (!region->loadState(state)) { return false; }
+    }
+
+    // The BIOS only ever gets unlocked going forward, so putting it back in
+    // means starting the memory map over.
+    if (bios) {
+        init();
+    } else {
+        unlockBiosRegion();
+    }
+
+    m_interrupts.refresh();
+    return true;
+}
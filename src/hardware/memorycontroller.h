@@ -17,7 +17,10 @@
 #include <memory>
 #include <functional>
 #include <optional>
+#include <utility>
 
+#include "gameboyinterface.h"
+#include "interrupt.h"
 #include "memoryregion.h"
 #include "mappedio.h"
 #include "readonly.h"
@@ -41,21 +44,40 @@ public:
     uint8_t & read(uint16_t address);
     const uint8_t & peek(uint16_t address);
 
+    // Hands back the backing storage of an IO register without going through
+    // any of the special handling that MappedIO does when the CPU reads it.
+    inline uint8_t & ioRegister(uint16_t address)
+        { return m_io.MemoryRegion::read(address); }
+
+    inline InterruptController & interrupts() { return m_interrupts; }
+
     void reset();
     void setCartridge(const std::string & filename);
 
+    // Gets rid of the BIOS and sets everything up the way that it would have
+    // been left for the cartridge (see ConfigKey::FAST_BOOT).
+    void boot();
+
     void saveBIOS(const std::string & filename);
 
-    inline bool isRtcResetRequested() const
-        { return m_io.isRtcResetRequested(); }
+    std::vector<GameBoyInterface::MemorySpan> getMemory(GameBoyInterface::MemoryArea area);
+
+    // VRAM belongs to the GPU, so it goes along with the rest of the GPU's
+    // state instead of ours.
+    void saveState(StateWriter & state) const;
+    bool loadState(StateReader & state);
 
-    inline void clearRtcReset()    { m_io.clearRtcReset(); }
     inline void unlockBiosRegion() { if (inBios()) { m_memory.pop_front(); } }
 
     inline bool inBios() const { return (&m_memory.front().get() == &m_bios); }
     inline bool isCartridgeValid() const { return m_cartridge.isValid(); }
 
     inline bool isCGB() const { return m_cartridge.isCGB(); }
+    inline bool supportsCGB() const { return m_cartridge.supportsCGB(); }
+
+    // The whole cartridge, which doesn't change until the next one gets
+    // loaded.
+    inline const std::vector<uint8_t> & rom() const { return m_cartridge.rom(); }
 
     inline uint8_t romBank() const { return m_cartridge.romBank(); }
     inline uint8_t ramBank() const { return m_cartridge.ramBank(); }
@@ -64,6 +86,16 @@ private:
     static uint8_t DUMMY;
     static const uint16_t MBC_TYPE_ADDRESS;
 
+    static const uint8_t DMG_WORKING_RAM_BANKS;
+    static const uint8_t DMG_VIDEO_RAM_BANKS;
+
+    static const uint8_t CGB_SPEED_SWITCH_IDLE;
+
+    static const uint8_t DMG_SERIAL_CONTROL_BOOT;
+    static const uint8_t CGB_SERIAL_CONTROL_BOOT;
+
+    static const std::vector<std::pair<uint16_t, uint8_t>> BOOT_REGISTERS;
+
     static const std::vector<uint8_t> DMG_BIOS_REGION;
     static const std::vector<uint8_t> CGB_BIOS_REGION;
 
@@ -78,6 +110,9 @@ private:
     MemoryRegion m_zero;
     Unusable m_unusable;
 
+    // IE is the last byte of high RAM, and IF is one of the IO registers.
+    InterruptController m_interrupts;
+
     struct {
         BankType type;
         bool ramEn;
@@ -0,0 +1,263 @@
+/*
+ * movie.cpp
+ *
+ * File layout:
+ *   The file starts off with the magic number and the version, followed by
+ *   one record after another.  Every record starts with its type and when it
+ *   happened, which is the number of frames since the last record and the
+ *   tick within the frame.  All of the numbers are LEB128 varints, so most
+ *   button presses only take up a handful of bytes.
+ *
+ *   - Event:      stamp, then the button's bit number (and 0x80 if pressed)
+ *   - Checkpoint: stamp, then the length of the save state and the state
+ *   - End:        stamp, which is how long the movie is
+ *
+ *   The first record is always a checkpoint at the very start.
+ *
+ * Playback:
+ *   The buttons are recorded in between instructions, so running the console
+ *   until it gets to the tick that a button landed on always stops it right
+ *   on the same instruction.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+#include "movie.h"
+#include "logging.h"
+
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+
+const uint32_t Movie::MAGIC   = 0x564D4247; // "GBMV"
+const uint8_t  Movie::VERSION = 1;
+
+// About a minute of emulated time.
+const uint32_t Movie::CHECKPOINT_FRAMES = 3600;
+
+bool Movie::load(const string & filename)
+{
+    m_events.clear();
+    m_checkpoints.clear();
+    m_length = 0;
+
+    ifstream input(filename, std::ios::in | std::ios::binary);
+    if (!input.is_open()) {
+        WARN("Failed to open movie: %s\n", filename.c_str());
+        return false;
+    }
+
+    vector<uint8_t> bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+    size_t offset = 0;
+    auto get = [&](uint64_t & value) {
+        value = 0;
+        for (uint8_t shift = 0; (offset < bytes.size()) && (shift < 64); shift += 7) {
+            uint8_t byte = bytes[offset++];
+
+            value |= uint64_t(byte & 0x7F) << shift;
+            if (0 == (byte & 0x80)) { return true; }
+        }
+        return false;
+    };
+
+    uint32_t magic = 0;
+    for (uint8_t i = 0; (i < sizeof(magic)) && (offset < bytes.size()); i++) {
+        magic |= uint32_t(bytes[offset++]) << (8 * i);
+    }
+
+    if ((MAGIC != magic) || (offset >= bytes.size()) || (VERSION != bytes[offset++])) {
+        WARN("Not a movie: %s\n", filename.c_str());
+        return false;
+    }
+
+    // Anything that doesn't make it all the way in to the file is the end of
+    // the movie.
+    uint64_t frame = 0;
+    while (offset < bytes.size()) {
+        uint8_t record = bytes[offset++];
+
+        uint64_t frames = 0;
+        uint64_t tick = 0;
+        if (!get(frames) || !get(tick)) { break; }
+
+        frame += frames;
+
+        uint64_t ticks = (frame * FRAME_TICKS) + tick;
+        if (RECORD_EVENT == record) {
+            if (offset >= bytes.size()) { break; }
+
+            uint8_t value = bytes[offset++];
+
+            Event event;
+            event.ticks   = ticks;
+            event.button  = GameBoyInterface::JoyPadButton(1 << (value & EVENT_BUTTON));
+            event.pressed = (0 != (value & EVENT_PRESSED));
+            m_events.push_back(event);
+        } else if (RECORD_CHECKPOINT == record) {
+            uint64_t length = 0;
+            if (!get(length) || (length > (bytes.size() - offset))) { break; }
+
+            Checkpoint checkpoint;
+            checkpoint.ticks = ticks;
+            checkpoint.event = m_events.size();
+            checkpoint.state.assign(bytes.begin() + offset, bytes.begin() + offset + length);
+            m_checkpoints.push_back(std::move(checkpoint));
+
+            offset += length;
+        } else if (RECORD_END != record) {
+            WARN("Unknown movie record: 0x%02x\n", record);
+            break;
+        }
+
+        m_length = std::max(m_length, ticks);
+    }
+
+    if (m_checkpoints.empty() || (0 != m_checkpoints.front().ticks)) {
+        WARN("Movie doesn't have a starting point: %s\n", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool Movie::Recorder::open(const string & filename, const GameBoyInterface::State & start)
+{
+    m_file = ofstream(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        WARN("Failed to open movie: %s\n", filename.c_str());
+        return false;
+    }
+
+    for (uint8_t i = 0; i < sizeof(MAGIC); i++) {
+        m_file.put(char((MAGIC >> (8 * i)) & 0xFF));
+    }
+    m_file.put(char(VERSION));
+
+    m_frame = 0;
+    checkpoint(0, start);
+
+    return bool(m_file);
+}
+
+void Movie::Recorder::close(uint64_t ticks)
+{
+    if (!m_file.is_open()) { return; }
+
+    stamp(RECORD_END, ticks);
+    m_file.close();
+}
+
+void Movie::Recorder::record(uint64_t ticks, GameBoyInterface::JoyPadButton button, bool pressed)
+{
+    uint8_t index = 0;
+    while ((index < EVENT_BUTTON) && (0 == (button & (1 << index)))) { index++; }
+
+    stamp(RECORD_EVENT, ticks);
+    m_file.put(char(index | ((pressed) ? EVENT_PRESSED : 0x00)));
+
+    // Whatever happens to us, the bug report still gets its input.
+    m_file.flush();
+}
+
+void Movie::Recorder::checkpoint(uint64_t ticks, const GameBoyInterface::State & state)
+{
+    stamp(RECORD_CHECKPOINT, ticks);
+
+    put(state.size());
+    m_file.write(reinterpret_cast<const char*>(state.data()), std::streamsize(state.size()));
+
+    m_file.flush();
+}
+
+void Movie::Recorder::stamp(uint8_t record, uint64_t ticks)
+{
+    uint64_t frame = ticks / FRAME_TICKS;
+
+    m_file.put(char(record));
+    put(frame - m_frame);
+    put(ticks % FRAME_TICKS);
+
+    m_frame = frame;
+}
+
+void Movie::Recorder::put(uint64_t value)
+{
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+
+        m_file.put(char(byte | ((0 != value) ? 0x80 : 0x00)));
+    } while (0 != value);
+}
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+bool MoviePlayer::open(const string & filename)
+{
+    if (!m_movie.load(filename)) { return false; }
+
+    return seek(0);
+}
+
+bool MoviePlayer::seek(uint64_t frame)
+{
+    uint64_t ticks = std::min(frame * Movie::FRAME_TICKS, m_movie.length());
+
+    // The first checkpoint is always at the very start, so there's always
+    // one to go back to.
+    const vector<Movie::Checkpoint> & checkpoints = m_movie.checkpoints();
+    auto checkpoint = std::upper_bound(checkpoints.begin(), checkpoints.end(), ticks,
+        [](uint64_t value, const Movie::Checkpoint & entry) { return value < entry.ticks; });
+    --checkpoint;
+
+    if (!m_console.loadState(checkpoint->state)) { return false; }
+
+    m_ticks = checkpoint->ticks;
+    m_next  = checkpoint->event;
+
+    advance(ticks);
+    return true;
+}
+
+uint64_t MoviePlayer::play(uint64_t frames)
+{
+    uint64_t start = m_ticks;
+    advance(std::min(m_ticks + (frames * Movie::FRAME_TICKS), m_movie.length()));
+
+    return m_ticks - start;
+}
+
+void MoviePlayer::advance(uint64_t ticks)
+{
+    const vector<Movie::Event> & events = m_movie.events();
+
+    while (m_ticks < ticks) {
+        // Everything that lands on this instruction goes in before it runs.
+        for (; (m_next < events.size()) && (events[m_next].ticks <= m_ticks); m_next++) {
+            const Movie::Event & event = events[m_next];
+            if (event.pressed) {
+                m_console.setButton(event.button);
+            } else {
+                m_console.clrButton(event.button);
+            }
+        }
+
+        uint64_t until = ticks;
+        if (m_next < events.size()) { until = std::min(until, events[m_next].ticks); }
+
+        uint64_t ran = m_console.runCycles(until - m_ticks);
+        if (0 == ran) {
+            WARN("%s\n", "Movie playback stalled (is the console running?)");
+            return;
+        }
+        m_ticks += ran;
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
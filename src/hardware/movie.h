@@ -0,0 +1,135 @@
+#ifndef MOVIE_H_
+#define MOVIE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "gameboyinterface.h"
+
+// A movie is every button that got pressed or released while a console was
+// being recorded, along with exactly when (in emulated time) that it landed.
+// Pressing the same buttons at the same times plays the game out exactly the
+// same way, as long as the console is deterministic.  The movie starts off
+// with a save state, and gets another one every so often so that playing it
+// back can skip ahead.  The save states only work with the build of the
+// emulator that made them, so the same goes for the movie.
+class Movie final {
+public:
+    // Ticks of the ~4MHz clock since the recording started.  They go in to
+    // the file as the frame and the tick within the frame.
+    struct Event {
+        uint64_t ticks;
+        GameBoyInterface::JoyPadButton button;
+        bool pressed;
+    };
+
+    // The index of the first event that comes after the save state, which
+    // isn't the same thing as the first event after its ticks when a button
+    // lands on the same tick as the state.
+    struct Checkpoint {
+        uint64_t ticks;
+        size_t event;
+
+        GameBoyInterface::State state;
+    };
+
+    static constexpr uint32_t FRAME_TICKS = 70224;
+
+    static const uint32_t CHECKPOINT_FRAMES;
+
+    Movie() : m_length(0) { }
+    ~Movie() = default;
+
+    // A movie that got cut short (e.g. the emulator crashed while it was
+    // being recorded) loads everything up to the last thing that made it in
+    // to the file.
+    bool load(const std::string & filename);
+
+    inline uint64_t length() const { return m_length; }
+    inline uint64_t frames() const { return m_length / FRAME_TICKS; }
+
+    inline const std::vector<Event> & events() const { return m_events; }
+    inline const std::vector<Checkpoint> & checkpoints() const { return m_checkpoints; }
+
+    // Writes the movie out as it's being recorded, so that nothing gets lost
+    // if we never make it to the end.
+    class Recorder final {
+    public:
+        Recorder() : m_frame(0) { }
+        ~Recorder() = default;
+
+        bool open(const std::string & filename, const GameBoyInterface::State & start);
+        void close(uint64_t ticks);
+
+        void record(uint64_t ticks, GameBoyInterface::JoyPadButton button, bool pressed);
+        void checkpoint(uint64_t ticks, const GameBoyInterface::State & state);
+
+    private:
+        std::ofstream m_file;
+
+        // Frames are written as the distance from the last record.
+        uint64_t m_frame;
+
+        void stamp(uint8_t record, uint64_t ticks);
+        void put(uint64_t value);
+    };
+
+private:
+    static const uint32_t MAGIC;
+    static const uint8_t VERSION;
+
+    enum Record : uint8_t {
+        RECORD_EVENT      = 0x01,
+        RECORD_CHECKPOINT = 0x02,
+        RECORD_END        = 0x03,
+    };
+
+    static constexpr uint8_t EVENT_PRESSED = 0x80;
+    static constexpr uint8_t EVENT_BUTTON  = 0x07;
+
+    std::vector<Event> m_events;
+    std::vector<Checkpoint> m_checkpoints;
+
+    uint64_t m_length;
+};
+
+// Plays a movie back in to a console as fast as the console can go.  The
+// console needs to have the movie's cartridge loaded and the same settings
+// that it was recorded with, and nothing else can be running it.
+class MoviePlayer final {
+public:
+    explicit MoviePlayer(GameBoyInterface & console)
+        : m_console(console), m_ticks(0), m_next(0) { }
+    ~MoviePlayer() = default;
+
+    // Loads the movie and puts the console at the start of it.
+    bool open(const std::string & filename);
+
+    // Jumps to the start of a frame by loading the last save state before
+    // it, and playing the rest of the way there.
+    bool seek(uint64_t frame);
+
+    // Plays up to the given number of frames, and hands back the number of
+    // ticks that actually ran (which is less at the end of the movie).
+    uint64_t play(uint64_t frames);
+
+    inline uint64_t frame() const { return m_ticks / Movie::FRAME_TICKS; }
+    inline bool isDone() const { return m_ticks >= m_movie.length(); }
+
+    inline const Movie & movie() const { return m_movie; }
+
+private:
+    GameBoyInterface & m_console;
+
+    Movie m_movie;
+
+    uint64_t m_ticks;
+    size_t m_next;
+
+    void advance(uint64_t ticks);
+};
+
+#endif /* MOVIE_H_ */
@@ -0,0 +1,74 @@
+#ifndef _MPSC_QUEUE_H
+#define _MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// An unbounded queue that any number of threads can push on to without
+// taking a lock, and that a single thread at a time pops off of.  Pushing
+// is one atomic exchange, so producers never wait on each other or on the
+// consumer.  The queue always keeps a dummy node at the front, which is what
+// keeps the producers and the consumer from ever touching the same node.
+template <typename T>
+class MpscQueue final {
+public:
+    MpscQueue() : m_head(new Node()), m_tail(m_head.load()) { }
+
+    ~MpscQueue()
+    {
+        T value;
+        while (pop(value)) { }
+
+        delete m_tail.load();
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue & operator=(const MpscQueue &) = delete;
+
+    void push(T value)
+    {
+        Node *node = new Node(std::move(value));
+
+        // Linking the node in is sequentially consistent so that a producer
+        // that checks on the consumer afterwards (e.g. is it still running?)
+        // can count on the consumer seeing the node if it's going to look.
+        Node *previous = m_head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node);
+    }
+
+    bool pop(T & value)
+    {
+        Node *tail = m_tail.load(std::memory_order_relaxed);
+        Node *next = tail->next.load();
+        if (!next) { return false; }
+
+        // The node that we just took the value out of becomes the new dummy.
+        value = std::move(next->value);
+        m_tail.store(next, std::memory_order_release);
+
+        delete tail;
+        return true;
+    }
+
+    // This is cheap enough to check on every instruction.  An item that is
+    // half way through being pushed might not show up yet, but it will be
+    // there the next time around.
+    inline bool empty() const
+    {
+        return !m_tail.load(std::memory_order_acquire)->next.load();
+    }
+
+private:
+    struct Node {
+        Node() : next(nullptr), value() { }
+        explicit Node(T && v) : next(nullptr), value(std::move(v)) { }
+
+        std::atomic<Node*> next;
+        T value;
+    };
+
+    std::atomic<Node*> m_head;
+    std::atomic<Node*> m_tail;
+};
+
+#endif
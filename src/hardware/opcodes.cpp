@@ -7,7 +7,7 @@
 Processor::Processor(ClockInterface & clock, MemoryController & memory)
     : m_clock(clock),
       m_memory(memory),
-      m_interrupts(m_memory.read(INTERRUPT_MASK_ADDRESS), m_memory.read(INTERRUPT_FLAGS_ADDRESS)),
+      m_interrupts(m_memory.interrupts()),
       m_halted(false),
       m_timer(memory),
       m_flags(m_gpr.f)
@@ -93,8 +93,8 @@ Processor::Processor(ClockInterface & clock, MemoryController & memory)
     OPCODES[0x2D] = { "DEC_l",    [this]() { dec(m_gpr.l);   }, 1, 1 };
     OPCODES[0x3B] = { "DEC_sp",   [this]() { dec(m_sp);      }, 1, 2 };
 
-    OPCODES[0xF3] = { "DI",   [this]() { m_interrupts.enable = false; }, 1, 1 };
-    OPCODES[0xFB] = { "EI",   [this]() { m_interrupts.enable = true;  }, 1, 1 };
+    OPCODES[0xF3] = { "DI",   [this]() { m_interrupts.disable(); }, 1, 1 };
+    OPCODES[0xFB] = { "EI",   [this]() { m_interrupts.enable();  }, 1, 1 };
     OPCODES[0x76] = { "HALT", [this]() { m_halted = true;             }, 1, 1 };
 
     OPCODES[0x34] = { "INC_(hl)", [this]() { incP(m_gpr.hl); }, 1, 0 };
@@ -29,6 +29,14 @@ const uint16_t Processor::ROM_ENTRY_POINT = 0x0100;
 
 const uint8_t Processor::CYCLES_PER_TICK = 4;
 
+// Machine cycles that the CPU sits stopped for while it changes speeds.
+const uint16_t Processor::SPEED_SWITCH_CYCLES = 2050;
+
+const uint16_t Processor::HEADER_CHECKSUM_ADDRESS = 0x014D;
+
+/** The timer has been running the whole time that the DMG BIOS was, so DIV reads 0xAB */
+const uint16_t Processor::DMG_BOOT_COUNTER = 0xABCC;
+
 void Processor::reset()
 {
     m_pc = 0x0000;
@@ -49,6 +57,69 @@ void Processor::reset()
     m_timer.reset();
 }
 
+void Processor::boot()
+{
+    assert(!m_memory.inBios());
+
+    m_pc = ROM_ENTRY_POINT;
+    m_sp = 0xFFFE;
+
+    if (!m_memory.isCGB()) {
+        // The flags are whatever the BIOS's last look at the header checksum
+        // left them as.
+        m_gpr.a = 0x01;
+        m_gpr.f = (m_memory.peek(HEADER_CHECKSUM_ADDRESS)) ? 0xB0 : 0x80;
+        m_gpr.bc = 0x0013;
+        m_gpr.de = 0x00D8;
+        m_gpr.hl = 0x014D;
+    } else if (m_memory.supportsCGB()) {
+        m_gpr.af = 0x1180;
+        m_gpr.bc = 0x0000;
+        m_gpr.de = 0xFF56;
+        m_gpr.hl = 0x000D;
+    } else {
+        m_gpr.af = 0x1180;
+        m_gpr.bc = 0x0000;
+        m_gpr.de = 0x0008;
+        m_gpr.hl = 0x007C;
+    }
+
+    // How long the CGB BIOS runs for depends on the game, so its DIV isn't
+    // documented as one value and the counter just starts over.
+    m_timer.reset((m_memory.isCGB()) ? 0x0000 : DMG_BOOT_COUNTER);
+
+    // Nothing in the BIOS ever turns the interrupts on.
+    m_interrupts.disable();
+}
+
+void Processor::saveState(StateWriter & state) const
+{
+    state.put(m_pc);
+    state.put(m_instr);
+    state.put(m_sp);
+    m_interrupts.saveState(state);
+    state.put(m_iCache);
+    state.put(m_halted);
+    state.put(m_operands);
+    state.put(m_gpr);
+
+    m_timer.saveState(state);
+}
+
+bool Processor::loadState(StateReader & state)
+{
+    bool loaded = state.get(m_pc)
+        && state.get(m_instr)
+        && state.get(m_sp)
+        && m_interrupts.loadState(state)
+        && state.get(m_iCache)
+        && state.get(m_halted)
+        && state.get(m_operands)
+        && state.get(m_gpr);
+
+    return loaded && m_timer.loadState(state);
+}
+
 void Processor::Command::print() const
 {
     TRACE("%s\n", str().c_str());
@@ -104,33 +175,10 @@ void Processor::history() const
     }
 }
 
-vector<Processor::Command> Processor::disassemble()
+const Processor::Operation *Processor::decode(uint8_t opcode, uint8_t next) const
 {
-    vector<Command> cmds;
-
-    uint16_t pc = 0x100;
-    while (pc < GPU_RAM_OFFSET) {
-        Command cmd;
-        cmd.pc     = pc;
-        cmd.opcode = m_memory.peek(pc++);
-
-        if (ILLEGAL_OPCODES.find(cmd.opcode) != ILLEGAL_OPCODES.end()) {
-            continue;
-        }
-
-        Operation *operation = lookup(pc, cmd.opcode);
-        if (!operation) { continue; }
-
-        cmd.operation = operation;
-
-        for (uint8_t i = 0; i < operation->length - 1; i++) {
-            cmd.operands[i] = m_memory.peek(pc++);
-        }
-
-        cmds.push_back(cmd);
-    }
-
-    return cmds;
+    const Operation & entry = (CB_PREFIX == opcode) ? CB_OPCODES[next] : OPCODES[opcode];
+    return (entry.name.empty()) ? nullptr : &entry;
 }
 
 Processor::Operation *Processor::lookup(uint16_t & pc, uint8_t opcode)
@@ -168,44 +216,31 @@ Processor::Operation *Processor::lookup(uint16_t & pc, uint8_t opcode)
 
 bool Processor::interrupt()
 {
-    if (!m_interrupts.enable && !m_halted) { return false; }
+    // Nothing is going on almost all of the time, which is one flag.
+    if (!m_interrupts.isPending()) { return false; }
 
-    InterruptVector vector = InterruptVector::INVALID;
+    // An EI that ran last time around takes effect now, but nothing gets
+    // serviced until after the next instruction.
+    if (m_interrupts.settle()) { return false; }
 
-    uint8_t status = m_interrupts.mask & m_interrupts.status;
+    InterruptVector vector = m_interrupts.next();
+    if (InterruptVector::INVALID == vector) { return false; }
 
-    // Check our interrupt status to see if any of the interrupt bits are
-    // set.  The if statements are in order of interrput priority.
-    if (status & uint8_t(InterruptMask::VBLANK)) {
-        vector = InterruptVector::VBLANK;
-    } else if (status & uint8_t(InterruptMask::LCD)) {
-        vector = InterruptVector::LCD;
-    } else if (status & uint8_t(InterruptMask::TIMER)) {
-        vector = InterruptVector::TIMER;
-    } else if (status & uint8_t(InterruptMask::SERIAL)) {
-        vector = InterruptVector::SERIAL;
-    } else if (status & uint8_t(InterruptMask::JOYPAD)) {
-        vector = InterruptVector::JOYPAD;
-    }
+    // An interrupt wakes us up from a halt even if interrupts are disabled,
+    // it just doesn't get serviced.
+    if (!m_interrupts.isEnabled()) { return m_halted; }
 
-    // If we found an interrupt that needs to be serviced, push the pc
-    // on to the stack and then set the pc to the address of the interrupt
-    // vector.
-    if (InterruptVector::INVALID != vector) {
-        if (m_interrupts.enable) {
-            push(m_pc);
+    // We found an interrupt that needs to be serviced, so push the pc on to
+    // the stack and then set the pc to the address of the interrupt vector.
+    push(m_pc);
 
-            m_pc = uint16_t(vector);
+    m_pc = uint16_t(vector);
 
-            // We are jumping to an ISR, so disable interrupts and clear the
-            // flag in the interrupt status register.
-            m_interrupts.status &= ~uint8_t(Interrupts::toMask(vector));
-            m_interrupts.enable = false;
-        }
-        return true;
-    }
+    // We are jumping to an ISR, so disable interrupts and clear the flag in
+    // the interrupt status register.
+    m_interrupts.acknowledge(vector);
 
-    return false;
+    return true;
 }
 
 void Processor::tick(uint8_t ticks)
@@ -280,8 +315,8 @@ void Processor::cycle()
 
     // Cache the interrupt state so that we can log it and use it for debugging
     // if necessary.
-    m_iCache.status = m_interrupts.status;
-    m_iCache.mask   = m_interrupts.mask;
+    m_iCache.status = m_interrupts.status();
+    m_iCache.mask   = m_interrupts.mask();
 
     execute(interrupt());
 }
@@ -297,14 +332,14 @@ void Processor::log(uint8_t opcode, const Operation *operation)
         m_sp,
         opcode,
         m_flags,
-        m_interrupts.enable,
+        m_interrupts.isEnabled(),
         m_iCache.mask,
         m_iCache.status,
         m_gpr.a,
         m_gpr.bc,
         m_gpr.de,
         m_gpr.hl,
-        m_memory.peek(GPU_SCANLINE_ADDRESS),
+        m_memory.peek(GPU_SCANLINE_ADDRESS), // worked out by the GPU (see readScanline)
         m_memory.romBank(),
         m_memory.ramBank(),
         m_operands,
@@ -627,7 +662,7 @@ void Processor::ret(bool enable)
     pop(m_pc);
 
     if (enable) {
-        m_interrupts.enable = true;
+        m_interrupts.restore();
     }
 
     tick(3);
@@ -861,17 +896,26 @@ void Processor::stop()
     // Check the speed switch register.  If the lowest bit is clear, then stop
     // was called without requesting a speed switch change, so we'll just bail
     // now.
-    uint8_t current = m_memory.read(CGB_SPEED_SWITCH_ADDRESS);
-    if (!(current & 0x01)) { return; }
+    uint8_t & current = m_memory.read(CGB_SPEED_SWITCH_ADDRESS);
+    if (!(current & SPEED_SWITCH_PREPARE)) { return; }
 
     TimerModule::ClockSpeed speed =
         (m_timer.getSpeed() == TimerModule::SPEED_NORMAL)
         ? TimerModule::SPEED_DOUBLE : TimerModule::SPEED_NORMAL;
 
-    // Update the MSB of the speed switch register and clear the LSB.
-    m_memory.write(CGB_SPEED_SWITCH_ADDRESS, uint8_t(speed) << 7);
+    // Update the MSB of the speed switch register and clear the LSB.  The
+    // CPU is the only one that gets to change either of them, so this goes
+    // straight to the register instead of through a write.
+    current &= ~(SPEED_SWITCH_PREPARE | SPEED_SWITCH_CURRENT);
+    current |= (uint8_t(speed) << 7);
 
     m_timer.setSpeed(speed);
+
+    // The rest of the hardware keeps going while the CPU waits for its clock
+    // to settle, and then the divider gets reset like it does on any STOP.
+    for (uint16_t i = 0; i < SPEED_SWITCH_CYCLES; i++) { tick(1); }
+
+    m_memory.write(CPU_TIMER_DIV_ADDRESS, 0x00);
 }
 
 void Processor::daa()
@@ -19,6 +19,7 @@
 
 #include "interrupt.h"
 #include "timermodule.h"
+#include "savestate.h"
 
 class GameBoy;
 class MemoryController;
@@ -57,15 +58,39 @@ public:
         std::string abbrev() const;
     };
 
+    static const uint8_t CB_PREFIX;
+
     explicit Processor(ClockInterface & clock, MemoryController & memory);
     ~Processor() = default;
 
     void reset();
     void cycle();
 
+    // Starts at the cartridge's entry point with the registers set the way
+    // that the BIOS leaves them, which depends on both the model and the
+    // game.  The BIOS region has to already be unlocked.
+    void boot();
+
+    inline uint16_t pc() const { return m_pc; }
+
+    // Everything that runs off of the CPU's clock (the timer, the serial
+    // port) goes twice as fast in double speed mode, and everything else
+    // (the GPU) doesn't.
+    inline TimerModule::ClockSpeed speed() const { return m_timer.getSpeed(); }
+
+    // The interrupt mask and status live in memory, so they go along with
+    // the rest of memory instead of with us.
+    void saveState(StateWriter & state) const;
+    bool loadState(StateReader & state);
+
     inline void updateTimer(uint8_t ticks) { m_timer.cycle(ticks); }
 
-    std::vector<Command> disassemble();
+    inline TimerModule & timer() { return m_timer; }
+
+    // Looks up an opcode (and the one after it when it's the CB prefix)
+    // without touching memory, which is nullptr when it isn't a real one.  The
+    // tables never change once we're built, so any thread can decode.
+    const Operation *decode(uint8_t opcode, uint8_t next) const;
 
 private:
 #ifdef UNIT_TEST
@@ -75,12 +100,20 @@ private:
 
     static const uint16_t HISTORY_SIZE;
 
-    static const uint8_t CB_PREFIX;
-
     static const uint16_t ROM_ENTRY_POINT;
 
     static const uint8_t CYCLES_PER_TICK;
 
+    static const uint16_t SPEED_SWITCH_CYCLES;
+
+    static const uint16_t HEADER_CHECKSUM_ADDRESS;
+    static const uint16_t DMG_BOOT_COUNTER;
+
+    enum SpeedSwitchMask {
+        SPEED_SWITCH_PREPARE = 0x01,
+        SPEED_SWITCH_CURRENT = 0x80,
+    };
+
     enum FlagMask {
         ZERO_FLAG_MASK       = 0x80,
         NEG_FLAG_MASK        = 0x40,
@@ -104,7 +137,7 @@ private:
     uint16_t m_sp;
 
     /** Interrupt enable, mask, and status registers */
-    Interrupts m_interrupts;
+    InterruptController & m_interrupts;
 
     struct {
         uint8_t status;
@@ -131,10 +164,10 @@ private:
 
     Operation *lookup(uint16_t & pc, uint8_t opcode);
 
-    inline void setVBlankInterrupt() { Interrupts::set(m_memory, InterruptMask::VBLANK); }
-    inline void setSerialInterrupt() { Interrupts::set(m_memory, InterruptMask::SERIAL); }
-    inline void setLCDInterrupt()    { Interrupts::set(m_memory, InterruptMask::LCD);    }
-    inline void setJoypadInterrupt() { Interrupts::set(m_memory, InterruptMask::JOYPAD); }
+    inline void setVBlankInterrupt() { m_interrupts.raise(InterruptMask::VBLANK); }
+    inline void setSerialInterrupt() { m_interrupts.raise(InterruptMask::SERIAL); }
+    inline void setLCDInterrupt()    { m_interrupts.raise(InterruptMask::LCD);    }
+    inline void setJoypadInterrupt() { m_interrupts.raise(InterruptMask::JOYPAD); }
 
     inline bool isZeroFlagSet()      const { return (m_flags & ZERO_FLAG_MASK);       }
     inline bool isNegFlagSet()       const { return (m_flags & NEG_FLAG_MASK);        }
@@ -0,0 +1,109 @@
+#ifndef SAVESTATE_H_
+#define SAVESTATE_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+// A save state is nothing more than each piece of the hardware writing out
+// its registers one after the other, and then reading them back in the same
+// order.  Everything goes out in the host's byte order and layout, so a state
+// only works with the build of the emulator that made it.
+class StateWriter final {
+public:
+    explicit StateWriter(std::vector<uint8_t> & bytes) : m_bytes(bytes) { }
+    ~StateWriter() = default;
+
+    template <typename T>
+    void put(const T & value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "state must be plain data");
+
+        const uint8_t *data = reinterpret_cast<const uint8_t*>(&value);
+        m_bytes.insert(m_bytes.end(), data, data + sizeof(T));
+    }
+
+    void put(const uint8_t *data, size_t length)
+    {
+        put(uint32_t(length));
+        m_bytes.insert(m_bytes.end(), data, data + length);
+    }
+
+    inline void put(const std::vector<uint8_t> & bytes) { put(bytes.data(), bytes.size()); }
+    inline void put(const std::string & text)
+        { put(reinterpret_cast<const uint8_t*>(text.data()), text.size()); }
+
+private:
+    std::vector<uint8_t> & m_bytes;
+};
+
+// Reading is the mirror image of writing.  Anything that doesn't line up with
+// what we expect (e.g. a state that was cut short, or a memory region that is
+// a different size than the one that was saved) marks the whole state bad,
+// and everything after that reads back as a failure.
+class StateReader final {
+public:
+    explicit StateReader(const std::vector<uint8_t> & bytes)
+        : m_bytes(bytes), m_offset(0), m_valid(true) { }
+    ~StateReader() = default;
+
+    template <typename T>
+    bool get(T & value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "state must be plain data");
+
+        if (!take(sizeof(T))) { return false; }
+
+        std::memcpy(&value, m_bytes.data() + m_offset - sizeof(T), sizeof(T));
+        return true;
+    }
+
+    // Fixed size blocks (e.g. a bank of RAM) have to come back exactly the
+    // same size that they went out.
+    bool get(uint8_t *data, size_t length)
+    {
+        uint32_t saved = 0;
+        if (!get(saved)) { return false; }
+
+        if ((saved != length) || !take(length)) { return fail(); }
+
+        std::memcpy(data, m_bytes.data() + m_offset - length, length);
+        return true;
+    }
+
+    inline bool get(std::vector<uint8_t> & bytes) { return get(bytes.data(), bytes.size()); }
+
+    bool get(std::string & text)
+    {
+        uint32_t length = 0;
+        if (!get(length) || !take(length)) { return fail(); }
+
+        text.assign(reinterpret_cast<const char*>(m_bytes.data() + m_offset - length), length);
+        return true;
+    }
+
+    // Lets the hardware reject something that read back fine, but doesn't
+    // make any sense (e.g. a state saved with a different cartridge).
+    inline bool fail() { m_valid = false; return false; }
+
+    inline bool isValid() const { return m_valid; }
+    inline bool isDone() const { return m_valid && (m_offset == m_bytes.size()); }
+
+private:
+    const std::vector<uint8_t> & m_bytes;
+
+    size_t m_offset;
+    bool m_valid;
+
+    bool take(size_t length)
+    {
+        if (!m_valid || (length > (m_bytes.size() - m_offset))) { return fail(); }
+
+        m_offset += length;
+        return true;
+    }
+};
+
+#endif /* SAVESTATE_H_ */
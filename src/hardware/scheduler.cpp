@@ -0,0 +1,297 @@
+/*
+ * scheduler.cpp
+ *
+ * The Scheduler runs any number of GameBoy instances on a fixed pool of
+ * worker threads, which keeps the number of threads at the number of cores
+ * no matter how many consoles there are.
+ *
+ * Frames:
+ *   A console runs one frame at a time on whichever worker picks it up.
+ *   Free running consoles go right back in to the worker's queue when their
+ *   frame is done.  Paced consoles wait on a timer until the deadline for
+ *   their next frame, and the timers that are due get moved into the queue of
+ *   whichever worker notices first.
+ *
+ * Stealing:
+ *   Every worker has its own queue, so workers don't fight over a single
+ *   queue.  A worker that runs out of consoles steals one from somebody
+ *   else, which is what evens things out when consoles run at different
+ *   speeds or take different amounts of time to run a frame.
+ *
+ * Pausing:
+ *   Anything that halts a console while it's on the pool gets it parked
+ *   instead of tying up a worker, and the console gets handed back to the
+ *   scheduler once it's resumed.  Queued commands run at the start of the
+ *   console's next frame.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <optional>
+#include <algorithm>
+#include <cassert>
+
+#include "scheduler.h"
+#include "gameboy.h"
+#include "logging.h"
+
+using std::vector;
+using std::shared_ptr;
+using std::weak_ptr;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+using std::chrono::steady_clock;
+
+Scheduler::Scheduler(uint32_t workers)
+    : m_earliest(NO_DEADLINE),
+      m_ready(0),
+      m_idle(0),
+      m_next(0),
+      m_interrupt(false),
+      m_frames(0),
+      m_steals(0)
+{
+    if (0 == workers) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // All of the workers need to be there before any of them start looking
+    // for something to steal.
+    for (uint32_t i = 0; i < workers; i++) {
+        m_workers.emplace_back(new Worker());
+    }
+
+    for (uint32_t i = 0; i < workers; i++) {
+        m_workers.at(i)->thread = std::thread([this, i] { run(i); });
+    }
+
+    NOTE("Scheduler running %u workers\n", workers);
+}
+
+Scheduler::~Scheduler()
+{
+    vector<weak_ptr<GameBoy>> consoles;
+    {
+        lock_guard<mutex> guard(m_lock);
+        consoles.swap(m_consoles);
+    }
+
+    // The consoles finish up whatever frame they're in the middle of, so the
+    // workers need to keep running until they're all stopped.
+    for (auto & entry : consoles) {
+        Console console = entry.lock();
+        if (console) { console->stop(); }
+    }
+
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_interrupt.store(true);
+        m_cv.notify_all();
+    }
+
+    for (auto & worker : m_workers) {
+        if (worker->thread.joinable()) { worker->thread.join(); }
+    }
+}
+
+bool Scheduler::add(shared_ptr<GameBoyInterface> console)
+{
+    Console gameboy = std::dynamic_pointer_cast<GameBoy>(console);
+    if (!gameboy) { return false; }
+
+    // The console holds on to the callback, so it can't hold on to the
+    // console or neither one of them would ever go away.
+    weak_ptr<GameBoy> handle = gameboy;
+    bool attached = gameboy->attach([this, handle] {
+        Console parked = handle.lock();
+        if (parked) { wake(parked); }
+    });
+    if (!attached) { return false; }
+
+    {
+        lock_guard<mutex> guard(m_lock);
+
+        m_consoles.erase(
+            std::remove_if(m_consoles.begin(), m_consoles.end(),
+                           [](const weak_ptr<GameBoy> & entry) { return entry.expired(); }),
+            m_consoles.end());
+        m_consoles.push_back(gameboy);
+    }
+
+    wake(gameboy);
+    return true;
+}
+
+Scheduler::Statistics Scheduler::getStatistics() const
+{
+    Statistics stats;
+    stats.frames = m_frames.load(std::memory_order_relaxed);
+    stats.steals = m_steals.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+void Scheduler::run(uint32_t index)
+{
+    while (!m_interrupt.load(std::memory_order_acquire)) {
+        // Busy workers need to keep an eye on the timers too.  Otherwise,
+        // paced consoles would miss their deadlines any time that there are
+        // free running consoles to keep everybody busy.
+        TimePoint now = steady_clock::now();
+        if (ticks(now) >= m_earliest.load(std::memory_order_acquire)) {
+            expire(index, now);
+        }
+
+        Console console = take(index);
+        if (!console) {
+            idle();
+            continue;
+        }
+
+        std::optional<TimePoint> deadline;
+        switch (console->advance(steady_clock::now(), deadline)) {
+        default:
+            assert(0);
+            [[fallthrough]];
+
+        // Parked consoles come back through their wake callback, and stopped
+        // consoles are done with the pool.
+        case GameBoy::Advance::PARKED:
+        case GameBoy::Advance::STOPPED:
+            break;
+
+        case GameBoy::Advance::RAN: {
+            m_frames.fetch_add(1, std::memory_order_relaxed);
+
+            if (deadline && (*deadline > steady_clock::now())) {
+                defer(console, *deadline);
+            } else {
+                push(index, console);
+            }
+            break;
+        }
+        }
+    }
+}
+
+void Scheduler::idle()
+{
+    unique_lock<mutex> lock(m_lock);
+
+    // Anybody that makes a console ready checks for idle workers after they
+    // bump the ready count, and we check the ready count after we bump the
+    // idle count, so at least one of us always sees the other.
+    m_idle.fetch_add(1);
+
+    if (!m_interrupt.load() && (0 == m_ready.load())) {
+        if (m_timers.empty()) {
+            m_cv.wait(lock);
+        } else {
+            m_cv.wait_until(lock, m_timers.top().deadline);
+        }
+    }
+
+    m_idle.fetch_sub(1);
+}
+
+Scheduler::Console Scheduler::take(uint32_t index)
+{
+    {
+        Worker & worker = *m_workers.at(index);
+
+        lock_guard<mutex> guard(worker.lock);
+        if (!worker.ready.empty()) {
+            Console console = std::move(worker.ready.front());
+            worker.ready.pop_front();
+
+            m_ready.fetch_sub(1);
+            return console;
+        }
+    }
+
+    if (0 == m_ready.load()) { return nullptr; }
+
+    // Start with our neighbor so that the thieves spread themselves out.
+    uint32_t count = workers();
+    for (uint32_t i = 1; i < count; i++) {
+        Worker & victim = *m_workers.at((index + i) % count);
+
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.ready.empty()) {
+            Console console = std::move(victim.ready.back());
+            victim.ready.pop_back();
+
+            m_ready.fetch_sub(1);
+            m_steals.fetch_add(1, std::memory_order_relaxed);
+            return console;
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::push(uint32_t index, Console console)
+{
+    {
+        Worker & worker = *m_workers.at(index);
+
+        lock_guard<mutex> guard(worker.lock);
+        worker.ready.push_back(std::move(console));
+    }
+
+    m_ready.fetch_add(1);
+
+    // Only bother with the lock when somebody could be asleep.  Taking it
+    // makes sure that a worker that's on its way to sleep gets there before
+    // we notify it.
+    if (m_idle.load() > 0) {
+        lock_guard<mutex> guard(m_lock);
+        m_cv.notify_one();
+    }
+}
+
+void Scheduler::wake(Console console)
+{
+    // Consoles that come from outside of the pool get dealt out evenly, and
+    // stealing takes care of the rest.
+    uint32_t index = m_next.fetch_add(1, std::memory_order_relaxed) % workers();
+    push(index, std::move(console));
+}
+
+void Scheduler::defer(Console console, TimePoint deadline)
+{
+    lock_guard<mutex> guard(m_lock);
+
+    m_timers.push({ deadline, std::move(console) });
+    m_earliest.store(ticks(m_timers.top().deadline), std::memory_order_release);
+
+    // An idle worker could be asleep until a later deadline than this one.
+    if (m_idle.load() > 0) { m_cv.notify_one(); }
+}
+
+void Scheduler::expire(uint32_t index, TimePoint now)
+{
+    vector<Console> due;
+    {
+        lock_guard<mutex> guard(m_lock);
+
+        while (!m_timers.empty() && (m_timers.top().deadline <= now)) {
+            due.push_back(m_timers.top().console);
+            m_timers.pop();
+        }
+
+        m_earliest.store(
+            (m_timers.empty()) ? NO_DEADLINE : ticks(m_timers.top().deadline),
+            std::memory_order_release);
+    }
+
+    // Everything that is due goes into our own queue, and anybody that is
+    // idle steals whatever we don't get to.
+    for (Console & console : due) {
+        push(index, std::move(console));
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "gameboyinterface.h"
+
+class GameBoy;
+
+class Scheduler final {
+public:
+    // The pool gets a worker per core unless it's told otherwise.
+    explicit Scheduler(uint32_t workers = 0);
+    ~Scheduler();
+
+    Scheduler(const Scheduler &) = delete;
+    Scheduler & operator=(const Scheduler &) = delete;
+
+    // Starts a console running on the pool instead of on a thread of its own.
+    // A console that's already running (started, on a pool, or being run by
+    // somebody else) gets turned away.  Stopping the console takes it back
+    // off of the pool, and anything left running when the scheduler goes
+    // away gets stopped.
+    bool add(std::shared_ptr<GameBoyInterface> console);
+
+    inline uint32_t workers() const { return uint32_t(m_workers.size()); }
+
+    struct Statistics {
+        uint64_t frames;
+        uint64_t steals;
+    };
+
+    Statistics getStatistics() const;
+
+private:
+    using TimePoint = std::chrono::steady_clock::time_point;
+    using Console = std::shared_ptr<GameBoy>;
+
+    // Every worker has its own queue of consoles that are ready to run.  The
+    // worker runs them from the front, and anybody that runs out of work
+    // steals from the back.
+    struct Worker {
+        std::mutex lock;
+        std::deque<Console> ready;
+        std::thread thread;
+    };
+
+    // Paced consoles wait here until their next frame is due.
+    struct Timer {
+        TimePoint deadline;
+        Console console;
+    };
+
+    struct Later {
+        inline bool operator()(const Timer & lhs, const Timer & rhs) const
+            { return lhs.deadline > rhs.deadline; }
+    };
+
+    static constexpr int64_t NO_DEADLINE = INT64_MAX;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    // Guards the timers and the consoles, and it's what idle workers sleep
+    // on until there is something to do.
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+
+    std::priority_queue<Timer, std::vector<Timer>, Later> m_timers;
+    std::vector<std::weak_ptr<GameBoy>> m_consoles;
+
+    // The earliest deadline (in nanoseconds on the steady clock) so that busy
+    // workers can tell whether any timers are due without taking the lock.
+    std::atomic<int64_t> m_earliest;
+
+    std::atomic<uint32_t> m_ready;
+    std::atomic<uint32_t> m_idle;
+    std::atomic<uint32_t> m_next;
+    std::atomic<bool> m_interrupt;
+
+    std::atomic<uint64_t> m_frames;
+    std::atomic<uint64_t> m_steals;
+
+    void run(uint32_t index);
+    void idle();
+
+    Console take(uint32_t index);
+    void push(uint32_t index, Console console);
+    void wake(Console console);
+
+    void defer(Console console, TimePoint deadline);
+    void expire(uint32_t index, TimePoint now);
+
+    static inline int64_t ticks(TimePoint time)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            time.time_since_epoch()).count();
+    }
+};
+
+#endif /* SCHEDULER_H_ */
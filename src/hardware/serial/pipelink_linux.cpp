@@ -73,7 +73,7 @@ void PipeLink::transfer(uint8_t value)
     }
 
     m_memory.write(SERIAL_DATA_ADDRESS, data);
-    Interrupts::set(m_memory, InterruptMask::SERIAL);
+    m_memory.interrupts().raise(InterruptMask::SERIAL);
 }
 
 void PipeLink::check()
@@ -91,7 +91,7 @@ void PipeLink::check()
     }
 
     m_memory.write(SERIAL_DATA_ADDRESS, data);
-    Interrupts::set(m_memory, InterruptMask::SERIAL);
+    m_memory.interrupts().raise(InterruptMask::SERIAL);
 
     m_pending = false;
 #endif
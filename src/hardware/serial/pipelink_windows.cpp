@@ -3,8 +3,8 @@
 #include "pipelink.h"
 #include "memorycontroller.h"
 
-PipeLink::PipeLink(MemoryController & memory)
-    : ConsoleLink(memory)
+PipeLink::PipeLink(MemoryController & memory, const ConfigSnapshot & config)
+    : ConsoleLink(memory, config)
 {
 
 }
@@ -9,7 +9,7 @@ class MemoryController;
 
 class PipeLink : public ConsoleLink {
 public:
-    PipeLink(MemoryController & memory);
+    PipeLink(MemoryController & memory, const ConfigSnapshot & config);
     ~PipeLink();
 
 private:
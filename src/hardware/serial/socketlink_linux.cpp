@@ -30,8 +30,9 @@ using std::list;
 using std::unique_lock;
 using std::string;
 
-SocketLink::SocketLink(MemoryController & memory)
-    : ConsoleLink(memory)
+SocketLink::SocketLink(MemoryController & memory, const ConfigSnapshot & config)
+    : ConsoleLink(memory, config),
+      m_host(config.getString(ConfigKey::LINK_ADDR))
 {
     m_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (INVALID_FD == m_socket) {
@@ -39,7 +40,7 @@ SocketLink::SocketLink(MemoryController & memory)
         return;
     }
 
-    int port = Configuration::getInt(ConfigKey::LINK_PORT);
+    int port = config.getInt(ConfigKey::LINK_PORT);
 
     NOTE("Socket server config: %s\n", (m_master) ? "master" : "slave");
 
@@ -132,9 +133,7 @@ void SocketLink::executeClient(int socket, int port)
     addr.sin_family = AF_INET;
     addr.sin_port   = htons(port);
 
-    string host = Configuration::getString(ConfigKey::LINK_ADDR);
-
-    struct hostent *info = gethostbyname(host.c_str());
+    struct hostent *info = gethostbyname(m_host.c_str());
     if (!info) {
         ERROR("%s\n", "Failed convert host IP");
         return;
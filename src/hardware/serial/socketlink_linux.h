@@ -5,6 +5,7 @@
 #include <thread>
 #include <list>
 #include <mutex>
+#include <string>
 
 #include "consolelink.h"
 
@@ -12,7 +13,7 @@ class MemoryController;
 
 class SocketLink final : public ConsoleLink {
 public:
-    SocketLink(MemoryController & memory);
+    SocketLink(MemoryController & memory, const ConfigSnapshot & config);
     ~SocketLink() { stop(); }
 
     void stop() override;
@@ -26,6 +27,8 @@ private:
     int m_socket;
     int m_connection;
 
+    std::string m_host;
+
     void initServer(int port);
     void initClient(int port);
 
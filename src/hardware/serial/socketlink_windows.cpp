@@ -19,8 +19,8 @@ using std::list;
 using std::unique_lock;
 using std::string;
 
-SocketLink::SocketLink(MemoryController & memory)
-    : ConsoleLink(memory)
+SocketLink::SocketLink(MemoryController & memory, const ConfigSnapshot & config)
+    : ConsoleLink(memory, config)
 {
 
 }
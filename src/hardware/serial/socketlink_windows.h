@@ -12,7 +12,7 @@ class MemoryController;
 
 class SocketLink final : public ConsoleLink {
 public:
-    SocketLink(MemoryController & memory);
+    SocketLink(MemoryController & memory, const ConfigSnapshot & config);
     ~SocketLink() { stop(); }
 
     void stop() override;
@@ -7,11 +7,10 @@
 #include <cassert>
 
 #include "timermodule.h"
+#include "memorycontroller.h"
 #include "memmap.h"
 #include "interrupt.h"
 
-const uint16_t TimerModule::RTC_INCREMENT = 512;
-
 const uint16_t TimerModule::TIMEOUT_4K   = 1024;
 const uint16_t TimerModule::TIMEOUT_252K = 16;
 const uint16_t TimerModule::TIMEOUT_65K  = 64;
@@ -21,68 +20,165 @@ const TimeoutMapArray TimerModule::TIMEOUT_MAP = {
     { TIMEOUT_4K, TIMEOUT_252K, TIMEOUT_65K, TIMEOUT_16K, },
 };
 
+// The registers that we work out ourselves get handed back straight from
+// memory, without going through the special handling that reading them does.
 TimerModule::TimerModule(MemoryController & memory)
     : m_memory(memory),
-      m_divider(memory.read(CPU_TIMER_DIV_ADDRESS)),
-      m_counter(memory.read(CPU_TIMER_COUNTER_ADDRESS)),
-      m_modulo(memory.read(CPU_TIMER_MODULO_ADDRESS)),
-      m_control(memory.read(CPU_TIMER_CONTROL_ADDRESS)),
+      m_divider(memory.ioRegister(CPU_TIMER_DIV_ADDRESS)),
+      m_counter(memory.ioRegister(CPU_TIMER_COUNTER_ADDRESS)),
+      m_modulo(memory.ioRegister(CPU_TIMER_MODULO_ADDRESS)),
+      m_control(memory.ioRegister(CPU_TIMER_CONTROL_ADDRESS)),
       m_speed(SPEED_NORMAL)
 {
     reset();
 }
 
-void TimerModule::reset()
+void TimerModule::reset(uint16_t counter)
 {
-    m_ticks = m_rtc = 0;
-
     m_divider = m_counter = m_modulo = m_control = 0x00;
+
+    m_speed = SPEED_NORMAL;
+
+    m_reset = 0;
+    m_now = m_since = counter;
+    m_base = 0x00;
+
+    m_timeout = TIMEOUT_MAP.at(m_control & TIMER_FREQUENCY);
+
+    schedule();
 }
 
-void TimerModule::cycle(uint8_t ticks)
+void TimerModule::saveState(StateWriter & state) const
 {
-    // Check to see if the memory module has a pending request for a reset of
-    // the real time clock.  If so, we need to reset the rtc counter and then
-    // clear the request.
-    if (m_memory.isRtcResetRequested()) {
-        m_divider = m_rtc = 0x00;
+    state.put(m_speed);
+    state.put(m_now);
+    state.put(m_reset);
+    state.put(m_base);
+    state.put(m_since);
+    state.put(m_due);
+    state.put(m_timeout);
+}
 
-        m_memory.clearRtcReset();
-    }
+bool TimerModule::loadState(StateReader & state)
+{
+    // TAC comes back with the rest of memory after we do, so the overflow
+    // can't be rescheduled from it here.
+    return state.get(m_speed)
+        && state.get(m_now)
+        && state.get(m_reset)
+        && state.get(m_base)
+        && state.get(m_since)
+        && state.get(m_due)
+        && state.get(m_timeout);
+}
+
+uint8_t & TimerModule::readDivider()
+{
+    m_divider = uint8_t(elapsed() >> 8);
+    return m_divider;
+}
+
+uint8_t & TimerModule::readCounter()
+{
+    sync();
 
-    m_rtc += ticks;
+    m_counter = m_base;
+    return m_counter;
+}
 
-    const uint16_t rtc = RTC_INCREMENT >> uint8_t(m_speed);
+void TimerModule::writeDivider()
+{
+    sync();
 
-    // Check to see if the number of ticks corresponding to 1 increment of
-    // the RTC has elapsed and increment it if so.
-    while (m_rtc >= rtc) {
-        m_divider++;
+    // Resetting the counter drops the bit that TIMA is watching, which counts
+    // as an edge if it was high.
+    bool high = isEdgeHigh();
+    m_reset = m_now;
 
-        m_rtc -= rtc;
-    }
+    if (high) { increment(); }
 
-    if (!(m_control & TIMER_ENABLE)) { return; }
+    schedule();
+}
 
-    m_ticks += ticks;
+void TimerModule::writeCounter(uint8_t value)
+{
+    sync();
 
-    // Read the frequency bits in the control register and look up how many
-    // clock cycles need to elapse until we need to increment the counter
-    // register.
-    m_timeout = TIMEOUT_MAP.at(m_control & TIMER_FREQUENCY) >> uint8_t(m_speed);
+    m_base = value;
+    schedule();
+}
 
-    while (m_ticks >= m_timeout) {
-        // We've got the correct number of ticks to increment the actual
-        // counter, so increment it now.  If the register is set to 0xFF,
-        // then this increment is going to overflow the register, so we
-        // need to set the timer interrupt bit and set the counter back to
-        // its initial value.
-        if (0xFF == m_counter++) {
-            Interrupts::set(m_memory, InterruptMask::TIMER);
+void TimerModule::writeModulo(uint8_t value)
+{
+    // The modulo only gets looked at when TIMA overflows, so it doesn't move
+    // the overflow at all.
+    m_modulo = value;
+}
 
-            m_counter = m_modulo;
-        }
+void TimerModule::writeControl(uint8_t value)
+{
+    sync();
 
-        m_ticks -= m_timeout;
+    // Switching to a bit that is low (or turning the timer off) while the
+    // old bit was high is a falling edge, just like the counter moving on.
+    bool high = isEdgeHigh();
+
+    m_control = (m_control & ~0x07) | (value & 0x07);
+    m_timeout = TIMEOUT_MAP.at(m_control & TIMER_FREQUENCY);
+
+    if (high && !isEdgeHigh()) { increment(); }
+
+    schedule();
+}
+
+void TimerModule::overflow()
+{
+    // A short timeout and a modulo close to 0xFF can overflow more than once
+    // in a single instruction.
+    while (m_now >= m_due) {
+        m_memory.interrupts().raise(InterruptMask::TIMER);
+
+        m_base  = m_modulo;
+        m_since = m_due;
+
+        schedule();
     }
 }
+
+void TimerModule::sync()
+{
+    // Brings TIMA up to where it is right now, so that whatever is about to
+    // change only counts from here on out.
+    if (m_now >= m_due) { overflow(); }
+
+    if (isEnabled()) {
+        uint64_t edges = (elapsed() / m_timeout) - ((m_since - m_reset) / m_timeout);
+        m_base = uint8_t(m_base + edges);
+    }
+    m_since = m_now;
+}
+
+void TimerModule::increment()
+{
+    // If TIMA is set to 0xFF, then this increment is going to overflow it,
+    // so we need to set the timer interrupt bit and set it back to its
+    // initial value.
+    if (0xFF == m_base++) {
+        m_memory.interrupts().raise(InterruptMask::TIMER);
+
+        m_base = m_modulo;
+    }
+}
+
+void TimerModule::schedule()
+{
+    if (!isEnabled()) {
+        m_due = UINT64_MAX;
+        return;
+    }
+
+    // TIMA goes up every time that the counter gets to a multiple of the
+    // timeout, and overflows on the one that takes it past 0xFF.
+    uint64_t edges = (m_since - m_reset) / m_timeout;
+    m_due = m_reset + ((edges + (0x100 - m_base)) * m_timeout);
+}
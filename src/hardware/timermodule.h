@@ -13,10 +13,17 @@
 #include <cstdint>
 #include <array>
 
+#include "savestate.h"
+
 class MemoryController;
 
 using TimeoutMapArray = std::array<uint16_t, TIMEOUT_SEL_COUNT>;
 
+// The timer is a single 16 bit counter that goes up once per clock cycle.
+// DIV is the top half of it, and TIMA goes up every time that the bit that
+// TAC selects goes from high to low.  Neither one gets worked out until it's
+// read, so the only thing that happens on every instruction is counting the
+// cycles and checking whether TIMA is due to overflow.
 struct TimerModule {
 public:
     enum ClockSpeed { SPEED_NORMAL = 0x00, SPEED_DOUBLE = 0x01, };
@@ -24,20 +31,39 @@ public:
     explicit TimerModule(MemoryController & memory);
     ~TimerModule() = default;
 
-    void reset();
+    // The counter doesn't start at 0 when the BIOS gets skipped, since the
+    // BIOS would have been running it the whole time.
+    void reset(uint16_t counter = 0);
 
-    void cycle(uint8_t ticks);
+    // The ticks are the ones that the rest of the hardware gets, which come
+    // half as often in double speed mode as the timer's own clock does.
+    inline void cycle(uint8_t ticks)
+    {
+        m_now += uint64_t(ticks) << uint8_t(m_speed);
+        if (m_now >= m_due) { overflow(); }
+    }
 
     void setSpeed(ClockSpeed speed) { m_speed = speed; }
 
     inline ClockSpeed getSpeed() const { return m_speed; }
 
+    uint8_t & readDivider();
+    uint8_t & readCounter();
+
+    void writeDivider();
+    void writeCounter(uint8_t value);
+    void writeModulo(uint8_t value);
+    void writeControl(uint8_t value);
+
+    // The registers themselves live in memory, which gets saved separately.
+    // DIV and TIMA get worked out from our state instead.
+    void saveState(StateWriter & state) const;
+    bool loadState(StateReader & state);
+
 private:
 #ifdef UNIT_TEST
     friend class TimerTest;
 #endif
-    static const uint16_t RTC_INCREMENT;
-
     static const uint16_t TIMEOUT_4K;
     static const uint16_t TIMEOUT_252K;
     static const uint16_t TIMEOUT_65K;
@@ -54,12 +80,35 @@ private:
     uint8_t & m_modulo;
     uint8_t & m_control;
 
-    uint16_t m_ticks;
-    uint16_t m_rtc;
-
     ClockSpeed m_speed;
 
+    // Timer clock cycles since the console was reset (plus wherever the
+    // counter started), and where we were the last time that DIV was written
+    // (which resets the whole counter).
+    uint64_t m_now;
+    uint64_t m_reset;
+
+    // TIMA was m_base at m_since, and has gone up once for every falling
+    // edge since then.  m_due is when it's going to overflow next.
+    uint8_t m_base;
+    uint64_t m_since;
+    uint64_t m_due;
+
     uint16_t m_timeout;
+
+    inline bool isEnabled() const { return (m_control & TIMER_ENABLE); }
+
+    // Where the 16 bit counter is, without it ever wrapping.
+    inline uint64_t elapsed() const { return m_now - m_reset; }
+
+    // The bit that TIMA watches is the one that's half of the timeout.
+    inline bool isEdgeHigh() const
+        { return isEnabled() && (elapsed() & (m_timeout >> 1)); }
+
+    void overflow();
+    void sync();
+    void increment();
+    void schedule();
 };
 
 #endif /* TIMERMODULE_H_ */
@@ -0,0 +1,305 @@
+/*
+ * vecenv.cpp
+ *
+ * The VecEnv runs a batch of consoles one step at a time for whoever is
+ * driving them (e.g. a reinforcement learning trainer).
+ *
+ * Stepping:
+ *   Every console runs on the caller's schedule through runFrame, so there
+ *   is no pacing and nothing runs in between steps.  The consoles in a step
+ *   get handed out one at a time to a fixed pool of threads, and the caller
+ *   works through the batch right along with the pool.
+ *
+ * Observations:
+ *   Each console writes its own slice of the caller's buffer, so nobody
+ *   shares anything while the observations get written.  The consoles are
+ *   headless and only draw the frames that are going to be looked at.
+ *
+ * Resetting:
+ *   Booting takes hundreds of frames, so it only ever happens once.  The
+ *   state after the boot (and any warm up) gets saved, and resetting a
+ *   console is loading that state back in.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cassert>
+
+#include "vecenv.h"
+#include "logging.h"
+
+using std::string;
+using std::vector;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+using std::chrono::steady_clock;
+
+const uint16_t VecEnv::ROM_ENTRY_POINT = 0x0100;
+
+// The boot ROM takes ~330 frames to hand off to the cartridge.
+const uint64_t VecEnv::BOOT_CYCLES_MAX = 1000 * 70224;
+
+const uint8_t VecEnv::BUTTON_COUNT = 8;
+
+VecEnv::VecEnv(uint32_t count, const Layout & layout, const ConfigSnapshot & config, uint32_t workers)
+    : m_layout(layout),
+      m_task(nullptr),
+      m_next(0),
+      m_batch(0),
+      m_busy(0),
+      m_interrupt(false)
+{
+    int scale = std::max(1, int(m_layout.scale));
+    if ((0 != (GameBoyInterface::WIDTH % scale)) || (0 != (GameBoyInterface::HEIGHT % scale))) {
+        WARN("Screen can't be scaled by %d, leaving it out\n", scale);
+        m_layout.scale = 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        Console console;
+        console.console = GameBoyInterface::Instance(config);
+        console.console->setHeadless(true);
+        console.time = 0.0;
+
+        m_consoles.push_back(std::move(console));
+    }
+
+    if (0 == workers) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // There's never any point in having more threads than consoles.
+    workers = std::max(1u, std::min(workers, count));
+    for (uint32_t i = 1; i < workers; i++) {
+        m_threads.emplace_back([this] { run(); });
+    }
+}
+
+VecEnv::~VecEnv()
+{
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_interrupt = true;
+    }
+    m_cv.notify_all();
+
+    for (std::thread & thread : m_threads) { thread.join(); }
+}
+
+bool VecEnv::load(const string & filename, uint32_t warmup)
+{
+    if (m_consoles.empty()) { return false; }
+
+    std::atomic<bool> loaded(true);
+    dispatch([&](uint32_t index) {
+        if (!m_consoles.at(index).console->load(filename)) { loaded = false; }
+    });
+    if (!loaded) { return false; }
+
+    // Everybody starts from the same place, so only one of the consoles has
+    // to sit through the boot ROM.  Without it, the console is already at the
+    // entry point (and running until it got back there would never end).
+    Console & first = m_consoles.front();
+    if (!first.console->configuration().getBool(ConfigKey::FAST_BOOT)) {
+        first.console->runUntil(ROM_ENTRY_POINT, BOOT_CYCLES_MAX);
+    }
+
+    for (uint32_t i = 0; i < warmup; i++) {
+        first.console->requestFrame();
+        first.console->runFrame();
+    }
+
+    m_startScreen = first.console->getRGB();
+    m_start = first.console->saveState();
+
+    dispatch([&](uint32_t index) {
+        if (!reset(index)) { loaded = false; }
+    });
+    return loaded;
+}
+
+size_t VecEnv::observationSize() const
+{
+    size_t pixels = 0;
+    if (0 != m_layout.scale) {
+        pixels = (GameBoyInterface::WIDTH / m_layout.scale) * (GameBoyInterface::HEIGHT / m_layout.scale);
+    }
+    return pixels + m_layout.addresses.size();
+}
+
+VecEnv::Timing VecEnv::step(const uint8_t *actions, uint32_t frames, uint8_t *observations)
+{
+    auto begin = steady_clock::now();
+
+    size_t length = observationSize();
+    dispatch([&](uint32_t index) {
+        auto start = steady_clock::now();
+
+        Console & console = m_consoles.at(index);
+        if (actions) { press(console, actions[index]); }
+
+        // A frame that gets asked for is the next full one, which is always
+        // done within two frames.
+        for (uint32_t i = 0; i < frames; i++) {
+            if ((0 != m_layout.scale) && ((i + 2) >= frames)) {
+                console.console->requestFrame();
+            }
+            console.console->runFrame();
+        }
+
+        write(console, observations + (index * length));
+
+        console.time = std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+    });
+
+    Timing timing;
+    timing.elapsed = std::chrono::duration<double, std::milli>(steady_clock::now() - begin).count();
+    timing.frames  = uint64_t(frames) * size();
+    timing.mean    = 0.0;
+    timing.slowest = 0.0;
+
+    for (const Console & console : m_consoles) {
+        timing.mean   += console.time;
+        timing.slowest = std::max(timing.slowest, console.time);
+    }
+    if (!m_consoles.empty()) { timing.mean /= double(m_consoles.size()); }
+
+    return timing;
+}
+
+void VecEnv::observe(uint8_t *observations)
+{
+    size_t length = observationSize();
+    dispatch([&](uint32_t index) {
+        write(m_consoles.at(index), observations + (index * length));
+    });
+}
+
+bool VecEnv::reset(uint32_t index)
+{
+    Console & console = m_consoles.at(index);
+    if (!console.console->loadState(m_start)) { return false; }
+
+    console.screen = m_startScreen;
+    return true;
+}
+
+void VecEnv::capture(uint32_t index)
+{
+    Console & console = m_consoles.at(index);
+
+    m_start = console.console->saveState();
+    m_startScreen = console.screen;
+}
+
+void VecEnv::press(Console & console, uint8_t action)
+{
+    for (uint8_t i = 0; i < BUTTON_COUNT; i++) {
+        auto button = GameBoyInterface::JoyPadButton(1 << i);
+
+        if (action & button) {
+            console.console->setButton(button);
+        } else {
+            console.console->clrButton(button);
+        }
+    }
+}
+
+void VecEnv::write(Console & console, uint8_t *observation)
+{
+    if (0 != m_layout.scale) {
+        ColorArray screen = console.console->getRGB();
+        if (!screen.empty()) { console.screen = std::move(screen); }
+
+        int scale  = m_layout.scale;
+        int width  = GameBoyInterface::WIDTH / scale;
+        int height = GameBoyInterface::HEIGHT / scale;
+
+        // Nothing has been drawn yet (e.g. the LCD is off), so it's all black.
+        if (console.screen.empty()) {
+            std::memset(observation, 0x00, size_t(width * height));
+            observation += (width * height);
+        } else {
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    uint32_t sum = 0;
+                    for (int row = y * scale; row < ((y + 1) * scale); row++) {
+                        const GB::RGB *pixel = &console.screen[(row * GameBoyInterface::WIDTH) + (x * scale)];
+                        for (int column = 0; column < scale; column++, pixel++) {
+                            // ITU-R BT.601 luma in 8 bit fixed point.
+                            sum += ((77 * pixel->red) + (150 * pixel->green) + (29 * pixel->blue)) >> 8;
+                        }
+                    }
+                    *observation++ = uint8_t(sum / uint32_t(scale * scale));
+                }
+            }
+        }
+    }
+
+    if (m_layout.addresses.empty()) { return; }
+
+    vector<uint8_t> values = console.console->queueRead(m_layout.addresses).get();
+    std::copy(values.begin(), values.end(), observation);
+}
+
+void VecEnv::dispatch(const Task & task)
+{
+    {
+        lock_guard<mutex> guard(m_lock);
+
+        m_task = &task;
+        m_next.store(0);
+        m_busy = uint32_t(m_threads.size());
+        m_batch++;
+    }
+    m_cv.notify_all();
+
+    drain(task);
+
+    // The task belongs to the caller, so nobody can still be using it once
+    // we hand control back.
+    unique_lock<mutex> lock(m_lock);
+    m_done.wait(lock, [&] { return (0 == m_busy); });
+    m_task = nullptr;
+}
+
+void VecEnv::drain(const Task & task)
+{
+    uint32_t index;
+    while ((index = m_next.fetch_add(1)) < size()) {
+        task(index);
+    }
+}
+
+void VecEnv::run()
+{
+    uint64_t batch = 0;
+    while (true) {
+        const Task *task = nullptr;
+        {
+            unique_lock<mutex> lock(m_lock);
+            m_cv.wait(lock, [&] { return (m_interrupt || (m_batch != batch)); });
+            if (m_interrupt) { return; }
+
+            batch = m_batch;
+            task  = m_task;
+        }
+
+        assert(task);
+        drain(*task);
+
+        {
+            lock_guard<mutex> guard(m_lock);
+            m_busy--;
+        }
+        m_done.notify_one();
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef VECENV_H_
+#define VECENV_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+#include "gameboyinterface.h"
+#include "configuration.h"
+
+// A batch of consoles that all run the same cartridge in lock step, which is
+// what training an agent against lots of copies of a game looks like.  Each
+// step hands every console its buttons, runs all of them the same number of
+// frames on a pool of threads, and then writes what each of them looks like
+// in to one buffer that the caller owns.
+class VecEnv final {
+public:
+    // What goes in to each console's slice of the observation buffer.  The
+    // screen is turned in to 8 bit grayscale and shrunk by averaging blocks
+    // of scale x scale pixels (a scale of 0 leaves the screen out), and that
+    // is followed by the value at each one of the addresses, in order.  The
+    // scale has to divide evenly in to both dimensions of the screen.
+    struct Layout {
+        uint8_t scale;
+        std::vector<uint16_t> addresses;
+    };
+
+    // Wall clock milliseconds.  The mean and the slowest are for a single
+    // console, so the gap between the slowest and the whole step is time that
+    // the pool spent waiting on stragglers.
+    struct Timing {
+        double elapsed;
+        double mean;
+        double slowest;
+
+        uint64_t frames;
+    };
+
+    // The pool gets a thread per core unless it's told otherwise, and the
+    // thread that calls step() is one of them.
+    VecEnv(uint32_t count, const Layout & layout,
+           const ConfigSnapshot & config = ConfigSnapshot(),
+           uint32_t workers = 0);
+    ~VecEnv();
+
+    VecEnv(const VecEnv &) = delete;
+    VecEnv & operator=(const VecEnv &) = delete;
+
+    // Loads the cartridge in to every console and puts all of them in the
+    // start state, which is right where the boot ROM hands off to the
+    // cartridge plus however many frames of warm up that we're asked for.
+    bool load(const std::string & filename, uint32_t warmup = 0);
+
+    inline uint32_t size() const { return uint32_t(m_consoles.size()); }
+    inline uint32_t workers() const { return uint32_t(m_threads.size() + 1); }
+
+    // Bytes in each console's slice of the observation buffer.
+    size_t observationSize() const;
+
+    // There is one action per console, which is the JoyPadButton values of
+    // all of the buttons that it holds down for the whole step (no actions
+    // leaves the buttons alone).  The buffer has to have room for an
+    // observation from every console.
+    //
+    // Headless consoles only draw the frames that get asked for, so the
+    // screen is the last frame that was drawn during the step, which can be
+    // a frame behind the one that just finished.
+    Timing step(const uint8_t *actions, uint32_t frames, uint8_t *observations);
+
+    // Writes everybody's observation without running anything (e.g. right
+    // after a reset).
+    void observe(uint8_t *observations);
+
+    // Puts a console back in the start state, or makes the state that a
+    // console is in right now the new start state for everybody.
+    bool reset(uint32_t index);
+    void capture(uint32_t index);
+
+    inline GameBoyInterface & at(uint32_t index) { return *m_consoles.at(index).console; }
+
+private:
+    static const uint16_t ROM_ENTRY_POINT;
+    static const uint64_t BOOT_CYCLES_MAX;
+
+    static const uint8_t BUTTON_COUNT;
+
+    struct Console {
+        std::shared_ptr<GameBoyInterface> console;
+
+        // The last frame that the console drew, since the console hands
+        // each one over exactly once.
+        ColorArray screen;
+
+        double time;
+    };
+
+    using Task = std::function<void(uint32_t)>;
+
+    Layout m_layout;
+    std::vector<Console> m_consoles;
+
+    GameBoyInterface::State m_start;
+    ColorArray m_startScreen;
+
+    // The pool hands out consoles one at a time, so the workers that get
+    // done first pick up the slack for consoles that take longer.
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::condition_variable m_done;
+
+    const Task *m_task;
+    std::atomic<uint32_t> m_next;
+    uint64_t m_batch;
+    uint32_t m_busy;
+    bool m_interrupt;
+
+    void run();
+    void dispatch(const Task & task);
+    void drain(const Task & task);
+
+    void press(Console & console, uint8_t action);
+    void write(Console & console, uint8_t *observation);
+};
+
+#endif /* VECENV_H_ */
@@ -0,0 +1,21 @@
+include(../build.pri)
+
+TEMPLATE = app
+
+CONFIG -= qt
+CONFIG -= core
+CONFIG -= gui
+
+CONFIG (asan) {
+    QMAKE_CXXFLAGS += -fsanitize=address
+    QMAKE_LFLAGS   += -fsanitize=address
+}
+
+unix: LIBS += -lpthread
+
+LIBS += -lhardware
+LIBS += -lutility
+
+TARGET = gbc-headless
+
+SOURCES += main.cpp
@@ -0,0 +1,473 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include "gameboyinterface.h"
+#include "scheduler.h"
+#include "vecenv.h"
+#include "movie.h"
+#include "configuration.h"
+#include "gbrgb.h"
+
+using std::string;
+using std::shared_ptr;
+using std::vector;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr double   FRAMES_PER_SECOND = 59.73;
+constexpr uint64_t DEFAULT_FRAMES    = 3600;
+
+// Each step of the batched benchmark looks like a typical training setup,
+// which holds each action for a few frames and looks at a quarter size
+// screen along with a few bytes of RAM.
+constexpr uint32_t STEP_FRAMES  = 4;
+constexpr uint8_t  STEP_SCALE   = 2;
+constexpr uint32_t STEP_WARMUP  = 60;
+
+struct Range {
+    const char *name;
+    uint16_t start;
+    uint16_t end;
+};
+
+// The regions that a game keeps its state in.  Only the currently mapped
+// banks are visible through the interface, so that's what gets checksummed.
+constexpr Range RANGES[] = {
+    { "wram", 0xC000, 0xDFFF },
+    { "xram", 0xA000, 0xBFFF },
+    { "hram", 0xFF80, 0xFFFE },
+};
+
+struct Options {
+    string rom;
+    uint64_t frames = DEFAULT_FRAMES;
+    string screenshot;
+    EmuMode mode = EmuMode::AUTO;
+    double speed = 0.0;
+    bool render = false;
+    bool fastBoot = false;
+    bool benchmark = false;
+    uint32_t instances = 0;
+    uint32_t batch = 0;
+    string movie;
+};
+
+void usage(const char *name)
+{
+    printf("usage: %s [-m auto|dmg|cgb] [-s free|<n>x] [-r] [-f] [-b] [-n instances] [-e instances] [-p movie] <rom> [frames] [screenshot.ppm]\n",
+           name);
+    printf("  -m  emulate the given model instead of the one the cartridge asks for\n");
+    printf("  -s  pace the emulator at a multiple of the real speed (e.g. 1.5x) instead of free running (which is deterministic)\n");
+    printf("  -r  render every frame instead of only the screenshot\n");
+    printf("  -f  skip the BIOS and start the cartridge right away\n");
+    printf("  -b  benchmark rendering the rom as both a DMG and a CGB\n");
+    printf("  -n  benchmark running 1, 2, 4, ... up to the given number of instances on a thread pool\n");
+    printf("  -e  benchmark stepping batches of 1, 2, 4, ... up to the given number of instances in lock step\n");
+    printf("  -p  play back a movie that was recorded with the rom as fast as possible\n");
+}
+
+bool parse(int argc, char **argv, Options & options)
+{
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if ("-r" == arg) {
+            options.render = true;
+        } else if ("-f" == arg) {
+            options.fastBoot = true;
+        } else if ("-b" == arg) {
+            options.benchmark = true;
+        } else if ("-m" == arg) {
+            if (++i >= argc) { return false; }
+
+            string model = argv[i];
+            if ("auto" == model)     { options.mode = EmuMode::AUTO; }
+            else if ("dmg" == model) { options.mode = EmuMode::DMG;  }
+            else if ("cgb" == model) { options.mode = EmuMode::CGB;  }
+            else { return false; }
+        } else if ("-n" == arg) {
+            if (++i >= argc) { return false; }
+
+            options.instances = uint32_t(strtoul(argv[i], nullptr, 10));
+            if (0 == options.instances) { return false; }
+        } else if ("-e" == arg) {
+            if (++i >= argc) { return false; }
+
+            options.batch = uint32_t(strtoul(argv[i], nullptr, 10));
+            if (0 == options.batch) { return false; }
+        } else if ("-p" == arg) {
+            if (++i >= argc) { return false; }
+
+            options.movie = argv[i];
+        } else if ("-s" == arg) {
+            if (++i >= argc) { return false; }
+
+            string speed = argv[i];
+            if ("free" == speed) {
+                options.speed = 0.0;
+            } else {
+                char *end = nullptr;
+                options.speed = strtod(speed.c_str(), &end);
+                if ((end == speed.c_str()) || (string("x") != end) || !(options.speed > 0.0)) {
+                    return false;
+                }
+            }
+        } else {
+            switch (positional++) {
+            case 0: options.rom = arg; break;
+            case 1: options.frames = strtoull(arg.c_str(), nullptr, 10); break;
+            case 2: options.screenshot = arg; break;
+            default: return false;
+            }
+        }
+    }
+    return (positional > 0) && (options.frames > 0);
+}
+
+uint32_t checksum(GameBoyInterface & console, const Range & range)
+{
+    vector<uint16_t> addresses;
+    for (uint32_t address = range.start; address <= range.end; address++) {
+        addresses.push_back(uint16_t(address));
+    }
+
+    // FNV-1a is more than good enough to tell two runs apart.
+    uint32_t hash = 0x811C9DC5;
+    for (uint8_t value : console.queueRead(addresses).get()) {
+        hash = (hash ^ value) * 0x01000193;
+    }
+    return hash;
+}
+
+bool screenshot(GameBoyInterface & console, const string & filename, std::function<void()> wait)
+{
+    // Headless instances only draw the frames that we ask for, so ask for
+    // one and wait for it to show up.
+    console.requestFrame();
+
+    ColorArray rgb;
+    while (rgb.empty()) {
+        wait();
+        rgb = console.getRGB();
+    }
+
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) { return false; }
+
+    fprintf(file, "P6 %d %d 255\n", GameBoyInterface::WIDTH, GameBoyInterface::HEIGHT);
+    for (const GB::RGB & pixel : rgb) {
+        fputc(pixel.red, file);
+        fputc(pixel.green, file);
+        fputc(pixel.blue, file);
+    }
+
+    fclose(file);
+    return true;
+}
+
+bool run(const Options & options, EmuMode mode)
+{
+    // The config file is deliberately left alone so that every run gets the
+    // same settings, and the default settings let the emulator free run.  The
+    // model and speed only get changed for this console.  A free run goes on
+    // nothing but emulated time, so that two runs of the same ROM always come
+    // out exactly the same.
+    bool paced = (options.speed > 0.0);
+
+    ConfigSnapshot config = ConfigSnapshot()
+        .with(ConfigKey::EMU_MODE, int(mode))
+        .with(ConfigKey::FAST_BOOT, options.fastBoot)
+        .with(ConfigKey::DETERMINISTIC, !paced);
+
+    shared_ptr<GameBoyInterface> console = GameBoyInterface::Instance(config);
+    console->setHeadless(!options.render);
+    console->setSpeed(options.speed);
+
+    if (!console->load(options.rom)) {
+        printf("Failed to load %s\n", options.rom.c_str());
+        return false;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+
+    // The console's own count leaves out the frames that the LCD was off
+    // for, which runFrame still runs.
+    uint64_t frames = 0;
+
+    bool captured = true;
+    if (paced) {
+        // Pacing only happens on the console's own thread, so the frame count
+        // is only close, and the checksums can't be compared between runs.
+        console->start();
+        while (console->getStatistics().frames < options.frames) {
+            std::this_thread::sleep_for(1ms);
+        }
+
+        if (!options.screenshot.empty()) {
+            captured = screenshot(*console, options.screenshot, [] { std::this_thread::sleep_for(1ms); });
+        }
+
+        console->stop();
+
+        frames = console->getStatistics().frames;
+    } else {
+        for (; frames < options.frames; frames++) {
+            console->runFrame();
+        }
+
+        // The screenshot is the first frame that the GPU draws after that,
+        // which is always the same one.
+        if (!options.screenshot.empty()) {
+            captured = screenshot(*console, options.screenshot, [&] { console->runFrame(); frames++; });
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    GameBoyInterface::Statistics stats = console->getStatistics();
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    double fps     = double(frames) / seconds;
+
+    printf("rom:     %s\n", options.rom.c_str());
+    printf("frames:  %llu\n", static_cast<unsigned long long>(frames));
+    printf("elapsed: %.3f s\n", seconds);
+    printf("frame:   %.3f ms\n", (seconds * 1000.0) / double(frames));
+    printf("speed:   %.1f fps (%.2fx)\n", fps, fps / FRAMES_PER_SECOND);
+    printf("pacing:  %.3f ms mean, %.3f ms jitter, %.3f ms max\n",
+           stats.frameTime, stats.frameJitter, stats.frameTimeMax);
+    printf("boot:    %.3f ms (%llu cycles) to the first frame\n",
+           stats.firstFrameTime, static_cast<unsigned long long>(stats.firstFrameTicks));
+    printf("lines:   %llu drawn, %llu reused\n",
+           static_cast<unsigned long long>(stats.linesDrawn),
+           static_cast<unsigned long long>(stats.linesReused));
+
+    // This is the last frame that was actually drawn, which is the
+    // screenshot when there is one, so it works as a golden image checksum.
+    GameBoyInterface::FrameInfo frame = console->getFrameInfo();
+    if (0 != frame.sequence) {
+        printf("image:   0x%016llx (frame %llu)\n",
+               static_cast<unsigned long long>(frame.hash),
+               static_cast<unsigned long long>(frame.sequence));
+    }
+
+    for (const Range & range : RANGES) {
+        printf("%s:    0x%08x\n", range.name, checksum(*console, range));
+    }
+
+    if (!captured) {
+        printf("Failed to write %s\n", options.screenshot.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool scale(const Options & options)
+{
+    ConfigSnapshot config = ConfigSnapshot()
+        .with(ConfigKey::EMU_MODE, int(options.mode))
+        .with(ConfigKey::FAST_BOOT, options.fastBoot);
+
+    vector<uint32_t> counts;
+    for (uint32_t count = 1; count < options.instances; count *= 2) {
+        counts.push_back(count);
+    }
+    counts.push_back(options.instances);
+
+    printf("rom:     %s\n", options.rom.c_str());
+    printf("\n");
+    printf("instances  workers   frames/s   per instance\n");
+
+    for (uint32_t count : counts) {
+        vector<shared_ptr<GameBoyInterface>> consoles;
+        for (uint32_t i = 0; i < count; i++) {
+            shared_ptr<GameBoyInterface> console = GameBoyInterface::Instance(config);
+            console->setHeadless(!options.render);
+            console->setSpeed(options.speed);
+
+            if (!console->load(options.rom)) {
+                printf("Failed to load %s\n", options.rom.c_str());
+                return false;
+            }
+            consoles.push_back(console);
+        }
+
+        // Every instance runs the same number of frames on average, which
+        // is all that the pool promises when they're free running.
+        Scheduler scheduler;
+        uint64_t total = uint64_t(count) * options.frames;
+
+        auto begin = std::chrono::steady_clock::now();
+
+        for (auto & console : consoles) { scheduler.add(console); }
+        while (scheduler.getStatistics().frames < total) {
+            std::this_thread::sleep_for(1ms);
+        }
+
+        // The consoles keep going until they're stopped, so the frames and
+        // the time have to be taken at the same point.
+        uint64_t frames = scheduler.getStatistics().frames;
+        auto end = std::chrono::steady_clock::now();
+
+        for (auto & console : consoles) { console->stop(); }
+
+        double seconds = std::chrono::duration<double>(end - begin).count();
+        double fps     = double(frames) / seconds;
+
+        printf("%9u  %7u  %9.1f  %9.1f (%.2fx)\n",
+               count, scheduler.workers(), fps, fps / count, fps / count / FRAMES_PER_SECOND);
+    }
+    return true;
+}
+
+bool step(const Options & options)
+{
+    ConfigSnapshot config = ConfigSnapshot()
+        .with(ConfigKey::EMU_MODE, int(options.mode))
+        .with(ConfigKey::FAST_BOOT, options.fastBoot);
+
+    VecEnv::Layout layout;
+    layout.scale = STEP_SCALE;
+    for (const Range & range : RANGES) { layout.addresses.push_back(range.start); }
+
+    vector<uint32_t> counts;
+    for (uint32_t count = 1; count < options.batch; count *= 2) {
+        counts.push_back(count);
+    }
+    counts.push_back(options.batch);
+
+    printf("rom:     %s\n", options.rom.c_str());
+    printf("\n");
+    printf("instances  workers   frames/s    step ms    mean ms    slowest ms\n");
+
+    for (uint32_t count : counts) {
+        VecEnv env(count, layout, config);
+        if (!env.load(options.rom, STEP_WARMUP)) {
+            printf("Failed to load %s\n", options.rom.c_str());
+            return false;
+        }
+
+        // The buttons change every step so that the games have something to
+        // do, and every instance gets a different one.
+        vector<uint8_t> actions(count);
+        vector<uint8_t> observations(count * env.observationSize());
+
+        uint64_t steps = std::max<uint64_t>(1, options.frames / STEP_FRAMES);
+
+        VecEnv::Timing total = { 0.0, 0.0, 0.0, 0 };
+        for (uint64_t i = 0; i < steps; i++) {
+            for (uint32_t j = 0; j < count; j++) {
+                actions[j] = uint8_t(1 << ((i + j) % 8));
+            }
+
+            VecEnv::Timing timing = env.step(actions.data(), STEP_FRAMES, observations.data());
+            total.elapsed += timing.elapsed;
+            total.mean    += timing.mean;
+            total.slowest += timing.slowest;
+            total.frames  += timing.frames;
+        }
+
+        double fps = (double(total.frames) * 1000.0) / total.elapsed;
+
+        printf("%9u  %7u  %9.1f  %9.3f  %9.3f  %12.3f\n",
+               count, env.workers(), fps,
+               total.elapsed / double(steps), total.mean / double(steps), total.slowest / double(steps));
+    }
+    return true;
+}
+
+bool play(const Options & options)
+{
+    // Movies only play back the same way on consoles that run on nothing
+    // but emulated time.
+    ConfigSnapshot config = ConfigSnapshot()
+        .with(ConfigKey::EMU_MODE, int(options.mode))
+        .with(ConfigKey::DETERMINISTIC, true);
+
+    shared_ptr<GameBoyInterface> console = GameBoyInterface::Instance(config);
+    console->setHeadless(!options.render);
+
+    if (!console->load(options.rom)) {
+        printf("Failed to load %s\n", options.rom.c_str());
+        return false;
+    }
+
+    MoviePlayer player(*console);
+    if (!player.open(options.movie)) {
+        printf("Failed to load %s\n", options.movie.c_str());
+        return false;
+    }
+
+    const Movie & movie = player.movie();
+
+    auto begin = std::chrono::steady_clock::now();
+    while (!player.isDone()) {
+        player.play(movie.frames() + 1);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    double fps     = double(movie.frames()) / seconds;
+
+    printf("rom:     %s\n", options.rom.c_str());
+    printf("movie:   %s\n", options.movie.c_str());
+    printf("frames:  %llu\n", static_cast<unsigned long long>(movie.frames()));
+    printf("events:  %zu (%zu checkpoints)\n", movie.events().size(), movie.checkpoints().size());
+    printf("elapsed: %.3f s\n", seconds);
+    printf("speed:   %.1f fps (%.2fx)\n", fps, fps / FRAMES_PER_SECOND);
+
+    for (const Range & range : RANGES) {
+        printf("%s:    0x%08x\n", range.name, checksum(*console, range));
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parse(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (options.instances > 0) {
+        return scale(options) ? 0 : 1;
+    }
+
+    if (options.batch > 0) {
+        return step(options) ? 0 : 1;
+    }
+
+    if (!options.movie.empty()) {
+        return play(options) ? 0 : 1;
+    }
+
+    if (!options.benchmark) {
+        return run(options, options.mode) ? 0 : 1;
+    }
+
+    // Every frame has to be drawn for the numbers to mean anything, and both
+    // models run the same rom so that the only difference is the renderer.
+    options.render = true;
+
+    bool passed = true;
+    for (EmuMode mode : { EmuMode::DMG, EmuMode::CGB }) {
+        printf("model:   %s\n", (EmuMode::CGB == mode) ? "cgb" : "dmg");
+        passed &= run(options, mode);
+        printf("\n");
+    }
+    return passed ? 0 : 1;
+}
@@ -63,6 +63,10 @@ GameServer::GameServer(int http, int websock)
 {
     string filename = Configuration::getString(ConfigKey::ROM);
     if (m_console) {
+        // The websocket only grabs a frame every time the client acks the
+        // previous one, so don't bother rendering frames nobody picks up.
+        m_console->setFrameSkip(GameBoyInterface::FRAMESKIP_AUTO);
+
         m_console->load(filename);
         m_console->start();
     }
@@ -330,13 +334,37 @@ void GameServer::websocket()
         if (INVALID == conn) { continue; }
 
         if (handshake(conn)) {
+            std::optional<uint64_t> sent;
+            uint64_t taken = 0;
             while (true) {
-                auto payload = m_console->getRGB();
-                if (payload.empty()) { continue; }
+                GameBoyInterface::FrameInfo frame = m_console->getFrameInfo();
+                if (frame.sequence == taken) {
+                    std::this_thread::sleep_for(33ms);
+                    continue;
+                }
+
+                // Every new frame has to be taken, or a GPU that's skipping
+                // frames never draws another one.  The hash has to be the one
+                // that goes with the pixels, which might not be the frame
+                // that we just looked at.
+                auto payload = m_console->getRGB(frame);
+                if (payload.empty()) {
+                    std::this_thread::sleep_for(33ms);
+                    continue;
+                }
+                taken = frame.sequence;
+
+                // Don't bother sending the client the same picture twice, just
+                // wait around for something on the screen to change.
+                if (sent && (*sent == frame.hash)) {
+                    std::this_thread::sleep_for(33ms);
+                    continue;
+                }
 
                 if (!send(conn, payload)) {
                     break;
                 }
+                sent = frame.hash;
 
                 std::this_thread::sleep_for(33ms);
 
@@ -8,6 +8,7 @@ SUBDIRS += utility
 SUBDIRS += hardware
 SUBDIRS += ipc
 SUBDIRS += ui
+SUBDIRS += headless
 
 SERVER=$$(SERVER_BUILD)
 !isEmpty(SERVER) {
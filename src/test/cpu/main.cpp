@@ -14,6 +14,8 @@ public:
 protected:
     void testInit();
     void testSwap();
+    void testSpeedSwitch();
+    void testInterrupts();
 
 private:
     MemoryController m_memory;
@@ -43,3 +45,79 @@ void CpuTest::testSwap()
     EXPECT_EQ(swapped, m_memory.read(WORKING_RAM_OFFSET));
 }
 TEST_F(CpuTest, Swap) { testSwap(); }
+
+void CpuTest::testSpeedSwitch()
+{
+    // Nothing happens without a switch being requested first.
+    m_memory.write(CGB_SPEED_SWITCH_ADDRESS, 0x00);
+    m_cpu.stop();
+    EXPECT_EQ(TimerModule::SPEED_NORMAL, m_cpu.speed());
+    EXPECT_EQ(0u, m_clock.ticks());
+
+    m_memory.write(CGB_SPEED_SWITCH_ADDRESS, Processor::SPEED_SWITCH_PREPARE);
+    m_cpu.stop();
+    EXPECT_EQ(TimerModule::SPEED_DOUBLE, m_cpu.speed());
+    EXPECT_EQ(Processor::SPEED_SWITCH_CURRENT, m_memory.read(CGB_SPEED_SWITCH_ADDRESS));
+
+    // The switch takes the same number of machine cycles either way, which
+    // are half as long in double speed mode.
+    uint32_t ticks = Processor::SPEED_SWITCH_CYCLES * (Processor::CYCLES_PER_TICK / 2);
+    EXPECT_EQ(ticks, m_clock.ticks());
+
+    m_memory.write(CGB_SPEED_SWITCH_ADDRESS, Processor::SPEED_SWITCH_CURRENT | Processor::SPEED_SWITCH_PREPARE);
+    m_cpu.stop();
+    EXPECT_EQ(TimerModule::SPEED_NORMAL, m_cpu.speed());
+    EXPECT_EQ(0x00, m_memory.read(CGB_SPEED_SWITCH_ADDRESS));
+}
+TEST_F(CpuTest, SpeedSwitch) { testSpeedSwitch(); }
+
+void CpuTest::testInterrupts()
+{
+    InterruptController & interrupts = m_memory.interrupts();
+
+    m_cpu.m_sp = WORKING_RAM_OFFSET + 0x100;
+    m_cpu.m_pc = 0x1234;
+
+    interrupts.disable();
+    interrupts.writeMask(0x1F);
+    EXPECT_FALSE(interrupts.isPending());
+
+    interrupts.raise(InterruptMask::TIMER);
+    interrupts.raise(InterruptMask::LCD);
+    EXPECT_TRUE(interrupts.isPending());
+
+    // Nothing gets serviced while interrupts are off.
+    EXPECT_FALSE(m_cpu.interrupt());
+    EXPECT_EQ(0x1234, m_cpu.m_pc);
+
+    // EI doesn't take effect until after the instruction that follows it.
+    m_cpu.OPCODES[0xFB].handler();
+    EXPECT_FALSE(m_cpu.interrupt());
+    EXPECT_TRUE(interrupts.isEnabled());
+
+    // The LCD has a higher priority than the timer.
+    EXPECT_TRUE(m_cpu.interrupt());
+    EXPECT_EQ(uint16_t(InterruptVector::LCD), m_cpu.m_pc);
+    EXPECT_EQ(uint8_t(InterruptMask::TIMER), interrupts.status());
+    EXPECT_FALSE(interrupts.isEnabled());
+
+    // RETI turns them back on right away.
+    m_cpu.OPCODES[0xD9].handler();
+    EXPECT_EQ(0x1234, m_cpu.m_pc);
+    EXPECT_TRUE(m_cpu.interrupt());
+    EXPECT_EQ(uint16_t(InterruptVector::TIMER), m_cpu.m_pc);
+    EXPECT_FALSE(interrupts.isPending());
+
+    // DI cancels an EI that hasn't taken effect yet.
+    interrupts.raise(InterruptMask::JOYPAD);
+    m_cpu.OPCODES[0xFB].handler();
+    m_cpu.OPCODES[0xF3].handler();
+    EXPECT_FALSE(m_cpu.interrupt());
+    EXPECT_FALSE(interrupts.isEnabled());
+
+    // A halt still wakes up for it though.
+    m_cpu.m_halted = true;
+    EXPECT_TRUE(m_cpu.interrupt());
+    EXPECT_EQ(uint16_t(InterruptVector::TIMER), m_cpu.m_pc);
+}
+TEST_F(CpuTest, Interrupts) { testInterrupts(); }
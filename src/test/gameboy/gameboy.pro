@@ -0,0 +1,6 @@
+include(../test.pri)
+
+LIBS += -lhardware
+LIBS += -lutility
+
+TARGET = gameboytest
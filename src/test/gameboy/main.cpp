@@ -0,0 +1,1766 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <set>
+
+#include "gameboyinterface.h"
+#include "configuration.h"
+#include "scheduler.h"
+#include "vecenv.h"
+#include "movie.h"
+#include "util.h"
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+
+class GameBoyTest : public ::testing::Test
+{
+protected:
+    void TearDown() override;
+
+    void start(EmuSpeed speed);
+    void create(EmuSpeed speed);
+
+    void testReadLatency(EmuSpeed speed);
+    void testWriteRead();
+    void testBatchedWriteRead();
+    void testCommandHandoff();
+    void testPausedWriteRead();
+    void testStopWhileHalted();
+    void testCallback();
+    void testConfiguration();
+    void testScheduler();
+    void testRunFrame();
+    void testRunCycles();
+    void testRunUntil();
+    void testSaveState();
+    void testVecEnv();
+    void testVecEnvFastBoot();
+    void testMemorySpans();
+    void testReplay();
+    void testMovie();
+    void testJoyPad();
+    void testDoubleSpeed();
+    void testFastBoot();
+    void testDisassembly();
+    void testLcdTiming();
+    void testLcdDisable();
+    void testLineCache();
+    void testColors();
+    void testThreadedRendering();
+    void testFrameSkip();
+    void testHeadless();
+    void testFrameTiming(EmuSpeed speed, double multiplier);
+
+    shared_ptr<GameBoyInterface> m_console;
+
+private:
+    static const string ROM;
+    static const size_t ROM_SIZE;
+    static const uint16_t ROM_ENTRY_POINT;
+    static const uint16_t ROM_LOGO_OFFSET;
+    static const uint16_t ROM_TITLE_OFFSET;
+    static const uint16_t ROM_CGB_OFFSET;
+    static const uint16_t ROM_TYPE_OFFSET;
+    static const uint16_t ROM_CHECKSUM_OFFSET;
+    static const vector<uint8_t> ROM_LOGO;
+
+    static const uint64_t FRAME_CYCLES;
+    static const uint64_t INSTRUCTION_CYCLES_MAX;
+    static const uint64_t BOOT_CYCLES_MAX;
+
+    static const uint16_t ADDRESS;
+    static const uint16_t JOYPAD_ADDRESS;
+    static const uint16_t INTERRUPT_ADDRESS;
+    static const uint8_t JOYPAD_INTERRUPT;
+    static const uint16_t DIVIDER_ADDRESS;
+    static const uint16_t SPEED_ADDRESS;
+    static const uint16_t LCD_CONTROL_ADDRESS;
+    static const uint16_t LCD_STATUS_ADDRESS;
+    static const uint16_t SCANLINE_ADDRESS;
+    static const uint16_t SCANLINE_COMPARE_ADDRESS;
+    static const uint16_t SCROLL_X_ADDRESS;
+    static const uint16_t BG_PALETTE_DMG_ADDRESS;
+
+    static const uint16_t NOP_PROGRAM_OFFSET;
+    static const vector<uint8_t> NOP_PROGRAM;
+
+    static const vector<uint8_t> SPEED_PROGRAM;
+    static const uint16_t SPEED_PROGRAM_OFFSET;
+    static const uint16_t SPEED_PROGRAM_LOOP;
+
+    static const vector<uint8_t> BOOT_PROGRAM;
+    static const uint16_t BOOT_PROGRAM_OFFSET;
+    static const uint16_t BOOT_PROGRAM_LOOP;
+    static const uint16_t BOOT_STACK_ADDRESS;
+    static const uint16_t BG_PALETTE_ADDRESS;
+    static const uint16_t SPRITE_PALETTE_ADDRESS;
+    static const uint8_t PALETTE_BYTES;
+
+    static const uint16_t ROM_SIZE_OFFSET;
+    static const vector<uint8_t> BANKED_PROGRAM;
+    static const uint16_t BANKED_PROGRAM_DATA;
+    static const vector<uint8_t> BANKED_ROUTINE;
+    static const uint16_t BANKED_ROUTINE_ADDRESS;
+
+    static const uint32_t READ_COUNT;
+    static const double READ_LATENCY_MAX_US;
+
+    static const double CLOCK_HZ;
+    static const double FRAME_TIME_TOLERANCE;
+
+    static const string REPLAY_ROM;
+    static const string REPLAY_TITLE;
+    static const vector<uint8_t> REPLAY_PROGRAM;
+    static const uint16_t REPLAY_PROGRAM_OFFSET;
+    static const uint32_t REPLAY_FRAMES;
+    static const uint32_t REPLAY_RTC_START;
+
+    static const string MOVIE;
+    static const uint32_t MOVIE_FRAMES;
+    static const uint32_t MOVIE_CHECKPOINT_FRAMES;
+
+    // A blank cartridge with a header that's good enough for the boot ROM to
+    // hand off to it, and writing it out once the code is in it.
+    static vector<uint8_t> cartridge(uint8_t type, const string & title);
+    static void save(const string & filename, vector<uint8_t> image);
+
+    static vector<uint8_t> replayCartridge();
+
+    // Skips the BIOS (which leaves the logo on the screen on a DMG) and runs
+    // until the CPU is in the middle of the NOPs.
+    void bootNops(ConfigSnapshot config, uint8_t flag = 0x00);
+
+    vector<uint64_t> replay(EmuSpeed speed, bool started, vector<uint8_t> & ram);
+};
+
+// All that the cartridge does is spin in a loop (JR -2) at the entry point,
+// which keeps the CPU thread busy without touching any memory.
+const string GameBoyTest::ROM = "gameboytest.gb";
+const size_t GameBoyTest::ROM_SIZE = 0x8000;
+const uint16_t GameBoyTest::ROM_ENTRY_POINT = 0x0100;
+const uint16_t GameBoyTest::ROM_LOGO_OFFSET = 0x0104;
+const uint16_t GameBoyTest::ROM_TITLE_OFFSET = 0x0134;
+const uint16_t GameBoyTest::ROM_CGB_OFFSET = 0x0143;
+const uint16_t GameBoyTest::ROM_TYPE_OFFSET = 0x0147;
+const uint16_t GameBoyTest::ROM_CHECKSUM_OFFSET = 0x014D;
+
+const vector<uint8_t> GameBoyTest::ROM_LOGO = {
+    0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03,
+    0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D, 0x00, 0x08,
+    0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E,
+    0xE6, 0xDD, 0xDD, 0xD9, 0x99, 0xBB, 0xBB, 0x67, 0x63,
+    0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB,
+    0xB9, 0x33, 0x3E,
+};
+
+// Clock cycles, at ~4MHz.  No instruction takes longer than a CALL, and the
+// boot ROM takes about 330 frames to get to the cartridge.
+const uint64_t GameBoyTest::FRAME_CYCLES = 70224;
+const uint64_t GameBoyTest::INSTRUCTION_CYCLES_MAX = 24;
+const uint64_t GameBoyTest::BOOT_CYCLES_MAX = 600 * FRAME_CYCLES;
+
+// Somewhere at the top of working RAM.
+const uint16_t GameBoyTest::ADDRESS = 0xDF00;
+
+const uint16_t GameBoyTest::JOYPAD_ADDRESS = 0xFF00;
+const uint16_t GameBoyTest::INTERRUPT_ADDRESS = 0xFF0F;
+const uint8_t GameBoyTest::JOYPAD_INTERRUPT = 0x10;
+const uint16_t GameBoyTest::DIVIDER_ADDRESS = 0xFF04;
+const uint16_t GameBoyTest::SPEED_ADDRESS = 0xFF4D;
+const uint16_t GameBoyTest::LCD_CONTROL_ADDRESS = 0xFF40;
+const uint16_t GameBoyTest::LCD_STATUS_ADDRESS = 0xFF41;
+const uint16_t GameBoyTest::SCANLINE_ADDRESS = 0xFF44;
+const uint16_t GameBoyTest::SCANLINE_COMPARE_ADDRESS = 0xFF45;
+const uint16_t GameBoyTest::SCROLL_X_ADDRESS = 0xFF43;
+const uint16_t GameBoyTest::BG_PALETTE_DMG_ADDRESS = 0xFF47;
+
+// Runs NOPs through the rest of the ROM and then jumps back to the start of
+// them with a JP (HL), so every instruction after the first one takes the
+// same 4 cycles and runCycles can stop on any multiple of 4.
+const uint16_t GameBoyTest::NOP_PROGRAM_OFFSET = 0x0150;
+const vector<uint8_t> GameBoyTest::NOP_PROGRAM = {
+    0x21, 0x53, 0x01, // LD HL, 0x0153
+};
+
+// Asks for double speed, runs a STOP to switch over to it, and then spins.
+const uint16_t GameBoyTest::SPEED_PROGRAM_OFFSET = 0x0150;
+const uint16_t GameBoyTest::SPEED_PROGRAM_LOOP = 0x0156;
+const vector<uint8_t> GameBoyTest::SPEED_PROGRAM = {
+    0x3E, 0x01, // LD A, 0x01
+    0xE0, 0x4D, // LDH (0x4D), A
+    0x10, 0x00, // STOP
+    0x18, 0xFE, // JR -2
+};
+
+// Pushes every register on to the stack (which is at the top of high RAM)
+// and then spins.
+const uint16_t GameBoyTest::BOOT_PROGRAM_OFFSET = 0x0150;
+const uint16_t GameBoyTest::BOOT_PROGRAM_LOOP = 0x0154;
+const uint16_t GameBoyTest::BOOT_STACK_ADDRESS = 0xFFF6;
+const vector<uint8_t> GameBoyTest::BOOT_PROGRAM = {
+    0xF5,       // PUSH AF
+    0xC5,       // PUSH BC
+    0xD5,       // PUSH DE
+    0xE5,       // PUSH HL
+    0x18, 0xFE, // JR -2
+};
+
+// The index registers, which are each followed by the data register.
+const uint16_t GameBoyTest::BG_PALETTE_ADDRESS = 0xFF68;
+const uint16_t GameBoyTest::SPRITE_PALETTE_ADDRESS = 0xFF6A;
+const uint8_t GameBoyTest::PALETTE_BYTES = 64;
+
+// Switches bank 2 in, calls in to it, and then spins.  The bytes after the
+// loop look like code, but nothing ever gets there.
+const uint16_t GameBoyTest::ROM_SIZE_OFFSET = 0x0148;
+const uint16_t GameBoyTest::BANKED_PROGRAM_DATA = 0x015A;
+const vector<uint8_t> GameBoyTest::BANKED_PROGRAM = {
+    0x3E, 0x02,       // LD A, 0x02
+    0xEA, 0x00, 0x20, // LD (0x2000), A
+    0xCD, 0x00, 0x40, // CALL 0x4000
+    0x18, 0xFE,       // JR -2
+    0x3E, 0x01,       // LD A, 0x01
+};
+
+const uint16_t GameBoyTest::BANKED_ROUTINE_ADDRESS = 0x4000;
+const vector<uint8_t> GameBoyTest::BANKED_ROUTINE = {
+    0x21, 0x00, 0xC0, // LD HL, 0xC000
+    0xCB, 0x37,       // SWAP A
+    0xC9,             // RET
+};
+
+const uint32_t GameBoyTest::READ_COUNT = 10000;
+
+// Pausing used to poll every 5ms, so anything close to that means that a
+// read is waiting on a sleep somewhere instead of being woken up.
+const double GameBoyTest::READ_LATENCY_MAX_US = 1000.0;
+
+// The mean frame time has to land within 10% of the frame period, which
+// leaves plenty of room for a busy machine to miss the odd frame.
+const double GameBoyTest::CLOCK_HZ = 4194304.0;
+const double GameBoyTest::FRAME_TIME_TOLERANCE = 0.1;
+
+// The replay cartridge is an MBC3 with a clock.  It copies the seconds out of
+// the clock and adds up the direction keys that are held down in to the first
+// two bytes of working RAM, over and over again.
+const string GameBoyTest::REPLAY_ROM = "replaytest.gb";
+const string GameBoyTest::REPLAY_TITLE = "REPLAYTEST";
+const uint16_t GameBoyTest::REPLAY_PROGRAM_OFFSET = 0x0150;
+
+const vector<uint8_t> GameBoyTest::REPLAY_PROGRAM = {
+    0x3E, 0x0A,         // LD A, 0x0A
+    0xEA, 0x00, 0x00,   // LD (0x0000), A   ; enable the RAM and the clock
+    0x3E, 0x08,         // LD A, 0x08
+    0xEA, 0x00, 0x40,   // LD (0x4000), A   ; select the seconds
+    0xAF,               // XOR A            ; loop:
+    0xEA, 0x00, 0x60,   // LD (0x6000), A
+    0x3C,               // INC A
+    0xEA, 0x00, 0x60,   // LD (0x6000), A   ; latch the clock
+    0xFA, 0x00, 0xA0,   // LD A, (0xA000)
+    0xEA, 0x00, 0xC0,   // LD (0xC000), A
+    0x3E, 0x20,         // LD A, 0x20
+    0xE0, 0x00,         // LDH (0x00), A    ; select the direction keys
+    0xF0, 0x00,         // LDH A, (0x00)
+    0x2F,               // CPL
+    0xE6, 0x0F,         // AND 0x0F
+    0x47,               // LD B, A
+    0xFA, 0x01, 0xC0,   // LD A, (0xC001)
+    0x80,               // ADD A, B
+    0xEA, 0x01, 0xC0,   // LD (0xC001), A
+    0x18, 0xDF,         // JR loop
+};
+
+// The boot ROM takes up most of the frames, and the clock rolls over to the
+// next minute while it's running.
+const uint32_t GameBoyTest::REPLAY_FRAMES = 400;
+const uint32_t GameBoyTest::REPLAY_RTC_START = 59;
+
+const string GameBoyTest::MOVIE = "gameboytest.movie";
+const uint32_t GameBoyTest::MOVIE_FRAMES = 500;
+const uint32_t GameBoyTest::MOVIE_CHECKPOINT_FRAMES = 100;
+
+void GameBoyTest::start(EmuSpeed speed)
+{
+    create(speed);
+    if (m_console) { m_console->start(); }
+}
+
+void GameBoyTest::create(EmuSpeed speed)
+{
+    // MBC1 with no RAM.
+    vector<uint8_t> image = cartridge(0x01, "");
+    image[ROM_ENTRY_POINT]     = 0x18;
+    image[ROM_ENTRY_POINT + 1] = 0xFE;
+
+    save(ROM, image);
+
+    // Only this console runs at the requested speed, and the config file is
+    // left alone.
+    m_console = GameBoyInterface::Instance(ConfigSnapshot().with(ConfigKey::SPEED, int(speed)));
+    ASSERT_TRUE(m_console->load(ROM));
+}
+
+vector<uint8_t> GameBoyTest::cartridge(uint8_t type, const string & title)
+{
+    vector<uint8_t> image(ROM_SIZE, 0x00);
+
+    std::copy(ROM_LOGO.begin(), ROM_LOGO.end(), image.begin() + ROM_LOGO_OFFSET);
+    std::copy(title.begin(), title.end(), image.begin() + ROM_TITLE_OFFSET);
+
+    image[ROM_TYPE_OFFSET] = type;
+    return image;
+}
+
+void GameBoyTest::save(const string & filename, vector<uint8_t> image)
+{
+    uint8_t checksum = 0;
+    for (uint16_t i = ROM_LOGO_OFFSET + uint16_t(ROM_LOGO.size()); i < ROM_CHECKSUM_OFFSET; i++) {
+        checksum = uint8_t(checksum - image[i] - 1);
+    }
+    image[ROM_CHECKSUM_OFFSET] = checksum;
+
+    FILE *file = fopen(filename.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+
+    fwrite(image.data(), 1, image.size(), file);
+    fclose(file);
+}
+
+void GameBoyTest::TearDown()
+{
+    if (m_console) { m_console->stop(); }
+
+    remove(ROM.c_str());
+}
+
+void GameBoyTest::testReadLatency(EmuSpeed speed)
+{
+    start(speed);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < READ_COUNT; i++) {
+        m_console->read(ADDRESS);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double latency = std::chrono::duration<double, std::micro>(end - begin).count() / READ_COUNT;
+    RecordProperty("latency_us", std::to_string(latency));
+
+    EXPECT_LT(latency, READ_LATENCY_MAX_US);
+}
+TEST_F(GameBoyTest, ReadLatencyFree) { testReadLatency(EmuSpeed::FREE); }
+TEST_F(GameBoyTest, ReadLatencyPaced) { testReadLatency(EmuSpeed::NORMAL); }
+
+void GameBoyTest::testWriteRead()
+{
+    start(EmuSpeed::NORMAL);
+
+    // Nothing that the cartridge runs touches working RAM, so whatever we
+    // write has to be what we read back.
+    for (uint32_t i = 0; i < 256; i++) {
+        m_console->write(ADDRESS, uint8_t(i));
+        EXPECT_EQ(m_console->read(ADDRESS), uint8_t(i));
+    }
+}
+TEST_F(GameBoyTest, WriteRead) { testWriteRead(); }
+
+void GameBoyTest::testBatchedWriteRead()
+{
+    start(EmuSpeed::NORMAL);
+
+    vector<uint16_t> addresses;
+    vector<GameBoyInterface::MemoryWrite> writes;
+    for (uint32_t i = 0; i < 256; i++) {
+        addresses.push_back(uint16_t(ADDRESS + i));
+        writes.push_back({ uint16_t(ADDRESS + i), uint8_t(0xFF - i) });
+    }
+
+    // Commands run in the order that they're queued, so the read has to see
+    // everything that the write did even though we never wait in between.
+    std::future<void> written = m_console->queueWrite(writes);
+    std::future<vector<uint8_t>> read = m_console->queueRead(addresses);
+
+    written.get();
+    vector<uint8_t> values = read.get();
+
+    ASSERT_EQ(values.size(), addresses.size());
+    for (uint32_t i = 0; i < values.size(); i++) {
+        EXPECT_EQ(values[i], uint8_t(0xFF - i));
+    }
+}
+TEST_F(GameBoyTest, BatchedWriteRead) { testBatchedWriteRead(); }
+
+void GameBoyTest::testCommandHandoff()
+{
+    create(EmuSpeed::FREE);
+
+    // Commands run on the caller's thread while nobody is running the CPU,
+    // and on whichever thread is running it otherwise.  Going back and forth
+    // between the two while they're being queued can't lose any of them.
+    std::atomic<bool> done(false);
+    std::thread runner([&] {
+        for (uint32_t i = 0; !done.load(); i++) {
+            if (i % 16) {
+                m_console->runCycles(FRAME_CYCLES / 16);
+            } else {
+                m_console->start();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                m_console->stop();
+            }
+        }
+    });
+
+    for (uint32_t i = 0; i < 4096; i++) {
+        m_console->write(ADDRESS, uint8_t(i));
+        EXPECT_EQ(m_console->read(ADDRESS), uint8_t(i));
+    }
+
+    done.store(true);
+    runner.join();
+}
+TEST_F(GameBoyTest, CommandHandoff) { testCommandHandoff(); }
+
+void GameBoyTest::testPausedWriteRead()
+{
+    start(EmuSpeed::NORMAL);
+
+    // The old callback goes away while the emulator is halted, so whatever
+    // it leaves behind gets a look at memory (from another thread) while the
+    // CPU thread is paused.
+    struct Paused {
+        std::function<void()> gone;
+        ~Paused() { gone(); }
+    };
+
+    GameBoyInterface *console = m_console.get();
+    std::future<bool> done;
+    bool finished = false;
+
+    auto paused = std::make_shared<Paused>();
+    paused->gone = [&] {
+        done = std::async(std::launch::async, [console] {
+            for (uint32_t i = 0; i < 256; i++) {
+                console->write(ADDRESS, uint8_t(i));
+                if (console->read(ADDRESS) != uint8_t(i)) { return false; }
+            }
+            return true;
+        });
+
+        // Nothing brings the CPU thread back to run the commands until we're
+        // done, so waiting any longer than this would be waiting forever.
+        finished = (std::future_status::ready == done.wait_for(std::chrono::seconds(5)));
+    };
+
+    m_console->setFrameCallback([paused](uint64_t) { });
+    paused.reset();
+    m_console->setFrameCallback(nullptr);
+
+    // Stopping runs whatever got stranded, so that we aren't stuck waiting
+    // on it.
+    if (!finished) { m_console->stop(); }
+
+    EXPECT_TRUE(finished);
+    EXPECT_TRUE(done.get());
+}
+TEST_F(GameBoyTest, PausedWriteRead) { testPausedWriteRead(); }
+
+void GameBoyTest::testStopWhileHalted()
+{
+    start(EmuSpeed::FREE);
+
+    // Same as above, the old callback goes away while the emulator is
+    // halted.  Stopping (and starting back up) in the mean time can't let the
+    // CPU get going again until the halt is over.
+    struct Halted {
+        std::function<void()> gone;
+        ~Halted() { gone(); }
+    };
+
+    GameBoyInterface *console = m_console.get();
+    uint8_t before = 0;
+    uint8_t after = 0;
+
+    auto halted = std::make_shared<Halted>();
+    halted->gone = [&] {
+        console->stop();
+        console->start();
+
+        before = console->read(DIVIDER_ADDRESS);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        after = console->read(DIVIDER_ADDRESS);
+    };
+
+    m_console->setFrameCallback([halted](uint64_t) { });
+    halted.reset();
+    m_console->setFrameCallback(nullptr);
+
+    EXPECT_EQ(after, before);
+
+    // Once it is, the console is running again.
+    before = m_console->read(DIVIDER_ADDRESS);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_NE(m_console->read(DIVIDER_ADDRESS), before);
+}
+TEST_F(GameBoyTest, StopWhileHalted) { testStopWhileHalted(); }
+
+void GameBoyTest::testCallback()
+{
+    start(EmuSpeed::FREE);
+
+    std::promise<vector<uint8_t>> promise;
+    m_console->write(ADDRESS, 0xA5);
+    m_console->queueRead({ ADDRESS }, [&promise](vector<uint8_t> values) {
+        promise.set_value(values);
+    });
+
+    vector<uint8_t> values = promise.get_future().get();
+    ASSERT_EQ(values.size(), 1u);
+    EXPECT_EQ(values.front(), 0xA5);
+
+    // A stopped console has nobody to drain the queue, so commands have to
+    // run right away on the thread that queued them.
+    m_console->stop();
+
+    bool called = false;
+    m_console->queueCallback([&called]() { called = true; });
+    EXPECT_TRUE(called);
+}
+TEST_F(GameBoyTest, Callback) { testCallback(); }
+
+void GameBoyTest::testConfiguration()
+{
+    start(EmuSpeed::FREE);
+
+    ConfigSnapshot config = m_console->configuration();
+    EXPECT_EQ(config.getEnum<EmuSpeed>(ConfigKey::SPEED), EmuSpeed::FREE);
+
+    // A second console with different settings shouldn't change anything
+    // about the first one, or about the process-wide configuration.
+    shared_ptr<GameBoyInterface> other =
+        GameBoyInterface::Instance(config.with(ConfigKey::SPEED, int(EmuSpeed::_2X)));
+
+    EXPECT_EQ(other->configuration().getEnum<EmuSpeed>(ConfigKey::SPEED), EmuSpeed::_2X);
+    EXPECT_EQ(m_console->configuration().getEnum<EmuSpeed>(ConfigKey::SPEED), EmuSpeed::FREE);
+    EXPECT_TRUE(ConfigSnapshot().diff(Configuration::instance().snapshot()).empty());
+
+    // Updates only go to the console that they're handed to.
+    m_console->configure(config.with(ConfigKey::SPEED, int(EmuSpeed::NORMAL)));
+
+    vector<ConfigKey> changed = config.diff(m_console->configuration());
+    ASSERT_EQ(changed.size(), 1u);
+    EXPECT_EQ(changed.front(), ConfigKey::SPEED);
+
+    EXPECT_EQ(other->configuration().getEnum<EmuSpeed>(ConfigKey::SPEED), EmuSpeed::_2X);
+
+    // The console keeps running through the change.
+    m_console->write(ADDRESS, 0x5A);
+    EXPECT_EQ(m_console->read(ADDRESS), 0x5A);
+
+    // Somebody else can look at the settings while they're being changed,
+    // and they always get one whole set of them or the other.
+    constexpr uint32_t UPDATES = 200;
+
+    std::atomic<bool> done(false);
+    std::thread updater([&] {
+        for (uint32_t i = 0; i < UPDATES; i++) {
+            EmuSpeed speed = (i & 1) ? EmuSpeed::_4X : EmuSpeed::FREE;
+            m_console->configure(config.with(ConfigKey::SPEED, int(speed)));
+        }
+        done = true;
+    });
+
+    while (!done) {
+        EmuSpeed speed = m_console->configuration().getEnum<EmuSpeed>(ConfigKey::SPEED);
+        EXPECT_TRUE((EmuSpeed::FREE == speed) || (EmuSpeed::_4X == speed) || (EmuSpeed::NORMAL == speed));
+    }
+    updater.join();
+
+    EXPECT_EQ(m_console->configuration().getEnum<EmuSpeed>(ConfigKey::SPEED), EmuSpeed::_4X);
+}
+TEST_F(GameBoyTest, Configuration) { testConfiguration(); }
+
+void GameBoyTest::testScheduler()
+{
+    create(EmuSpeed::NORMAL);
+
+    Scheduler scheduler(2);
+    ASSERT_TRUE(scheduler.add(m_console));
+
+    // Nobody else gets to run the console while it's on the pool, including
+    // another pool.
+    Scheduler other(1);
+    EXPECT_FALSE(other.add(m_console));
+    EXPECT_FALSE(scheduler.add(m_console));
+    EXPECT_EQ(m_console->runCycles(FRAME_CYCLES), 0u);
+
+    // Paced consoles still run at the real speed on the pool.
+    auto begin = std::chrono::steady_clock::now();
+    while (scheduler.getStatistics().frames < 30) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    EXPECT_GT(seconds, 0.4);
+
+    // Queued commands run in between frames.
+    m_console->write(ADDRESS, 0x3C);
+    EXPECT_EQ(m_console->read(ADDRESS), 0x3C);
+
+    // Changing the settings halts the console, which parks it until it's
+    // resumed, and it has to pick back up where it left off.
+    m_console->configure(m_console->configuration().with(ConfigKey::SPEED, int(EmuSpeed::FREE)));
+
+    uint64_t frames = scheduler.getStatistics().frames;
+    while (scheduler.getStatistics().frames < (frames + 100)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Stopping the console takes it off of the pool.
+    m_console->stop();
+
+    frames = scheduler.getStatistics().frames;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(scheduler.getStatistics().frames, frames);
+
+    // A console that's running on its own thread can't go on a pool either.
+    m_console->start();
+    EXPECT_FALSE(other.add(m_console));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(other.getStatistics().frames, 0u);
+}
+TEST_F(GameBoyTest, Scheduler) { testScheduler(); }
+
+void GameBoyTest::testRunFrame()
+{
+    create(EmuSpeed::NORMAL);
+
+    // No pacing, so this shouldn't take anywhere near the ~170ms that it
+    // would take in real time.
+    auto begin = std::chrono::steady_clock::now();
+
+    uint64_t cycles = 0;
+    for (uint32_t i = 0; i < 10; i++) {
+        cycles += m_console->runFrame();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    EXPECT_LT(seconds, 0.1);
+
+    // Whatever one frame runs over by comes out of the next one.
+    EXPECT_GE(cycles, 10 * FRAME_CYCLES);
+    EXPECT_LT(cycles, (10 * FRAME_CYCLES) + INSTRUCTION_CYCLES_MAX);
+
+    // Nothing runs while the emulator is started.
+    m_console->start();
+    EXPECT_EQ(m_console->runFrame(), 0u);
+}
+TEST_F(GameBoyTest, RunFrame) { testRunFrame(); }
+
+void GameBoyTest::testRunCycles()
+{
+    create(EmuSpeed::FREE);
+
+    for (uint64_t cycles : { 1, 100, 1000, 100000 }) {
+        uint64_t ran = m_console->runCycles(cycles);
+        EXPECT_GE(ran, cycles);
+        EXPECT_LT(ran, cycles + INSTRUCTION_CYCLES_MAX);
+    }
+
+    // Memory access works in between runs.
+    m_console->write(ADDRESS, 0xC3);
+    EXPECT_EQ(m_console->read(ADDRESS), 0xC3);
+}
+TEST_F(GameBoyTest, RunCycles) { testRunCycles(); }
+
+void GameBoyTest::testRunUntil()
+{
+    create(EmuSpeed::FREE);
+
+    // The boot ROM hands off to the cartridge at the entry point.
+    uint64_t cycles = m_console->runUntil(ROM_ENTRY_POINT, BOOT_CYCLES_MAX);
+    EXPECT_LT(cycles, BOOT_CYCLES_MAX);
+
+    // From there on out, the cartridge loops on a single relative jump.
+    EXPECT_EQ(m_console->runUntil(ROM_ENTRY_POINT), 12u);
+
+    // The predicate gets checked after every instruction.
+    uint32_t checks = 0;
+    m_console->runUntil([&checks] { return (++checks == 5); });
+    EXPECT_EQ(checks, 5u);
+
+    // The limit stops it when the predicate never comes true.
+    cycles = m_console->runUntil([] { return false; }, 1000);
+    EXPECT_GE(cycles, 1000u);
+    EXPECT_LT(cycles, 1000 + INSTRUCTION_CYCLES_MAX);
+}
+TEST_F(GameBoyTest, RunUntil) { testRunUntil(); }
+
+void GameBoyTest::testSaveState()
+{
+    create(EmuSpeed::FREE);
+
+    m_console->runUntil(ROM_ENTRY_POINT, BOOT_CYCLES_MAX);
+    m_console->write(ADDRESS, 0x42);
+
+    GameBoyInterface::State state = m_console->saveState();
+    ASSERT_FALSE(state.empty());
+
+    // Loading puts back memory and right where the CPU was in the loop, so
+    // the next trip around the loop is a full one.
+    m_console->write(ADDRESS, 0x24);
+    m_console->runCycles(1000);
+
+    ASSERT_TRUE(m_console->loadState(state));
+    EXPECT_EQ(m_console->read(ADDRESS), 0x42);
+    EXPECT_EQ(m_console->runUntil(ROM_ENTRY_POINT), 12u);
+
+    // Anything that isn't a whole state gets turned away without touching
+    // the console.
+    m_console->write(ADDRESS, 0x81);
+
+    GameBoyInterface::State truncated(state.begin(), state.end() - 1);
+    EXPECT_FALSE(m_console->loadState(truncated));
+    EXPECT_FALSE(m_console->loadState(GameBoyInterface::State(state.size(), 0x00)));
+    EXPECT_EQ(m_console->read(ADDRESS), 0x81);
+
+    // It also has to come from the same cartridge.
+    shared_ptr<GameBoyInterface> empty = GameBoyInterface::Instance();
+    EXPECT_FALSE(empty->loadState(state));
+
+    // Starting picks up from the state instead of starting over.
+    ASSERT_TRUE(m_console->loadState(state));
+    m_console->start();
+    EXPECT_EQ(m_console->read(ADDRESS), 0x42);
+}
+TEST_F(GameBoyTest, SaveState) { testSaveState(); }
+
+void GameBoyTest::testVecEnv()
+{
+    // Only the cartridge is needed.
+    create(EmuSpeed::FREE);
+
+    VecEnv::Layout layout;
+    layout.scale = 4;
+    layout.addresses = { JOYPAD_ADDRESS, ADDRESS };
+
+    VecEnv env(3, layout, ConfigSnapshot(), 2);
+    ASSERT_TRUE(env.load(ROM));
+
+    size_t size = env.observationSize();
+    ASSERT_EQ(size, size_t((160 / 4) * (144 / 4)) + 2);
+
+    // Select the direction keys so that they show up in the joypad register.
+    for (uint32_t i = 0; i < env.size(); i++) {
+        env.at(i).write(JOYPAD_ADDRESS, 0x20);
+        env.at(i).write(ADDRESS, uint8_t(i + 1));
+    }
+
+    vector<uint8_t> actions = {
+        0x00, GameBoyInterface::JOYPAD_RIGHT, GameBoyInterface::JOYPAD_UP | GameBoyInterface::JOYPAD_DOWN,
+    };
+    vector<uint8_t> observations(env.size() * size, 0xCD);
+
+    VecEnv::Timing timing = env.step(actions.data(), 4, observations.data());
+    EXPECT_EQ(timing.frames, 12u);
+    EXPECT_GT(timing.elapsed, 0.0);
+    EXPECT_LE(timing.slowest, timing.elapsed);
+
+    // Every console got its own buttons, and wrote its own slice.
+    for (uint32_t i = 0; i < env.size(); i++) {
+        const uint8_t *ram = &observations[((i + 1) * size) - 2];
+        EXPECT_EQ(ram[0] & 0x0F, uint8_t(~actions[i] & 0x0F));
+        EXPECT_EQ(ram[1], uint8_t(i + 1));
+    }
+
+    // Resetting only puts the one console back to where everybody started,
+    // which is before any frames were drawn.
+    ASSERT_TRUE(env.reset(1));
+    env.observe(observations.data());
+
+    EXPECT_TRUE(std::all_of(&observations[size], &observations[(2 * size) - 2],
+                            [](uint8_t pixel) { return (0x00 == pixel); }));
+
+    EXPECT_EQ(observations[(1 * size) - 1], 1u);
+    EXPECT_EQ(observations[(2 * size) - 1], 0u);
+    EXPECT_EQ(observations[(3 * size) - 1], 3u);
+}
+TEST_F(GameBoyTest, VecEnv) { testVecEnv(); }
+
+void GameBoyTest::testVecEnvFastBoot()
+{
+    vector<uint8_t> image = cartridge(0x01, "");
+    image[ROM_ENTRY_POINT]     = 0x18;
+    image[ROM_ENTRY_POINT + 1] = uint8_t(BOOT_PROGRAM_OFFSET - (ROM_ENTRY_POINT + 2));
+    std::copy(BOOT_PROGRAM.begin(), BOOT_PROGRAM.end(), image.begin() + BOOT_PROGRAM_OFFSET);
+    save(ROM, image);
+
+    VecEnv::Layout layout;
+    layout.scale = 0;
+
+    VecEnv env(2, layout, ConfigSnapshot().with(ConfigKey::FAST_BOOT, true), 2);
+    ASSERT_TRUE(env.load(ROM));
+
+    // Everybody starts out right at the entry point without having run a
+    // thing, so the jump to the program is the first thing that they do.
+    for (uint32_t i = 0; i < env.size(); i++) {
+        EXPECT_EQ(env.at(i).getStatistics().frames, 0u);
+        EXPECT_EQ(env.at(i).getStatistics().firstFrameTicks, 0u);
+
+        EXPECT_LE(env.at(i).runUntil(BOOT_PROGRAM_OFFSET, FRAME_CYCLES), INSTRUCTION_CYCLES_MAX);
+    }
+}
+TEST_F(GameBoyTest, VecEnvFastBoot) { testVecEnvFastBoot(); }
+
+void GameBoyTest::testMemorySpans()
+{
+    create(EmuSpeed::FREE);
+
+    // The cartridge is a DMG cartridge, so only the banks that a DMG has
+    // show up.  It doesn't say how much RAM it has, so it gets all of it.
+    using Area = GameBoyInterface::MemoryArea;
+    ASSERT_EQ(m_console->getMemory(Area::WRAM).size(), 2u);
+    ASSERT_EQ(m_console->getMemory(Area::VRAM).size(), 1u);
+    for (const GameBoyInterface::MemorySpan & bank : m_console->getMemory(Area::CART_RAM)) {
+        EXPECT_EQ(bank.size, 0x2000u);
+    }
+
+    vector<GameBoyInterface::MemorySpan> oam  = m_console->getMemory(Area::OAM);
+    vector<GameBoyInterface::MemorySpan> hram = m_console->getMemory(Area::HRAM);
+    ASSERT_EQ(oam.size(), 1u);
+    ASSERT_EQ(hram.size(), 1u);
+    EXPECT_EQ(oam.front().size, 160u);
+    EXPECT_EQ(hram.front().size, 127u);
+
+    // 0xDF00 is in the second half of WRAM, which is bank 1 on a DMG.
+    GameBoyInterface::MemorySpan wram = m_console->getMemory(Area::WRAM).at(1);
+    ASSERT_EQ(wram.size, 0x1000u);
+
+    m_console->write(ADDRESS, 0x5A);
+    EXPECT_EQ(wram.data[ADDRESS - 0xD000], 0x5A);
+
+    vector<uint64_t> frames;
+    vector<uint8_t> values;
+    m_console->setFrameCallback([&](uint64_t frame) {
+        frames.push_back(frame);
+        values.push_back(wram.data[ADDRESS - 0xD000]);
+
+        // Anything that doesn't halt the emulator is fair game.
+        m_console->queueWrite({ { ADDRESS, uint8_t(frame) } });
+    });
+
+    for (uint32_t i = 0; i < 5; i++) {
+        m_console->runFrame();
+    }
+
+    // The boot ROM turns the LCD on right away, so there's a vblank in every
+    // frame after the first one, and each of them sees the last one's write.
+    ASSERT_GE(frames.size(), 4u);
+    EXPECT_EQ(values.front(), 0x5A);
+    for (size_t i = 1; i < frames.size(); i++) {
+        EXPECT_EQ(frames.at(i), frames.at(i - 1) + 1);
+        EXPECT_EQ(values.at(i), uint8_t(frames.at(i - 1)));
+    }
+
+    // Nothing gets called once the callback is taken away.
+    m_console->setFrameCallback(nullptr);
+    size_t count = frames.size();
+    m_console->runFrame();
+    EXPECT_EQ(frames.size(), count);
+}
+TEST_F(GameBoyTest, MemorySpans) { testMemorySpans(); }
+
+vector<uint64_t> GameBoyTest::replay(EmuSpeed speed, bool started, vector<uint8_t> & ram)
+{
+    ConfigSnapshot config = ConfigSnapshot()
+        .with(ConfigKey::SPEED, int(speed))
+        .with(ConfigKey::DETERMINISTIC, true)
+        .with(ConfigKey::RTC_START, int(REPLAY_RTC_START));
+
+    shared_ptr<GameBoyInterface> console = GameBoyInterface::Instance(config);
+    if (!console->load(REPLAY_ROM)) { return { }; }
+
+    auto hash = [](uint64_t value, const uint8_t *data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            value = (value ^ data[i]) * 0x100000001B3;
+        }
+        return value;
+    };
+
+    vector<uint64_t> hashes;
+    std::promise<void> finished;
+
+    console->setFrameCallback([&](uint64_t) {
+        if (hashes.size() >= REPLAY_FRAMES) { return; }
+
+        // What the frame looks like, along with all of the RAM.
+        ColorArray screen = console->getRGB();
+
+        uint64_t value = hash(0xCBF29CE484222325,
+                              reinterpret_cast<const uint8_t*>(screen.data()),
+                              screen.size() * sizeof(GB::RGB));
+        for (auto area : { GameBoyInterface::MemoryArea::WRAM, GameBoyInterface::MemoryArea::HRAM }) {
+            for (const GameBoyInterface::MemorySpan & span : console->getMemory(area)) {
+                value = hash(value, span.data, span.size);
+            }
+        }
+        hashes.push_back(value);
+
+        if (hashes.size() == REPLAY_FRAMES) {
+            GameBoyInterface::MemorySpan wram = console->getMemory(GameBoyInterface::MemoryArea::WRAM).front();
+            ram.assign(wram.data, wram.data + wram.size);
+
+            finished.set_value();
+            return;
+        }
+
+        // The input log is a different set of direction keys every 8 frames.
+        uint8_t keys = uint8_t(hashes.size() / 8) & 0x0F;
+        for (uint8_t i = 0; i < 4; i++) {
+            auto button = GameBoyInterface::JoyPadButton(1 << i);
+            if (keys & button) {
+                console->setButton(button);
+            } else {
+                console->clrButton(button);
+            }
+        }
+    });
+
+    if (started) {
+        console->start();
+        finished.get_future().wait();
+        console->stop();
+    } else {
+        while (hashes.size() < REPLAY_FRAMES) { console->runFrame(); }
+    }
+
+    return hashes;
+}
+
+vector<uint8_t> GameBoyTest::replayCartridge()
+{
+    vector<uint8_t> image = cartridge(0x10, REPLAY_TITLE);
+    image[ROM_ENTRY_POINT]     = 0x18;
+    image[ROM_ENTRY_POINT + 1] = uint8_t(REPLAY_PROGRAM_OFFSET - (ROM_ENTRY_POINT + 2));
+    std::copy(REPLAY_PROGRAM.begin(), REPLAY_PROGRAM.end(), image.begin() + REPLAY_PROGRAM_OFFSET);
+
+    return image;
+}
+
+void GameBoyTest::bootNops(ConfigSnapshot config, uint8_t flag)
+{
+    vector<uint8_t> image = cartridge(0x01, "");
+    image[ROM_CGB_OFFSET]      = flag;
+    image[ROM_ENTRY_POINT]     = 0x18;
+    image[ROM_ENTRY_POINT + 1] = uint8_t(NOP_PROGRAM_OFFSET - (ROM_ENTRY_POINT + 2));
+    std::copy(NOP_PROGRAM.begin(), NOP_PROGRAM.end(), image.begin() + NOP_PROGRAM_OFFSET);
+    image[ROM_SIZE - 1] = 0xE9;
+    save(ROM, image);
+
+    m_console = GameBoyInterface::Instance(config.with(ConfigKey::FAST_BOOT, true));
+    ASSERT_TRUE(m_console->load(ROM));
+    m_console->runCycles(NOP_PROGRAM_OFFSET);
+}
+
+void GameBoyTest::testReplay()
+{
+    save(REPLAY_ROM, replayCartridge());
+
+    // The same input has to come out exactly the same way no matter how
+    // fast the console runs, or who is running it.
+    vector<uint8_t> ram, paced;
+    vector<uint64_t> expected = replay(EmuSpeed::FREE, false, ram);
+    vector<uint64_t> actual = replay(EmuSpeed::_4X, true, paced);
+
+    remove(REPLAY_ROM.c_str());
+    remove((REPLAY_TITLE + ".sav").c_str());
+
+    ASSERT_EQ(expected.size(), REPLAY_FRAMES);
+    EXPECT_EQ(expected, actual);
+    EXPECT_EQ(ram, paced);
+
+    // The clock counted the emulated time, not the time on the host.
+    ASSERT_EQ(ram.size(), 0x1000u);
+    double seconds = double(REPLAY_FRAMES * FRAME_CYCLES) / 4194304.0;
+    EXPECT_EQ(ram[0], uint8_t(uint32_t(REPLAY_RTC_START + seconds) % 60));
+
+    // Somebody was pressing the keys.
+    EXPECT_NE(ram[1], 0x00);
+}
+TEST_F(GameBoyTest, Replay) { testReplay(); }
+
+void GameBoyTest::testMovie()
+{
+    save(REPLAY_ROM, replayCartridge());
+
+    ConfigSnapshot config = ConfigSnapshot()
+        .with(ConfigKey::SPEED, int(EmuSpeed::FREE))
+        .with(ConfigKey::DETERMINISTIC, true);
+
+    auto ram = [](GameBoyInterface & console) {
+        vector<uint8_t> bytes;
+        for (const GameBoyInterface::MemorySpan & span : console.getMemory(GameBoyInterface::MemoryArea::WRAM)) {
+            bytes.insert(bytes.end(), span.data, span.data + span.size);
+        }
+        return bytes;
+    };
+
+    // The buttons come in from another thread while the console is running,
+    // which is never the same twice.
+    shared_ptr<GameBoyInterface> recorded = GameBoyInterface::Instance(config);
+    ASSERT_TRUE(recorded->load(REPLAY_ROM));
+    ASSERT_TRUE(recorded->startRecording(MOVIE, MOVIE_CHECKPOINT_FRAMES));
+
+    recorded->start();
+    for (uint32_t i = 0; recorded->getStatistics().frames < MOVIE_FRAMES; i++) {
+        auto button = GameBoyInterface::JoyPadButton(1 << (i % 4));
+        if (i & 0x04) {
+            recorded->setButton(button);
+        } else {
+            recorded->clrButton(button);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    recorded->stop();
+    recorded->stopRecording();
+
+    vector<uint8_t> expected = ram(*recorded);
+    EXPECT_NE(expected[1], 0x00);
+
+    // Playing it back ends up in exactly the same place.
+    shared_ptr<GameBoyInterface> console = GameBoyInterface::Instance(config);
+    ASSERT_TRUE(console->load(REPLAY_ROM));
+
+    MoviePlayer player(*console);
+    ASSERT_TRUE(player.open(MOVIE));
+
+    const Movie & movie = player.movie();
+    EXPECT_GE(movie.frames(), MOVIE_FRAMES - 1);
+    EXPECT_FALSE(movie.events().empty());
+    EXPECT_GE(movie.checkpoints().size(), size_t(MOVIE_FRAMES / MOVIE_CHECKPOINT_FRAMES));
+
+    while (!player.isDone()) { player.play(100); }
+    EXPECT_EQ(ram(*console), expected);
+
+    // So does skipping ahead (or back) and playing the rest of it.
+    for (uint64_t frame : { movie.frames() / 2, uint64_t(1), movie.frames() - 10 }) {
+        ASSERT_TRUE(player.seek(frame));
+        EXPECT_EQ(player.frame(), frame);
+
+        while (!player.isDone()) { player.play(100); }
+        EXPECT_EQ(ram(*console), expected);
+    }
+
+    remove(MOVIE.c_str());
+    remove(REPLAY_ROM.c_str());
+    remove((REPLAY_TITLE + ".sav").c_str());
+}
+TEST_F(GameBoyTest, Movie) { testMovie(); }
+
+void GameBoyTest::testJoyPad()
+{
+    create(EmuSpeed::FREE);
+    ASSERT_GE(m_console->runUntil(ROM_ENTRY_POINT, BOOT_CYCLES_MAX), 1u);
+
+    // Only the direction keys are selected, and the cartridge never turns
+    // on any interrupts, so the flag stays put.
+    m_console->write(JOYPAD_ADDRESS, 0x20);
+    m_console->write(INTERRUPT_ADDRESS, 0x00);
+
+    auto lines = [&] { return uint8_t(m_console->read(JOYPAD_ADDRESS) & 0x0F); };
+    auto raised = [&] { return (0 != (m_console->read(INTERRUPT_ADDRESS) & JOYPAD_INTERRUPT)); };
+
+    // The button doesn't land until its delay is up, and then it goes in
+    // before the next instruction.
+    m_console->queueButton(GameBoyInterface::JOYPAD_RIGHT, true, 1000);
+    m_console->runCycles(500);
+    EXPECT_EQ(lines(), 0x0F);
+    EXPECT_FALSE(raised());
+
+    m_console->runCycles(500 + INSTRUCTION_CYCLES_MAX);
+    EXPECT_EQ(lines(), 0x0E);
+    EXPECT_TRUE(raised());
+
+    // Letting go of it is a line going high, which doesn't raise anything.
+    m_console->write(INTERRUPT_ADDRESS, 0x00);
+    m_console->clrButton(GameBoyInterface::JOYPAD_RIGHT);
+    m_console->runCycles(1);
+    EXPECT_EQ(lines(), 0x0F);
+    EXPECT_FALSE(raised());
+
+    // A button on the row that isn't selected doesn't show up until the row
+    // is, and then it's the same as pressing it.
+    m_console->setButton(GameBoyInterface::JOYPAD_A);
+    m_console->runCycles(1);
+    EXPECT_EQ(lines(), 0x0F);
+    EXPECT_FALSE(raised());
+
+    m_console->write(JOYPAD_ADDRESS, 0x10);
+    EXPECT_EQ(lines(), 0x0E);
+    EXPECT_TRUE(raised());
+}
+TEST_F(GameBoyTest, JoyPad) { testJoyPad(); }
+
+void GameBoyTest::testDoubleSpeed()
+{
+    struct Measured {
+        uint8_t speed;
+        uint8_t divider;
+        uint64_t frame;
+    };
+
+    auto measure = [&](bool request) {
+        vector<uint8_t> image = cartridge(0x01, "");
+        image[ROM_CGB_OFFSET]      = 0xC0;
+        image[ROM_ENTRY_POINT]     = 0x18;
+        image[ROM_ENTRY_POINT + 1] = uint8_t(SPEED_PROGRAM_OFFSET - (ROM_ENTRY_POINT + 2));
+        std::copy(SPEED_PROGRAM.begin(), SPEED_PROGRAM.end(), image.begin() + SPEED_PROGRAM_OFFSET);
+
+        // Without the request the STOP doesn't switch anything.
+        if (!request) { image[SPEED_PROGRAM_OFFSET + 2] = image[SPEED_PROGRAM_OFFSET + 3] = 0x00; }
+
+        save(ROM, image);
+
+        m_console = GameBoyInterface::Instance(ConfigSnapshot().with(ConfigKey::SPEED, int(EmuSpeed::FREE)));
+        EXPECT_TRUE(m_console->load(ROM));
+        EXPECT_GE(m_console->runUntil(SPEED_PROGRAM_LOOP, BOOT_CYCLES_MAX), 1u);
+
+        Measured measured;
+        measured.speed = m_console->read(SPEED_ADDRESS);
+
+        // Short enough that the divider doesn't wrap at either speed.
+        uint8_t divider = m_console->read(DIVIDER_ADDRESS);
+        m_console->runCycles(FRAME_CYCLES / 8);
+        measured.divider = uint8_t(m_console->read(DIVIDER_ADDRESS) - divider);
+
+        m_console->runFrame();
+        measured.frame = m_console->runFrame();
+
+        return measured;
+    };
+
+    Measured normal = measure(false);
+    EXPECT_EQ(normal.speed, 0x7E);
+
+    Measured fast = measure(true);
+    EXPECT_EQ(fast.speed, 0xFE);
+
+    // The timer runs off of the CPU's clock, so it goes twice as fast, but the
+    // screen still draws a frame in the same amount of time.
+    EXPECT_GT(normal.divider, 0);
+    EXPECT_NEAR(fast.divider, 2 * normal.divider, 2);
+
+    EXPECT_NEAR(double(normal.frame), double(FRAME_CYCLES), double(INSTRUCTION_CYCLES_MAX));
+    EXPECT_NEAR(double(fast.frame), double(FRAME_CYCLES), double(INSTRUCTION_CYCLES_MAX));
+}
+TEST_F(GameBoyTest, DoubleSpeed) { testDoubleSpeed(); }
+
+void GameBoyTest::testFastBoot()
+{
+    struct Booted {
+        vector<uint8_t> registers;
+        vector<uint8_t> vram;
+        vector<uint8_t> palettes;
+        GameBoyInterface::Statistics stats;
+    };
+
+    auto boot = [&](EmuMode mode, uint8_t flag, bool fast) {
+        vector<uint8_t> image = cartridge(0x01, "");
+        image[ROM_CGB_OFFSET]      = flag;
+        image[ROM_ENTRY_POINT]     = 0x18;
+        image[ROM_ENTRY_POINT + 1] = uint8_t(BOOT_PROGRAM_OFFSET - (ROM_ENTRY_POINT + 2));
+        std::copy(BOOT_PROGRAM.begin(), BOOT_PROGRAM.end(), image.begin() + BOOT_PROGRAM_OFFSET);
+        save(ROM, image);
+
+        ConfigSnapshot config = ConfigSnapshot()
+            .with(ConfigKey::SPEED, int(EmuSpeed::FREE))
+            .with(ConfigKey::EMU_MODE, int(mode))
+            .with(ConfigKey::FAST_BOOT, fast);
+
+        m_console = GameBoyInterface::Instance(config);
+        EXPECT_TRUE(m_console->load(ROM));
+        EXPECT_GE(m_console->runUntil(BOOT_PROGRAM_LOOP, BOOT_CYCLES_MAX), 1u);
+
+        Booted booted;
+        for (uint16_t address = BOOT_STACK_ADDRESS; address < 0xFFFE; address++) {
+            booted.registers.push_back(m_console->read(address));
+        }
+
+        using Area = GameBoyInterface::MemoryArea;
+        for (const GameBoyInterface::MemorySpan & bank : m_console->getMemory(Area::VRAM)) {
+            booted.vram.insert(booted.vram.end(), bank.data, bank.data + bank.size);
+        }
+
+        for (uint16_t index : { BG_PALETTE_ADDRESS, SPRITE_PALETTE_ADDRESS }) {
+            for (uint8_t i = 0; i < PALETTE_BYTES; i++) {
+                m_console->write(index, i);
+                booted.palettes.push_back(m_console->read(index + 1));
+            }
+        }
+
+        m_console->runFrame();
+        m_console->runFrame();
+        booted.stats = m_console->getStatistics();
+
+        return booted;
+    };
+
+    // A DMG game on a DMG, a CGB game, and a DMG game on a CGB.
+    const vector<std::pair<EmuMode, uint8_t>> models = {
+        { EmuMode::AUTO, 0x00 }, { EmuMode::AUTO, 0x80 }, { EmuMode::CGB, 0x00 },
+    };
+
+    for (const auto & [mode, flag] : models) {
+        Booted bios = boot(mode, flag, false);
+        Booted fast = boot(mode, flag, true);
+
+        EXPECT_EQ(fast.registers, bios.registers);
+        EXPECT_EQ(fast.palettes, bios.palettes);
+
+        // The CGB BIOS leaves its own logo behind, which doesn't get drawn
+        // without it.
+        if ((EmuMode::AUTO == mode) && !flag) { EXPECT_EQ(fast.vram, bios.vram); }
+
+        // Skipping the BIOS gets the first frame out right away, instead of
+        // after the few hundred frames that the logo takes.
+        EXPECT_GT(fast.stats.firstFrameTicks, 0u);
+        EXPECT_LE(fast.stats.firstFrameTicks, FRAME_CYCLES);
+        EXPECT_GT(bios.stats.firstFrameTicks, 100 * FRAME_CYCLES);
+        EXPECT_GT(fast.stats.firstFrameTime, 0.0);
+    }
+}
+TEST_F(GameBoyTest, FastBoot) { testFastBoot(); }
+
+void GameBoyTest::testDisassembly()
+{
+    using Listing = GameBoyInterface::Listing;
+
+    // 4 banks of MBC1, with every RST and interrupt vector going straight
+    // back to wherever it came from.
+    vector<uint8_t> image = cartridge(0x01, "");
+    image.resize(4 * 0x4000, 0x00);
+    image[ROM_SIZE_OFFSET] = 0x01;
+
+    std::fill(image.begin(), image.begin() + ROM_ENTRY_POINT, 0xC9);
+    image[ROM_ENTRY_POINT]     = 0x18;
+    image[ROM_ENTRY_POINT + 1] = uint8_t(BOOT_PROGRAM_OFFSET - (ROM_ENTRY_POINT + 2));
+    std::copy(BANKED_PROGRAM.begin(), BANKED_PROGRAM.end(), image.begin() + BOOT_PROGRAM_OFFSET);
+
+    // Bank 1 is code too, but nothing switches to it.
+    for (uint16_t bank : { 1, 2 }) {
+        std::copy(BANKED_ROUTINE.begin(), BANKED_ROUTINE.end(), image.begin() + (bank * 0x4000));
+    }
+    save(ROM, image);
+
+    // The cache goes by the hash of the ROM that actually got written out.
+    std::ifstream input(ROM, std::ios::in | std::ios::binary);
+    vector<uint8_t> rom((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+    std::ostringstream cache;
+    cache << std::hex << std::setw(16) << std::setfill('0') << Util::hash(rom.data(), rom.size()) << ".dis";
+    remove(cache.str().c_str());
+
+    auto find = [](const Listing & listing, uint16_t bank, uint16_t address) {
+        return std::find_if(listing.begin(), listing.end(),
+            [&](const GameBoyInterface::Instruction & instruction) {
+                return (instruction.bank == bank) && (instruction.address == address);
+            });
+    };
+
+    m_console = GameBoyInterface::Instance(ConfigSnapshot().with(ConfigKey::SPEED, int(EmuSpeed::FREE)));
+    ASSERT_TRUE(m_console->load(ROM));
+
+    Listing listing = m_console->disassemble().get();
+
+    // Everything that the program runs, including the routine in bank 2,
+    // and nothing that it doesn't.
+    for (uint16_t address : { 0x0100, 0x0150, 0x0152, 0x0155, 0x0158 }) {
+        EXPECT_NE(find(listing, 0, address), listing.end()) << address;
+    }
+    EXPECT_EQ(find(listing, 0, BANKED_PROGRAM_DATA), listing.end());
+
+    for (uint16_t address : { 0x4000, 0x4003, 0x4005 }) {
+        EXPECT_NE(find(listing, 2, address), listing.end()) << address;
+    }
+    EXPECT_EQ(find(listing, 1, BANKED_ROUTINE_ADDRESS), listing.end());
+
+    auto swap = find(listing, 2, 0x4003);
+    ASSERT_NE(swap, listing.end());
+    EXPECT_EQ(swap->bytes, vector<uint8_t>({ 0xCB, 0x37 }));
+    EXPECT_NE(swap->text.find("SWAP"), string::npos);
+
+    EXPECT_TRUE(std::is_sorted(listing.begin(), listing.end(),
+        [](const GameBoyInterface::Instruction & left, const GameBoyInterface::Instruction & right) {
+            return std::make_pair(left.bank, left.address) < std::make_pair(right.bank, right.address);
+        }));
+
+    // Asking about bank 1 adds its three instructions to what has already
+    // been found.
+    Listing more = m_console->disassemble(1, BANKED_ROUTINE_ADDRESS).get();
+    EXPECT_EQ(more.size(), listing.size() + 3);
+    EXPECT_NE(find(more, 1, BANKED_ROUTINE_ADDRESS), more.end());
+
+    // A fresh console with the same cartridge picks all of it back up out of
+    // the cache, without being told about bank 1.
+    shared_ptr<GameBoyInterface> console =
+        GameBoyInterface::Instance(ConfigSnapshot().with(ConfigKey::SPEED, int(EmuSpeed::FREE)));
+    ASSERT_TRUE(console->load(ROM));
+
+    Listing cached = console->disassemble().get();
+    EXPECT_EQ(cached.size(), more.size());
+    EXPECT_NE(find(cached, 1, BANKED_ROUTINE_ADDRESS), cached.end());
+
+    console.reset();
+    m_console.reset();
+
+    remove(cache.str().c_str());
+}
+TEST_F(GameBoyTest, Disassembly) { testDisassembly(); }
+
+void GameBoyTest::testLcdTiming()
+{
+    enum Mode : uint8_t { HBLANK = 0, VBLANK = 1, OAM = 2, VRAM = 3, };
+
+    constexpr uint8_t STATUS_MODE        = 0x03;
+    constexpr uint8_t STATUS_COINCIDENCE = 0x04;
+    constexpr uint8_t STATUS_HBLANK_INT  = 0x08;
+    constexpr uint8_t STATUS_COMPARE_INT = 0x40;
+
+    constexpr uint8_t VBLANK_INTERRUPT = 0x01;
+    constexpr uint8_t LCD_INTERRUPT    = 0x02;
+
+    // Straight to the cartridge with the screen on.
+    bootNops(ConfigSnapshot().with(ConfigKey::SPEED, int(EmuSpeed::FREE)));
+    ASSERT_FALSE(HasFatalFailure());
+
+    auto mode = [&] { return Mode(m_console->read(LCD_STATUS_ADDRESS) & STATUS_MODE); };
+    auto line = [&] { return int(m_console->read(SCANLINE_ADDRESS)); };
+    auto flags = [&] { return int(m_console->read(INTERRUPT_ADDRESS) & (VBLANK_INTERRUPT | LCD_INTERRUPT)); };
+    auto step = [&](uint64_t cycles) { EXPECT_EQ(m_console->runCycles(cycles), cycles); };
+
+    // Find the start of the pixel transfer on the first line, to within one
+    // instruction.  Everything below is measured from there, and checked on
+    // both sides of where the edge has to be.
+    for (uint32_t i = 0; (i < FRAME_CYCLES) && ((0 != line()) || (OAM != mode())); i += 4) { step(4); }
+    for (uint32_t i = 0; (i < FRAME_CYCLES) && (VRAM != mode()); i += 4) { step(4); }
+    ASSERT_EQ(line(), 0);
+    ASSERT_EQ(mode(), VRAM);
+
+    // The pixel transfer takes 172 cycles, and the HBlank interrupt goes off
+    // right as it ends.
+    m_console->write(LCD_STATUS_ADDRESS, STATUS_HBLANK_INT);
+    m_console->write(INTERRUPT_ADDRESS, 0x00);
+
+    step(168);
+    EXPECT_EQ(mode(), VRAM);
+    EXPECT_EQ(flags(), 0x00);
+
+    step(4);
+    EXPECT_EQ(mode(), HBLANK);
+    EXPECT_EQ(flags(), LCD_INTERRUPT);
+
+    // LY goes up 204 cycles later, which is when it matches LYC.
+    m_console->write(LCD_STATUS_ADDRESS, STATUS_COMPARE_INT);
+    m_console->write(SCANLINE_COMPARE_ADDRESS, 1);
+    m_console->write(INTERRUPT_ADDRESS, 0x00);
+
+    step(200);
+    EXPECT_EQ(line(), 0);
+    EXPECT_EQ(mode(), HBLANK);
+    EXPECT_EQ(m_console->read(LCD_STATUS_ADDRESS) & STATUS_COINCIDENCE, 0);
+    EXPECT_EQ(flags(), 0x00);
+
+    step(4);
+    EXPECT_EQ(line(), 1);
+    EXPECT_EQ(mode(), OAM);
+    EXPECT_EQ(m_console->read(LCD_STATUS_ADDRESS) & STATUS_COINCIDENCE, STATUS_COINCIDENCE);
+    EXPECT_EQ(flags(), LCD_INTERRUPT);
+
+    // The VBlank starts 144 lines after the first one did, 80 cycles before
+    // the pixel transfer would have.
+    m_console->write(LCD_STATUS_ADDRESS, 0x00);
+    m_console->write(INTERRUPT_ADDRESS, 0x00);
+
+    step((144 * 456) - 80 - 376 - 4);
+    EXPECT_EQ(line(), 143);
+    EXPECT_EQ(mode(), HBLANK);
+    EXPECT_EQ(flags(), 0x00);
+
+    step(4);
+    EXPECT_EQ(line(), 144);
+    EXPECT_EQ(mode(), VBLANK);
+    EXPECT_EQ(flags(), VBLANK_INTERRUPT);
+}
+TEST_F(GameBoyTest, LcdTiming) { testLcdTiming(); }
+
+void GameBoyTest::testLcdDisable()
+{
+    constexpr uint8_t STATUS_MODE        = 0x03;
+    constexpr uint8_t STATUS_COINCIDENCE = 0x04;
+    constexpr uint8_t STATUS_COMPARE_INT = 0x40;
+
+    constexpr uint8_t LCD_INTERRUPT = 0x02;
+
+    constexpr uint8_t DISPLAY_ON  = 0x91;
+    constexpr uint8_t DISPLAY_OFF = 0x11;
+
+    bootNops(ConfigSnapshot().with(ConfigKey::SPEED, int(EmuSpeed::FREE)));
+    ASSERT_FALSE(HasFatalFailure());
+
+    auto mode = [&] { return int(m_console->read(LCD_STATUS_ADDRESS) & STATUS_MODE); };
+    auto line = [&] { return int(m_console->read(SCANLINE_ADDRESS)); };
+    auto flags = [&] { return int(m_console->read(INTERRUPT_ADDRESS) & LCD_INTERRUPT); };
+
+    // Somewhere in the middle of the frame.
+    m_console->runCycles(FRAME_CYCLES / 3);
+    ASSERT_GT(line(), 0);
+
+    // LY and the mode both read 0 for as long as the display is off, no
+    // matter how long that is.
+    m_console->write(LCD_CONTROL_ADDRESS, DISPLAY_OFF);
+    EXPECT_EQ(line(), 0);
+    EXPECT_EQ(mode(), 0);
+
+    m_console->runCycles(FRAME_CYCLES / 2);
+    EXPECT_EQ(line(), 0);
+    EXPECT_EQ(mode(), 0);
+
+    // Turning it back on starts the frame over from the top.
+    m_console->write(LCD_CONTROL_ADDRESS, DISPLAY_ON);
+    EXPECT_EQ(line(), 0);
+    EXPECT_EQ(mode(), 2);
+
+    m_console->runCycles(456);
+    EXPECT_EQ(line(), 1);
+
+    // A new LYC that matches the line that we're on goes off right away,
+    // instead of waiting for the next line.
+    m_console->write(LCD_STATUS_ADDRESS, STATUS_COMPARE_INT);
+    m_console->write(INTERRUPT_ADDRESS, 0x00);
+    m_console->write(SCANLINE_COMPARE_ADDRESS, 1);
+
+    EXPECT_EQ(flags(), LCD_INTERRUPT);
+    EXPECT_EQ(m_console->read(LCD_STATUS_ADDRESS) & STATUS_COINCIDENCE, STATUS_COINCIDENCE);
+}
+TEST_F(GameBoyTest, LcdDisable) { testLcdDisable(); }
+
+void GameBoyTest::testLineCache()
+{
+    constexpr uint64_t LINES       = 144;
+    constexpr uint64_t LINE_CYCLES = 456;
+
+    // Somewhere in the hblank, after the line has already been drawn.
+    constexpr uint64_t HBLANK_CYCLES = 350;
+
+    constexpr uint8_t DISPLAY_ON  = 0x91;
+    constexpr uint8_t DISPLAY_OFF = 0x11;
+
+    using Statistics = GameBoyInterface::Statistics;
+
+    // Every frame has to get drawn for the counts to add up.
+    bootNops(ConfigSnapshot().with(ConfigKey::DETERMINISTIC, true));
+    ASSERT_FALSE(HasFatalFailure());
+
+    // Start the frame over so that we know exactly where in it we are.
+    m_console->write(LCD_CONTROL_ADDRESS, DISPLAY_OFF);
+    m_console->write(LCD_CONTROL_ADDRESS, DISPLAY_ON);
+    m_console->runCycles(2 * FRAME_CYCLES);
+
+    // Nothing on the screen is changing, so every line of the next frame
+    // comes straight out of the cache.
+    Statistics before = m_console->getStatistics();
+    m_console->runCycles(FRAME_CYCLES);
+    Statistics after = m_console->getStatistics();
+
+    EXPECT_EQ(after.linesDrawn - before.linesDrawn, 0u);
+    EXPECT_EQ(after.linesReused - before.linesReused, LINES);
+    EXPECT_GT(after.lineHitRate(), 0.0);
+
+    // Changing the palette halfway down the screen has to redraw the rest of
+    // this frame and the top half of the next one.
+    const uint64_t middle = (LINES / 2) * LINE_CYCLES + HBLANK_CYCLES;
+    m_console->runCycles(middle);
+
+    uint64_t hash = m_console->getFrameInfo().hash;
+    m_console->write(BG_PALETTE_DMG_ADDRESS, uint8_t(~m_console->read(BG_PALETTE_DMG_ADDRESS)));
+
+    before = m_console->getStatistics();
+    m_console->runCycles(FRAME_CYCLES);
+    after = m_console->getStatistics();
+
+    EXPECT_EQ(after.linesDrawn - before.linesDrawn, LINES);
+    EXPECT_EQ(after.linesReused - before.linesReused, 0u);
+    EXPECT_NE(m_console->getFrameInfo().hash, hash);
+
+    // After which it's back to being cached.
+    before = after;
+    m_console->runCycles(FRAME_CYCLES);
+    after = m_console->getStatistics();
+
+    EXPECT_EQ(after.linesDrawn - before.linesDrawn, 0u);
+    EXPECT_EQ(after.linesReused - before.linesReused, LINES);
+}
+TEST_F(GameBoyTest, LineCache) { testLineCache(); }
+
+void GameBoyTest::testColors()
+{
+    constexpr uint8_t CGB_FLAG = 0x80;
+
+    // The top left corner is well clear of the logo, so it's always the
+    // first color of the first background palette.
+    auto corner = [&] {
+        m_console->runCycles(2 * FRAME_CYCLES);
+
+        ColorArray pixels = m_console->getRGB();
+        EXPECT_FALSE(pixels.empty());
+
+        // Copying the pixel has to keep every channel where it was, too.
+        GB::RGB pixel = pixels.empty() ? GB::RGB() : pixels.front();
+        return std::array<int, 4>{ pixel.red, pixel.green, pixel.blue, pixel.alpha };
+    };
+
+    // Each of the DMG shades, straight out of the default palette.
+    const vector<std::array<int, 4>> shades = {
+        { 0xFF, 0xFF, 0xFF, 0xFF },
+        { 0xBD, 0xBD, 0xBD, 0xFF },
+        { 0x62, 0x62, 0x62, 0xFF },
+        { 0x00, 0x00, 0x00, 0xFF },
+    };
+
+    bootNops(ConfigSnapshot().with(ConfigKey::DETERMINISTIC, true));
+    ASSERT_FALSE(HasFatalFailure());
+
+    for (uint8_t shade = 0; shade < shades.size(); shade++) {
+        m_console->write(BG_PALETTE_DMG_ADDRESS, shade);
+        EXPECT_EQ(corner(), shades[shade]) << "shade " << int(shade);
+    }
+
+    // Each channel of a CGB color is 5 bits, which gets scaled up to 8.
+    const vector<std::pair<uint16_t, std::array<int, 4>>> colors = {
+        { 0x0000, { 0x00, 0x00, 0x00, 0xFF } },
+        { 0x7FFF, { 0xFF, 0xFF, 0xFF, 0xFF } },
+        { 0x001F, { 0xFF, 0x00, 0x00, 0xFF } },
+        { 0x03E0, { 0x00, 0xFF, 0x00, 0xFF } },
+        { 0x7C00, { 0x00, 0x00, 0xFF, 0xFF } },
+        { 0x4210, { 0x83, 0x83, 0x83, 0xFF } },
+    };
+
+    bootNops(ConfigSnapshot()
+        .with(ConfigKey::DETERMINISTIC, true)
+        .with(ConfigKey::EMU_MODE, int(EmuMode::CGB)), CGB_FLAG);
+    ASSERT_FALSE(HasFatalFailure());
+
+    for (const auto & [color, expected] : colors) {
+        m_console->write(BG_PALETTE_ADDRESS, 0x00);
+        m_console->write(BG_PALETTE_ADDRESS + 1, uint8_t(color & 0xFF));
+        m_console->write(BG_PALETTE_ADDRESS, 0x01);
+        m_console->write(BG_PALETTE_ADDRESS + 1, uint8_t(color >> 8));
+
+        EXPECT_EQ(corner(), expected) << "color 0x" << std::hex << color;
+    }
+}
+TEST_F(GameBoyTest, Colors) { testColors(); }
+
+void GameBoyTest::testThreadedRendering()
+{
+    constexpr uint32_t FRAMES = 60;
+
+    using FrameInfo = GameBoyInterface::FrameInfo;
+
+    struct Rendered {
+        std::map<uint64_t, uint64_t> hashes;
+        FrameInfo last;
+        ColorArray pixels;
+    };
+
+    // The logo scrolls a little further every frame, and the scroll register
+    // changes somewhere in the middle of the frame, so every line has to
+    // pick up the right one for the frames to come out the same.
+    auto render = [&](bool threaded) {
+        bootNops(ConfigSnapshot().with(ConfigKey::SPEED, int(EmuSpeed::FREE)));
+        m_console->setThreadedRendering(threaded);
+
+        Rendered rendered;
+        for (uint32_t i = 0; i < FRAMES; i++) {
+            m_console->write(SCROLL_X_ADDRESS, uint8_t(i * 3));
+            m_console->runFrame();
+
+            FrameInfo frame = m_console->getFrameInfo();
+            if (frame.sequence) { rendered.hashes[frame.sequence] = frame.hash; }
+        }
+
+        // Waits on the render thread to finish whatever it still had.
+        m_console->setThreadedRendering(false);
+
+        rendered.pixels = m_console->getRGB(rendered.last);
+        rendered.hashes[rendered.last.sequence] = rendered.last.hash;
+
+        m_console->stop();
+        return rendered;
+    };
+
+    Rendered drawn = render(false);
+    Rendered threaded = render(true);
+
+    ASSERT_GT(drawn.last.sequence, FRAMES / 2);
+    EXPECT_EQ(threaded.last.sequence, drawn.last.sequence);
+    EXPECT_EQ(threaded.last.hash, drawn.last.hash);
+
+    // The hash has to actually be of the pixels that get handed over.
+    for (const Rendered * rendered : { &drawn, &threaded }) {
+        const ColorArray & pixels = rendered->pixels;
+        ASSERT_FALSE(pixels.empty());
+        EXPECT_EQ(Util::hash(pixels.data(), pixels.size() * sizeof(pixels[0])), rendered->last.hash);
+    }
+
+    // Whatever frames the render thread had finished by the time that we
+    // looked have to be the same ones too.
+    for (const auto & [sequence, hash] : threaded.hashes) {
+        ASSERT_EQ(drawn.hashes.count(sequence), 1u);
+        EXPECT_EQ(hash, drawn.hashes[sequence]) << "frame " << sequence;
+    }
+
+    std::set<uint64_t> distinct;
+    for (const auto & entry : drawn.hashes) { distinct.insert(entry.second); }
+    EXPECT_GT(distinct.size(), size_t(FRAMES / 2));
+}
+TEST_F(GameBoyTest, ThreadedRendering) { testThreadedRendering(); }
+
+void GameBoyTest::testFrameSkip()
+{
+    constexpr uint32_t FRAMES = 30;
+
+    // How many frames got drawn, when whoever is showing them takes every
+    // one of them as soon as it's done (or none at all).
+    auto drawn = [&](GameBoyInterface::FrameSkipMode mode, uint8_t ratio, bool taken) {
+        bootNops(ConfigSnapshot().with(ConfigKey::SPEED, int(EmuSpeed::FREE)));
+        m_console->setFrameSkip(mode, ratio);
+
+        GameBoyInterface *console = m_console.get();
+        if (taken) { m_console->setFrameCallback([console](uint64_t) { console->getRGB(); }); }
+
+        uint64_t first = m_console->getFrameInfo().sequence;
+        for (uint32_t i = 0; i < FRAMES; i++) { m_console->runFrame(); }
+        uint64_t frames = m_console->getFrameInfo().sequence - first;
+
+        m_console->stop();
+        return frames;
+    };
+
+    using Mode = GameBoyInterface::FrameSkipMode;
+
+    EXPECT_EQ(drawn(Mode::FRAMESKIP_NONE, 0, false), FRAMES);
+    EXPECT_EQ(drawn(Mode::FRAMESKIP_FIXED, 0, false), FRAMES);
+
+    // One frame gets drawn and then the next two are skipped, whether or not
+    // anybody looks at them.
+    for (bool taken : { false, true }) {
+        uint64_t frames = drawn(Mode::FRAMESKIP_FIXED, 2, taken);
+        EXPECT_GE(frames, (FRAMES / 3) - 1);
+        EXPECT_LE(frames, (FRAMES / 3) + 1);
+    }
+
+    // Nothing new gets drawn until the last frame has been taken, but every
+    // frame that does get taken is followed by a new one, even though the
+    // screen never changes.
+    EXPECT_LE(drawn(Mode::FRAMESKIP_AUTO, 0, false), 1u);
+    EXPECT_EQ(drawn(Mode::FRAMESKIP_AUTO, 0, true), FRAMES);
+}
+TEST_F(GameBoyTest, FrameSkip) { testFrameSkip(); }
+
+void GameBoyTest::testHeadless()
+{
+    constexpr uint32_t FRAMES = 5;
+
+    using FrameInfo = GameBoyInterface::FrameInfo;
+
+    // The logo never moves, so every frame that gets drawn is the same one.
+    bootNops(ConfigSnapshot().with(ConfigKey::SPEED, int(EmuSpeed::FREE)));
+    ASSERT_FALSE(HasFatalFailure());
+
+    for (uint32_t i = 0; i < FRAMES; i++) { m_console->runFrame(); }
+    FrameInfo drawn = m_console->getFrameInfo();
+    ASSERT_GT(drawn.sequence, 0u);
+
+    m_console->stop();
+
+    // Nothing gets drawn until somebody asks.
+    bootNops(ConfigSnapshot().with(ConfigKey::SPEED, int(EmuSpeed::FREE)));
+    ASSERT_FALSE(HasFatalFailure());
+    m_console->setHeadless(true);
+
+    for (uint32_t i = 0; i < FRAMES; i++) { m_console->runFrame(); }
+    EXPECT_EQ(m_console->getFrameInfo().sequence, 0u);
+    EXPECT_TRUE(m_console->getRGB().empty());
+
+    // The request gets the next full frame, which might not start until the
+    // one after this.
+    m_console->requestFrame();
+
+    ColorArray pixels;
+    for (uint32_t i = 0; (i < 3) && pixels.empty(); i++) {
+        m_console->runFrame();
+        pixels = m_console->getRGB();
+    }
+    ASSERT_FALSE(pixels.empty());
+
+    FrameInfo requested = m_console->getFrameInfo();
+    EXPECT_EQ(requested.sequence, 1u);
+    EXPECT_EQ(requested.hash, Util::hash(pixels.data(), pixels.size() * sizeof(pixels[0])));
+    EXPECT_EQ(requested.hash, drawn.hash);
+
+    // And only the one frame.
+    for (uint32_t i = 0; i < FRAMES; i++) { m_console->runFrame(); }
+    EXPECT_EQ(m_console->getFrameInfo().sequence, requested.sequence);
+    EXPECT_TRUE(m_console->getRGB().empty());
+}
+TEST_F(GameBoyTest, Headless) { testHeadless(); }
+
+void GameBoyTest::testFrameTiming(EmuSpeed speed, double multiplier)
+{
+    const double period = 1000.0 * FRAME_CYCLES / CLOCK_HZ / multiplier;
+
+    create(speed);
+    ASSERT_FALSE(HasFatalFailure());
+
+    // None of the presets are the speed that we were asked for, so it has to
+    // be set directly.
+    if (EmuSpeed::FREE == speed) {
+        m_console->setSpeed(multiplier);
+    }
+
+    // Nothing to report until the clock has been running for a while.
+    GameBoyInterface::Statistics stats = m_console->getStatistics();
+    EXPECT_EQ(stats.frameTime, 0.0);
+    EXPECT_EQ(stats.frameJitter, 0.0);
+
+    m_console->start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    stats = m_console->getStatistics();
+    m_console->stop();
+
+    EXPECT_NEAR(stats.frameTime, period, period * FRAME_TIME_TOLERANCE);
+    EXPECT_GE(stats.frameTimeMax, stats.frameTime);
+
+    // Being paced at all means that the frames come out at about the same
+    // time every time, so the jitter is nowhere near a whole frame.
+    EXPECT_GT(stats.frameJitter, 0.0);
+    EXPECT_LT(stats.frameJitter, period / 2);
+}
+TEST_F(GameBoyTest, FrameTimingNormal) { testFrameTiming(EmuSpeed::NORMAL, 1); }
+TEST_F(GameBoyTest, FrameTiming2X) { testFrameTiming(EmuSpeed::_2X, 2); }
+TEST_F(GameBoyTest, FrameTimingMultiplier) { testFrameTiming(EmuSpeed::FREE, 1.5); }
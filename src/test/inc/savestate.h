@@ -0,0 +1 @@
+../../hardware/savestate.h
\ No newline at end of file
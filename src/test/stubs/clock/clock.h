@@ -10,6 +10,8 @@ public:
     void setSpeed() { }
     void reset() { m_ticks = 0; }
 
+    inline uint32_t ticks() const { return m_ticks; }
+
 private:
     uint32_t m_ticks;
 };
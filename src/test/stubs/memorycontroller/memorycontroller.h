@@ -12,9 +12,14 @@
 #include <vector>
 #include <string>
 
+#include "memmap.h"
+#include "interrupt.h"
+
 class MemoryController final {
 public:
-    MemoryController() : m_memory(MEM_SIZE) { }
+    MemoryController()
+        : m_memory(MEM_SIZE),
+          m_interrupts(m_memory[INTERRUPT_MASK_ADDRESS], m_memory[INTERRUPT_FLAGS_ADDRESS]) { }
     ~MemoryController() = default;
 
     MemoryController(const MemoryController &) = delete;
@@ -28,28 +33,32 @@ public:
     uint8_t & read(uint16_t address);
     const uint8_t & peek(uint16_t address);
 
+    inline uint8_t & ioRegister(uint16_t address) { return read(address); }
+
+    inline InterruptController & interrupts() { return m_interrupts; }
+
     void reset() { }
     void setCartridge(const std::string&) { }
 
     void saveBIOS(const std::string&) { }
 
-    inline bool isRtcResetRequested() const { return false; }
-
-    inline void clearRtcReset()    { }
     inline void unlockBiosRegion() { }
 
     inline bool inBios() const { return false; }
     inline bool isCartridgeValid() const { return false; }
 
     inline bool isCGB() const { return true; }
+    inline bool supportsCGB() const { return true; }
 
     inline uint8_t romBank() const { return 0; }
     inline uint8_t ramBank() const { return 0; }
 
 private:
-    static constexpr uint16_t MEM_SIZE = 0xFFFF;
+    static constexpr uint32_t MEM_SIZE = 0x10000;
 
     std::vector<uint8_t> m_memory;
+
+    InterruptController m_interrupts;
 };
 
 #endif /* SRC_MEMORYCONTROLLER_H_ */
@@ -5,4 +5,5 @@ CONFIG += ordered
 TEMPLATE = subdirs
 
 SUBDIRS += cpu
+SUBDIRS += gameboy
 SUBDIRS += timer
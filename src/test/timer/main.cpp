@@ -21,12 +21,20 @@ protected:
     void testInit();
     void testTimeoutSetting();
     void testCounterTick();
-    // TODO: void testRtcTick();
+    void testDividerTick();
+    void testDividerEdge();
+    void testControlEdge();
     void testTimerModulo();
 
     MemoryController m_memory;
     TimerModule m_timer;
 
+    // The ticks that come in to the timer are at most a byte at a time.
+    void run(uint32_t ticks);
+
+    inline bool isInterrupted()
+        { return (m_memory.read(INTERRUPT_FLAGS_ADDRESS) & uint8_t(InterruptMask::TIMER)); }
+
 private:
     static const vector<pair<uint8_t, uint16_t>> SETTINGS;
 };
@@ -43,10 +51,17 @@ void TimerTest::SetUp()
     m_timer.reset();
 }
 
+void TimerTest::run(uint32_t ticks)
+{
+    for (; ticks > 0xFF; ticks -= 0xFF) { m_timer.cycle(0xFF); }
+    m_timer.cycle(uint8_t(ticks));
+}
+
 void TimerTest::testInit()
 {
-    EXPECT_EQ(m_timer.m_ticks, 0);
-    EXPECT_EQ(m_timer.m_rtc, 0);
+    EXPECT_EQ(m_timer.m_now, 0u);
+    EXPECT_EQ(m_timer.m_base, 0);
+    EXPECT_EQ(m_timer.m_due, UINT64_MAX);
     EXPECT_EQ(m_timer.m_divider, 0);
     EXPECT_EQ(m_timer.m_counter, 0);
     EXPECT_EQ(m_timer.m_modulo, 0);
@@ -64,8 +79,7 @@ void TimerTest::testTimeoutSetting()
     for (const auto & setting : SETTINGS) {
         auto [frequency, timeout] = setting;
 
-        m_memory.write(CPU_TIMER_CONTROL_ADDRESS, frequency | TimerModule::TIMER_ENABLE);
-        m_timer.cycle(1);
+        m_timer.writeControl(frequency | TimerModule::TIMER_ENABLE);
 
         EXPECT_EQ(timeout, m_timer.m_timeout);
     }
@@ -78,49 +92,136 @@ void TimerTest::testCounterTick()
         auto [frequency, timeout] = setting;
 
         m_timer.reset();
-        m_memory.write(CPU_TIMER_CONTROL_ADDRESS, frequency | TimerModule::TIMER_ENABLE);
+        m_timer.writeControl(frequency | TimerModule::TIMER_ENABLE);
+
+        // Nothing is going to happen until the counter overflows.
+        EXPECT_EQ(m_timer.m_due, uint64_t(timeout) * 0x100);
 
-        for (uint16_t i = 0; i < timeout; ++i) { m_timer.cycle(1); }
+        run(timeout - 1);
+        EXPECT_EQ(0, m_timer.readCounter());
 
-        EXPECT_EQ(1, m_timer.m_counter);
+        run(1);
+        EXPECT_EQ(1, m_timer.readCounter());
         EXPECT_EQ(1, m_memory.read(CPU_TIMER_COUNTER_ADDRESS));
-        EXPECT_EQ(0, m_timer.m_ticks);
 
         for (uint8_t i = 0; i < 0xFF; ++i) {
-            for (uint16_t j = 0; j < timeout; ++j) { m_timer.cycle(1); }
+            run(timeout);
 
             if (0xFE != i) {
-                ASSERT_EQ(i + 2, m_timer.m_counter);
+                ASSERT_EQ(i + 2, m_timer.readCounter());
                 ASSERT_EQ(i + 2, m_memory.read(CPU_TIMER_COUNTER_ADDRESS));
             }
         }
 
-        EXPECT_EQ(0, m_timer.m_counter);
+        EXPECT_EQ(0, m_timer.readCounter());
         EXPECT_EQ(0, m_memory.read(CPU_TIMER_COUNTER_ADDRESS));
 
-        uint8_t & ints = m_memory.read(INTERRUPT_FLAGS_ADDRESS);
-        EXPECT_EQ(ints & uint8_t(InterruptMask::TIMER), uint8_t(InterruptMask::TIMER));
+        EXPECT_TRUE(isInterrupted());
 
-        ints = uint8_t(InterruptMask::NONE);
+        m_memory.read(INTERRUPT_FLAGS_ADDRESS) = uint8_t(InterruptMask::NONE);
     }
 }
 TEST_F(TimerTest, CounterTick) { testCounterTick(); }
 
+void TimerTest::testDividerTick()
+{
+    // DIV goes up every 256 cycles whether the timer is on or not, and twice
+    // as often in double speed mode.
+    run(255);
+    EXPECT_EQ(0, m_timer.readDivider());
+
+    run(1);
+    EXPECT_EQ(1, m_timer.readDivider());
+    EXPECT_EQ(1, m_memory.read(CPU_TIMER_DIV_ADDRESS));
+
+    run(256 * 0xFF);
+    EXPECT_EQ(0, m_timer.readDivider());
+
+    m_timer.setSpeed(TimerModule::SPEED_DOUBLE);
+    run(128);
+    EXPECT_EQ(1, m_timer.readDivider());
+
+    // Writing anything at all starts it back over.
+    run(100);
+    m_timer.writeDivider();
+    EXPECT_EQ(0, m_timer.readDivider());
+
+    run(127);
+    EXPECT_EQ(0, m_timer.readDivider());
+}
+TEST_F(TimerTest, DividerTick) { testDividerTick(); }
+
+void TimerTest::testDividerEdge()
+{
+    const uint16_t timeout = TimerModule::TIMEOUT_252K;
+
+    m_timer.writeControl(0x01 | TimerModule::TIMER_ENABLE);
+
+    // Resetting the counter while the bit is low doesn't do anything.
+    run((timeout / 2) - 1);
+    m_timer.writeDivider();
+    EXPECT_EQ(0, m_timer.readCounter());
+
+    // Doing it while the bit is high is a falling edge.
+    run(timeout / 2);
+    m_timer.writeDivider();
+    EXPECT_EQ(1, m_timer.readCounter());
+
+    // Everything counts from the reset from then on out.
+    run(timeout - 1);
+    EXPECT_EQ(1, m_timer.readCounter());
+    run(1);
+    EXPECT_EQ(2, m_timer.readCounter());
+
+    // The edge can be the one that overflows.
+    m_timer.writeCounter(0xFF);
+    m_timer.writeModulo(0x80);
+    run(timeout / 2);
+    m_timer.writeDivider();
+    EXPECT_EQ(0x80, m_timer.readCounter());
+    EXPECT_TRUE(isInterrupted());
+}
+TEST_F(TimerTest, DividerEdge) { testDividerEdge(); }
+
+void TimerTest::testControlEdge()
+{
+    const uint16_t timeout = TimerModule::TIMEOUT_252K;
+
+    m_timer.writeControl(0x01 | TimerModule::TIMER_ENABLE);
+    run(timeout / 2);
+
+    // Turning the timer off while the bit is high is a falling edge, and it
+    // doesn't count while it's off.
+    m_timer.writeControl(0x01);
+    EXPECT_EQ(1, m_timer.readCounter());
+
+    run(timeout * 4);
+    EXPECT_EQ(1, m_timer.readCounter());
+    EXPECT_EQ(m_timer.m_due, UINT64_MAX);
+}
+TEST_F(TimerTest, ControlEdge) { testControlEdge(); }
+
 void TimerTest::testTimerModulo()
 {
     constexpr uint8_t modulo = 0x32;
 
-    m_memory.write(CPU_TIMER_MODULO_ADDRESS, modulo);
+    m_timer.writeModulo(modulo);
 
     EXPECT_EQ(modulo, m_timer.m_modulo);
 
-    m_memory.write(CPU_TIMER_CONTROL_ADDRESS, TimerModule::TIMEOUT_4K | TimerModule::TIMER_ENABLE);
+    m_timer.writeControl(TimerModule::TIMER_ENABLE);
+    m_timer.writeCounter(0xFF);
 
-    m_timer.m_ticks   = TimerModule::TIMEOUT_4K - 1;
-    m_timer.m_counter = 0xFF;
+    run(TimerModule::TIMEOUT_4K - 1);
+    EXPECT_EQ(0xFF, m_timer.readCounter());
+    EXPECT_FALSE(isInterrupted());
 
-    m_timer.cycle(1);
+    run(1);
+    EXPECT_EQ(modulo, m_timer.readCounter());
+    EXPECT_TRUE(isInterrupted());
 
-    EXPECT_EQ(modulo, m_timer.m_counter);
+    // It keeps counting up from the modulo.
+    run(TimerModule::TIMEOUT_4K * 3);
+    EXPECT_EQ(modulo + 3, m_timer.readCounter());
 }
 TEST_F(TimerTest, Modulo) { testTimerModulo(); }
@@ -169,6 +169,18 @@ ApplicationWindow {
                         }
                     }
                 }
+                Action {
+                    id: m_quad
+
+                    text: qsTr("Quadruple")
+                    checkable: true
+                    ActionGroup.group: m_speed
+                    onTriggered: {
+                        if (true === m_quad.checked) {
+                            m_screen.emu_speed = EmulationSpeed.SPEED_QUAD;
+                        }
+                    }
+                }
                 Action {
                     id: m_free
 
@@ -232,6 +244,8 @@ ApplicationWindow {
             m_normal.checked = true;
         } else if (EmulationSpeed.SPEED_DOUBLE === speed) {
             m_double.checked = true;
+        } else if (EmulationSpeed.SPEED_QUAD === speed) {
+            m_quad.checked = true;
         } else if (EmulationSpeed.SPEED_FREE === speed) {
             m_free.checked = true;
         }
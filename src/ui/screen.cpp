@@ -37,6 +37,7 @@ Screen::Screen(QQuickItem *parent)
       m_width(GameBoyInterface::WIDTH),
       m_height(GameBoyInterface::HEIGHT),
       m_canvas(m_width, m_height, QImage::Format_RGBA8888),
+      m_frame({ 0, 0 }),
       m_stopped(true)
 {
     setFlag(ItemHasContents, true);
@@ -48,6 +49,8 @@ Screen::Screen(QQuickItem *parent)
     string filename = (args.size() < 2) ?
         Configuration::getString(ConfigKey::ROM) : args.at(1).toStdString();
 
+    if (args.size() > 2) { m_movie = args.at(2).toStdString(); }
+
     m_rom = QString::fromStdString(filename);
     reset(filename);
 }
@@ -63,12 +66,16 @@ void Screen::stop()
 
     m_timer.stop();
 
-    if (m_console) { m_console->stop(); }
+    if (m_console) {
+        m_console->stop();
+        m_console->stopRecording();
+    }
 }
 
 void Screen::setLinkMaster(bool master)
 {
     Configuration::updateBool(ConfigKey::LINK_MASTER, master);
+    configure();
 }
 bool Screen::getLinkMaster() const
 {
@@ -78,6 +85,7 @@ bool Screen::getLinkMaster() const
 void Screen::setLinkType(ScreenTypes::ConsoleLinkType type)
 {
     Configuration::updateInt(ConfigKey::LINK_TYPE, type);
+    configure();
 }
 ScreenTypes::ConsoleLinkType Screen::getLinkType() const
 {
@@ -87,6 +95,7 @@ ScreenTypes::ConsoleLinkType Screen::getLinkType() const
 void Screen::setSpeed(ScreenTypes::EmulationSpeed speed)
 {
     Configuration::updateInt(ConfigKey::SPEED, speed);
+    configure();
 }
 ScreenTypes::EmulationSpeed Screen::getSpeed() const
 {
@@ -96,6 +105,7 @@ ScreenTypes::EmulationSpeed Screen::getSpeed() const
 void Screen::setMode(ScreenTypes::EmulationMode mode)
 {
     Configuration::updateInt(ConfigKey::EMU_MODE, mode);
+    configure();
 }
 ScreenTypes::EmulationMode Screen::getMode() const
 {
@@ -105,12 +115,20 @@ ScreenTypes::EmulationMode Screen::getMode() const
 void Screen::setLinkEnable(bool enable)
 {
     Configuration::updateBool(ConfigKey::LINK_ENABLE, enable);
+    configure();
 }
 bool Screen::getLinkEnable() const
 {
     return Configuration::getBool(ConfigKey::LINK_ENABLE);
 }
 
+void Screen::configure()
+{
+    // The console has its own copy of the settings, so it needs to be handed
+    // the new ones whenever they change.
+    if (m_console) { m_console->configure(Configuration::instance().snapshot()); }
+}
+
 void Screen::setROM(QString rom)
 {
     string filename = QUrl(rom).toLocalFile().toStdString();
@@ -130,6 +148,9 @@ void Screen::reset(const string & path)
     m_console = shared_ptr<GameBoyInterface>(GameBoyInterface::Instance());
     assert(m_console);
 
+    // The new console starts numbering its frames all over again.
+    m_frame = { 0, 0 };
+
 #ifdef WIN32
     string filename = path;
 
@@ -145,7 +166,14 @@ void Screen::reset(const string & path)
         Configuration::updateString(ConfigKey::ROM, filename);
     }
 
+    // We only sample the frame buffer every refresh timeout, which is slower
+    // than the emulated frame rate, so let the GPU skip frames we won't see.
+    m_console->setFrameSkip(GameBoyInterface::FRAMESKIP_AUTO);
+
     m_console->load(filename);
+
+    if (!m_movie.empty()) { m_console->startRecording(m_movie); }
+
     m_console->start();
 
     m_timer.setInterval(REFRESH_TIMEOUT);
@@ -181,9 +209,24 @@ void Screen::paint(QPainter *painter)
 
 void Screen::onTimeout()
 {
-    ColorArray rgb = m_console->getRGB();
+    // There's no reason to touch the canvas unless a new frame has shown up
+    // and it actually looks different from the one that we already have.
+    GameBoyInterface::FrameInfo frame = m_console->getFrameInfo();
+    if (frame.sequence == m_frame.sequence) { return; }
+
+    // Taking the frame is what tells the GPU that somebody looked at it, so
+    // that it goes on to draw the next one when it's skipping frames, so it
+    // gets taken even when it's the same as the one that we already have.
+    // Another frame could have been drawn since we looked, so the one that
+    // we get is the one that goes with the pixels.
+    ColorArray rgb = m_console->getRGB(frame);
     if (rgb.empty()) { return; }
 
+    bool unchanged = (0 != m_frame.sequence) && (frame.hash == m_frame.hash);
+
+    m_frame = frame;
+    if (unchanged) { return; }
+
     for (size_t i = 0; i < rgb.size(); i++) {
         const GB::RGB & color = rgb.at(i);
 
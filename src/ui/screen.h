@@ -38,6 +38,7 @@ namespace ScreenTypes {
         SPEED_NORMAL = 0,
         SPEED_DOUBLE = 1,
         SPEED_FREE   = 2,
+        SPEED_QUAD   = 3,
     };
     Q_ENUM_NS(EmulationSpeed);
 
@@ -128,11 +129,20 @@ private:
 
     std::shared_ptr<GameBoyInterface> m_console;
 
+    // The frame that is currently sitting in the canvas.
+    GameBoyInterface::FrameInfo m_frame;
+
     bool m_stopped;
 
     QTimer m_timer;
 
     QString m_rom;
+
+    // Everything that gets played gets recorded in to the movie (if there
+    // is one), starting over every time that the console gets reset.
+    std::string m_movie;
+
+    void configure();
 };
 
 #endif
@@ -26,6 +26,9 @@ const list<ConfigKey> Configuration::KEYS = {
     ConfigKey::LINK_TYPE,
     ConfigKey::LINK_ADDR,
     ConfigKey::LINK_ENABLE,
+    ConfigKey::DETERMINISTIC,
+    ConfigKey::RTC_START,
+    ConfigKey::FAST_BOOT,
 };
 
 const Configuration::ConfigMap Configuration::DEFAULT_CONFIG{
@@ -61,6 +64,18 @@ const Configuration::ConfigMap Configuration::DEFAULT_CONFIG{
         uint8_t(ConfigKey::LINK_ENABLE),
         Configuration::Setting(new BoolValue(false))
     },
+    {
+        uint8_t(ConfigKey::DETERMINISTIC),
+        Configuration::Setting(new BoolValue(false))
+    },
+    {
+        uint8_t(ConfigKey::RTC_START),
+        Configuration::Setting(new IntValue(0))
+    },
+    {
+        uint8_t(ConfigKey::FAST_BOOT),
+        Configuration::Setting(new BoolValue(false))
+    },
 };
 
 Configuration Configuration::s_instance;
@@ -94,14 +109,8 @@ void Configuration::parse(const string & file)
         auto iterator = m_settings.find(uint8_t(std::stoi(key)));
         if (m_settings.end() == iterator) { continue; }
 
-        Setting setting;
-        if (SettingValue::TYPE_STRING == type) {
-            setting = Setting(new StringValue(value));
-        } else if (SettingValue::TYPE_INT == type) {
-            setting = Setting(new IntValue(value));
-        } else if (SettingValue::TYPE_BOOL == type) {
-            setting = Setting(new BoolValue(value));
-        } else {
+        Setting setting = create(type, value);
+        if (!setting) {
             WARN("Unknown configuration data type: %s\n", type.c_str());
             continue;
         }
@@ -110,6 +119,30 @@ void Configuration::parse(const string & file)
     }
 }
 
+Configuration::Setting Configuration::create(const string & type, const string & value)
+{
+    if (SettingValue::TYPE_STRING == type) {
+        return Setting(new StringValue(value));
+    } else if (SettingValue::TYPE_INT == type) {
+        return Setting(new IntValue(value));
+    } else if (SettingValue::TYPE_BOOL == type) {
+        return Setting(new BoolValue(value));
+    }
+    return nullptr;
+}
+
+ConfigSnapshot Configuration::snapshot() const
+{
+    // The settings get updated in place, so every one of them needs to be
+    // copied for the snapshot to stay the same.
+    ConfigSnapshot::SettingMap settings;
+    for (const auto & entry : m_settings) {
+        const Setting & setting = entry.second;
+        settings.emplace(entry.first, create(setting->type(), setting->toString()));
+    }
+    return ConfigSnapshot(settings);
+}
+
 void Configuration::save(const string & file) const
 {
     if (file.empty()) { return; }
@@ -150,6 +183,9 @@ string Configuration::toString(ConfigKey key)
     CASE(ConfigKey::LINK_ADDR);
     CASE(ConfigKey::LINK_TYPE);
     CASE(ConfigKey::LINK_ENABLE);
+    CASE(ConfigKey::DETERMINISTIC);
+    CASE(ConfigKey::RTC_START);
+    CASE(ConfigKey::FAST_BOOT);
 
     default: break;
     }
@@ -208,3 +244,63 @@ bool Configuration::updateInt(ConfigKey key, int value)
 {
     return update<int>(key, value, SettingValue::TYPE_INT);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+ConfigSnapshot::ConfigSnapshot()
+    : ConfigSnapshot(Configuration::instance().snapshot())
+{
+
+}
+
+ConfigSnapshot::Setting ConfigSnapshot::find(ConfigKey key) const
+{
+    auto iterator = m_settings.find(uint8_t(key));
+    return (m_settings.end() == iterator) ? nullptr : iterator->second;
+}
+
+string ConfigSnapshot::getString(ConfigKey key, string def) const
+{
+    Setting setting = find(key);
+    return (setting) ? setting->toString() : def;
+}
+
+int ConfigSnapshot::getInt(ConfigKey key, int def) const
+{
+    Setting setting = find(key);
+    return (setting) ? setting->toInt() : def;
+}
+
+bool ConfigSnapshot::getBool(ConfigKey key, bool def) const
+{
+    Setting setting = find(key);
+    return (setting) ? setting->toBool() : def;
+}
+
+ConfigSnapshot ConfigSnapshot::with(ConfigKey key, const string & value) const
+{
+    return change<string>(key, value);
+}
+
+ConfigSnapshot ConfigSnapshot::with(ConfigKey key, bool value) const
+{
+    return change<bool>(key, value);
+}
+
+ConfigSnapshot ConfigSnapshot::with(ConfigKey key, int value) const
+{
+    return change<int>(key, value);
+}
+
+vector<ConfigKey> ConfigSnapshot::diff(const ConfigSnapshot & other) const
+{
+    vector<ConfigKey> keys;
+    for (const auto & entry : m_settings) {
+        ConfigKey key = ConfigKey(entry.first);
+
+        Setting theirs = other.find(key);
+        if (!theirs || (theirs->toString() != entry.second->toString())) {
+            keys.push_back(key);
+        }
+    }
+    return keys;
+}
@@ -20,6 +20,16 @@ enum class ConfigKey : uint8_t {
     LINK_TYPE   = 5,
     LINK_ADDR   = 6,
     LINK_ENABLE = 7,
+
+    // Runs only on emulated time, so that the same cartridge and the same
+    // input always play out exactly the same way.  The RTC start is the
+    // time (in seconds) that the cartridge clock reads when it gets loaded.
+    DETERMINISTIC = 8,
+    RTC_START     = 9,
+
+    // Skips the BIOS and starts the cartridge with everything set up the
+    // way that the BIOS leaves it.
+    FAST_BOOT     = 10,
 };
 
 enum class EmuMode : uint8_t {
@@ -28,10 +38,13 @@ enum class EmuMode : uint8_t {
     DMG  = 2,
 };
 
+// The speeds that the UI offers.  A console can be paced at any multiple of
+// the real speed through GameBoyInterface::setSpeed.
 enum class EmuSpeed : uint8_t {
     NORMAL = 0,
     _2X    = 1,
     FREE   = 2,
+    _4X    = 3,
 };
 
 enum class LinkType : uint8_t {
@@ -39,6 +52,8 @@ enum class LinkType : uint8_t {
     PIPE   = 1,
 };
 
+class ConfigSnapshot;
+
 class ConfigChangeListener {
 public:
     virtual void onConfigChange(ConfigKey key) = 0;
@@ -67,6 +82,11 @@ public:
 
     std::string str() const;
 
+    // Copies out the current settings.  The copy doesn't change when the
+    // settings are updated, so it's safe to hand off to anybody that needs a
+    // consistent view of the configuration (i.e. a console instance).
+    ConfigSnapshot snapshot() const;
+
     static std::string toString(ConfigKey key);
 
     static bool updateString(ConfigKey key, const std::string & value);
@@ -179,6 +199,8 @@ public:
 
     using Setting = std::shared_ptr<SettingValue>;
 
+    static Setting create(const std::string & type, const std::string & value);
+
     Setting operator[](ConfigKey key) const
     {
         auto iterator = m_settings.find(uint8_t(key));
@@ -205,6 +227,62 @@ private:
     void broadcastUpdate(ConfigKey key);
 };
 
+class ConfigSnapshot {
+public:
+    ConfigSnapshot();
+    ~ConfigSnapshot() = default;
+
+    std::string getString(ConfigKey key, std::string def = "") const;
+    int getInt(ConfigKey key, int def = 0) const;
+    bool getBool(ConfigKey key, bool def = false) const;
+
+    template <typename T>
+    inline T getEnum(ConfigKey key) const { return T(getInt(key)); }
+
+    // Returns a copy of this snapshot with a single setting changed, which is
+    // how one instance gets different settings than the rest of the process
+    // without touching the shared configuration.
+    ConfigSnapshot with(ConfigKey key, const std::string & value) const;
+    ConfigSnapshot with(ConfigKey key, bool value) const;
+    ConfigSnapshot with(ConfigKey key, int value) const;
+    inline ConfigSnapshot with(ConfigKey key, const char *value) const
+        { return with(key, std::string(value)); }
+
+    // The keys whose values are different between the two snapshots.
+    std::vector<ConfigKey> diff(const ConfigSnapshot & other) const;
+
+private:
+    friend class Configuration;
+
+    using Setting = std::shared_ptr<const Configuration::SettingValue>;
+    using SettingMap = std::unordered_map<uint8_t, Setting>;
+
+    explicit ConfigSnapshot(const SettingMap & settings) : m_settings(settings) { }
+
+    Setting find(ConfigKey key) const;
+
+    template <typename T>
+    ConfigSnapshot change(ConfigKey key, const T & value) const;
+
+    // None of the settings ever get modified after the snapshot is created,
+    // so copies of a snapshot are free to share them.
+    SettingMap m_settings;
+};
+
+template <typename T>
+ConfigSnapshot ConfigSnapshot::change(ConfigKey key, const T & value) const
+{
+    Setting setting = find(key);
+    if (!setting) { return *this; }
+
+    Configuration::Setting copy = Configuration::create(setting->type(), setting->toString());
+    copy->set(value);
+
+    ConfigSnapshot snapshot(*this);
+    snapshot.m_settings[uint8_t(key)] = copy;
+    return snapshot;
+}
+
 template <typename T>
 bool Configuration::update(ConfigKey key, const T & value, const char *type)
 {
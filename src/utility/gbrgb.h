@@ -19,7 +19,7 @@ namespace GB {
         RGB() : RGB(0, 0, 0, 0) { }
 
         RGB(const RGB & other)
-            : RGB(other.red, other.blue, other.green, other.alpha) { }
+            : RGB(other.red, other.green, other.blue, other.alpha) { }
 
         RGB & operator=(const RGB & other)
         {
@@ -46,3 +46,102 @@ string Util::join(const vector<string> & pieces, const string & sep)
         });
     return output;
 }
+
+namespace {
+    constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t rotl(uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    // Always little endian, no matter what the host is, so that the same
+    // bytes hash the same way everywhere.
+    inline uint64_t read64(const uint8_t *data)
+    {
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; i--) { value = (value << 8) | data[i]; }
+        return value;
+    }
+
+    inline uint32_t read32(const uint8_t *data)
+    {
+        uint32_t value = 0;
+        for (int i = 3; i >= 0; i--) { value = (value << 8) | data[i]; }
+        return value;
+    }
+
+    inline uint64_t step(uint64_t accumulator, uint64_t input)
+    {
+        accumulator += input * PRIME_2;
+        return rotl(accumulator, 31) * PRIME_1;
+    }
+
+    inline uint64_t merge(uint64_t hash, uint64_t accumulator)
+    {
+        hash ^= step(0, accumulator);
+        return (hash * PRIME_1) + PRIME_4;
+    }
+}
+
+uint64_t Util::hash(const void *data, size_t length, uint64_t seed)
+{
+    const uint8_t *input = static_cast<const uint8_t*>(data);
+    const uint8_t *end   = input + length;
+
+    uint64_t hash;
+    if (length >= 32) {
+        // The four lanes don't depend on each other, so the compiler is free
+        // to vectorize the bulk of the work.
+        uint64_t v1 = seed + PRIME_1 + PRIME_2;
+        uint64_t v2 = seed + PRIME_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME_1;
+
+        for (const uint8_t *limit = end - 32; input <= limit; input += 32) {
+            v1 = step(v1, read64(input));
+            v2 = step(v2, read64(input + 8));
+            v3 = step(v3, read64(input + 16));
+            v4 = step(v4, read64(input + 24));
+        }
+
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = merge(hash, v1);
+        hash = merge(hash, v2);
+        hash = merge(hash, v3);
+        hash = merge(hash, v4);
+    } else {
+        hash = seed + PRIME_5;
+    }
+
+    hash += uint64_t(length);
+
+    for (; (input + 8) <= end; input += 8) {
+        hash ^= step(0, read64(input));
+        hash  = (rotl(hash, 27) * PRIME_1) + PRIME_4;
+    }
+
+    if ((input + 4) <= end) {
+        hash ^= uint64_t(read32(input)) * PRIME_1;
+        hash  = (rotl(hash, 23) * PRIME_2) + PRIME_3;
+        input += 4;
+    }
+
+    for (; input < end; input++) {
+        hash ^= uint64_t(*input) * PRIME_5;
+        hash  = rotl(hash, 11) * PRIME_1;
+    }
+
+    // Make sure that every input bit has a chance to flip every output bit.
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <cstddef>
 
 namespace Util {
     std::vector<std::string> split(
@@ -14,6 +16,11 @@ namespace Util {
     std::string join(
         const std::vector<std::string> & pieces,
         const std::string & sep = ":");
+
+    // A 64 bit xxHash (XXH64) of the given bytes.  It isn't cryptographic,
+    // but it's fast and it's stable across runs and platforms, so it's good
+    // for telling two buffers apart and for golden checksums.
+    uint64_t hash(const void *data, size_t length, uint64_t seed = 0);
 };
 
 #endif